@@ -0,0 +1,34 @@
+#pragma once
+#include "type.h"
+#include <vector>
+
+namespace Rehenz
+{
+	// geometry of .obj file
+	// faces are triangulated as fans, faces with a missing position are dropped,
+	// materials, groups and other statements are ignored
+	struct ObjData
+	{
+	public:
+		// 3 floats per v
+		std::vector<float> positions;
+		// 2 floats per vt
+		std::vector<float> uvs;
+		// 3 floats per vn
+		std::vector<float> normals;
+		// 3 corners per triangle, 3 ints per corner : v, vt, vn
+		// indices are 0-based, -1 if missing
+		std::vector<int> corners;
+	};
+
+	// parse float at p, no locale and no allocation, stop at end or first invalid char
+	// return position after the number, p if there is no number
+	const char* ParseFloat(const char* p, const char* end, float& value);
+
+	// parse .obj text, split on line boundaries and parse by threads, 0 is hardware concurrency
+	// small text is parsed by calling thread
+	void ParseObj(const char* text, size_t size, ObjData& data, int threads = 0);
+
+	// memory-map and parse .obj file, return false if file can not be opened or is empty
+	bool ReadObjFile(const std::string& filename, ObjData& data, int threads = 0);
+}
@@ -1,46 +1,170 @@
 #include "drawer.h"
 #include "util.h"
 #include <cassert>
+#include <algorithm>
 
 namespace Rehenz
 {
-	DrawerBase::DrawerBase(uint* _buffer, int _width, int _height)
-		: buffer(_buffer), w(_width), h(_height)
+	// compute span [left,right) of triangle in the row whose center is yc
+	// p1.y <= p2.y <= p3.y, p1.y < p3.y, and p1.y <= yc < p3.y
+	// pixel x is covered when left <= x + 0.5 < right
+	inline void TriangleSpan(const Point& p1, const Point& p2, const Point& p3, float yc, float& left, float& right)
 	{
+		float x13 = p1.x + (yc - p1.y) * ((p3.x - p1.x) / (p3.y - p1.y));
+		float x_short = (yc < p2.y) ? p1.x + (yc - p1.y) * ((p2.x - p1.x) / (p2.y - p1.y))
+			: p2.x + (yc - p2.y) * ((p3.x - p2.x) / (p3.y - p2.y));
+		left = Min(x13, x_short);
+		right = Max(x13, x_short);
 	}
 
-	DrawerBase::~DrawerBase()
+	// depth test and write a span of unorm z, compared in stored integers
+	template <typename T, uint Scale, bool Reversed>
+	inline void DepthSpanUnorm(T* zrow, int x_begin, int x_end, float z, float dzdx)
+	{
+		for (int x = x_begin; x < x_end; x++)
+		{
+			T q = static_cast<T>(Clamp(z, 0.0f, 1.0f) * Scale + 0.5f);
+			if (Reversed ? q > zrow[x] : q < zrow[x])
+				zrow[x] = q;
+			z += dzdx;
+		}
+	}
+
+	int DepthBuffer::PixelSize(DepthFormat format)
+	{
+		return (format == DepthFormat::Unorm16) ? 2 : 4;
+	}
+
+	void DepthBuffer::Fill(int begin, int end, float z) const
+	{
+		switch (format)
+		{
+		case DepthFormat::Unorm16:
+			std::fill(static_cast<word*>(data) + begin, static_cast<word*>(data) + end,
+				static_cast<word>(Clamp(z, 0.0f, 1.0f) * 0xffff + 0.5f));
+			break;
+		case DepthFormat::Unorm24:
+			std::fill(static_cast<uint*>(data) + begin, static_cast<uint*>(data) + end,
+				static_cast<uint>(Clamp(z, 0.0f, 1.0f) * 0xffffff + 0.5f));
+			break;
+		default:
+			std::fill(static_cast<float*>(data) + begin, static_cast<float*>(data) + end, z);
+		}
+	}
+
+	TileClear::TileClear(int _width, int _height)
+		: w(_width), h(_height),
+		tiles_x((_width + tile_size - 1) / tile_size), tiles_y((_height + tile_size - 1) / tile_size),
+		flags(static_cast<size_t>(tiles_x) * tiles_y, 0)
+	{
+		buffer = nullptr;
+		pitch = _width;
+		sample_buffer = nullptr;
+		sample_zbuffer = nullptr;
+		samples = 1;
+		color = 0;
+		z = 1.0f;
+	}
+
+	TileClear::~TileClear()
+	{
+	}
+
+	void TileClear::SetBuffers(uint* _buffer, DepthBuffer _zbuffer, uint* _sample_buffer, float* _sample_zbuffer, int _samples, int _pitch)
+	{
+		buffer = _buffer;
+		pitch = (_pitch == 0) ? w : _pitch;
+		zbuffer = _zbuffer;
+		sample_buffer = _sample_buffer;
+		sample_zbuffer = _sample_zbuffer;
+		samples = _samples;
+	}
+
+	void TileClear::ClearColor(uint _color)
+	{
+		color = _color;
+		for (auto& f : flags)
+			f |= pending_color;
+	}
+
+	void TileClear::ClearZ(float _z)
+	{
+		z = _z;
+		for (auto& f : flags)
+			f |= pending_z;
+	}
+
+	void TileClear::ClearTile(int t)
+	{
+		int x0 = (t % tiles_x) * tile_size, y0 = (t / tiles_x) * tile_size;
+		int x1 = Min(x0 + tile_size, w), y1 = Min(y0 + tile_size, h);
+		for (int y = y0; y < y1; y++)
+		{
+			int i = y * w + x0, n = x1 - x0;
+			if (flags[t] & pending_color)
+			{
+				if (buffer != nullptr)
+					std::fill(buffer + y * pitch + x0, buffer + y * pitch + x1, color);
+				if (sample_buffer != nullptr)
+					std::fill(sample_buffer + i * samples, sample_buffer + (i + n) * samples, color);
+			}
+			if (flags[t] & pending_z)
+			{
+				if (zbuffer.data != nullptr)
+					zbuffer.Fill(i, i + n, z);
+				if (sample_zbuffer != nullptr)
+					std::fill(sample_zbuffer + i * samples, sample_zbuffer + (i + n) * samples, z);
+			}
+		}
+		flags[t] = 0;
+	}
+
+	void TileClear::Finish()
+	{
+		for (int t = 0; t < tiles_x * tiles_y; t++)
+		{
+			if (!(flags[t] & pending_color) || buffer == nullptr)
+				continue;
+			int x0 = (t % tiles_x) * tile_size, y0 = (t / tiles_x) * tile_size;
+			int x1 = Min(x0 + tile_size, w), y1 = Min(y0 + tile_size, h);
+			for (int y = y0; y < y1; y++)
+				std::fill(buffer + y * pitch + x0, buffer + y * pitch + x1, color);
+			flags[t] &= ~pending_color;
+		}
+	}
+
+	DrawerBase::DrawerBase(uint* _buffer, int _width, int _height, int _pitch)
+		: buffer(_buffer), w(_width), h(_height), pitch((_pitch == 0) ? _width : _pitch), tile_clear(nullptr)
 	{
 	}
 
-	uint DrawerBase::white = ColorRGB(255, 255, 255);
-	uint DrawerBase::black = ColorRGB(0, 0, 0);
-	uint DrawerBase::red = ColorRGB(255, 0, 0);
-	uint DrawerBase::green = ColorRGB(0, 255, 0);
-	uint DrawerBase::blue = ColorRGB(0, 0, 255);
-	uint DrawerBase::yellow = ColorRGB(255, 255, 0);
-	uint DrawerBase::magenta = ColorRGB(255, 0, 255);
-	uint DrawerBase::cyan = ColorRGB(0, 255, 255);
+	DrawerBase::~DrawerBase()
+	{
+	}
 
-	uint DrawerBase::red_l = ColorRGB(242, 129, 128);
-	uint DrawerBase::yellow_l = ColorRGB(223, 218, 129);
-	uint DrawerBase::blue_l = ColorRGB(141, 219, 254);
-	uint DrawerBase::green_l = ColorRGB(149, 224, 129);
-	uint DrawerBase::purple_l = ColorRGB(141, 133, 253);
-	uint DrawerBase::pink_l = ColorRGB(231, 162, 244);
-	uint DrawerBase::orange_l = ColorRGB(255, 178, 125);
+	// definitions of constexpr static members, they are odr-used when bound to references
+	constexpr uint DrawerBase::white, DrawerBase::black, DrawerBase::red, DrawerBase::green;
+	constexpr uint DrawerBase::blue, DrawerBase::yellow, DrawerBase::magenta, DrawerBase::cyan;
+	constexpr uint DrawerBase::red_l, DrawerBase::yellow_l, DrawerBase::blue_l, DrawerBase::green_l;
+	constexpr uint DrawerBase::purple_l, DrawerBase::pink_l, DrawerBase::orange_l;
 
 	void DrawerBase::Fill(uint color)
 	{
-		int s = w * h;
-		for (int i = 0; i < s; i++)
-			buffer[i] = color;
+		if (tile_clear != nullptr)
+		{
+			tile_clear->ClearColor(color);
+			return;
+		}
+		for (int y = 0; y < h; y++)
+			std::fill(buffer + y * pitch, buffer + y * pitch + w, color);
 	}
 
 	void DrawerBase::Pixel(Point2I p, uint color)
 	{
 		assert(p.x >= 0 && p.x < w&& p.y >= 0 && p.y < h);
-		int i = p.y * w + p.x;
+		if (tile_clear != nullptr)
+			tile_clear->Touch(p.y, p.x, p.x + 1);
+		int i = p.y * pitch + p.x;
 		buffer[i] = color;
 	}
 
@@ -84,8 +208,8 @@ namespace Rehenz
 		}
 	}
 
-	Drawer::Drawer(uint* _buffer, int _width, int _height)
-		: DrawerBase(_buffer, _width, _height)
+	Drawer::Drawer(uint* _buffer, int _width, int _height, int _pitch)
+		: DrawerBase(_buffer, _width, _height, _pitch)
 	{
 	}
 
@@ -277,8 +401,8 @@ namespace Rehenz
 		}
 	}
 
-	DrawerF::DrawerF(uint* _buffer, int _width, int _height)
-		: DrawerBase(_buffer, _width, _height)
+	DrawerF::DrawerF(uint* _buffer, int _width, int _height, int _pitch)
+		: DrawerBase(_buffer, _width, _height, _pitch)
 	{
 	}
 
@@ -421,10 +545,22 @@ namespace Rehenz
 	{
 		assert(v.p.x >= 0 && v.p.x < w&& v.p.y >= 0 && v.p.y < h);
 		int i = static_cast<int>(v.p.y) * w + static_cast<int>(v.p.x);
-		if (v.p.z < zbuffer[i])
+		uint& dst = buffer[static_cast<int>(v.p.y) * pitch + static_cast<int>(v.p.x)];
+		float z = zbuffer.Quantize(v.p.z);
+		if (ZTest(z, zbuffer.Load(i)))
 		{
-			buffer[i] = ColorRGB(ps(*ps_data, VertexRecover(v)));
-			zbuffer[i] = v.p.z;
+			Color c = ps(*ps_data, VertexRecover(v));
+			if (output == Output::Opaque)
+			{
+				dst = ColorRGB(c);
+				if (!z_equal)
+					zbuffer.Store(i, z);
+			}
+			else if (output == Output::Blend)
+				dst = ColorBlend(dst, c);
+			else
+				kbuffer->Insert(static_cast<int>(v.p.x), static_cast<int>(v.p.y), v.p.z, c);
+			pixel_count++;
 		}
 	}
 
@@ -435,6 +571,8 @@ namespace Rehenz
 			if (v2.p.x > v1.p.x)
 			{
 				float x = NextHalf(v1.p.x);
+				if (tile_clear != nullptr)
+					tile_clear->Touch(static_cast<int>(y), static_cast<int>(x), Min(static_cast<int>(ceilf(v2.p.x - 0.5f)), w));
 				Vertex ddv = (v2 - v1) * (1.0f / (v2.p.x - v1.p.x));
 				Vertex v = v1 + ddv * (x - v1.p.x);
 				for (; x < v2.p.x; x += 1.0f)
@@ -448,22 +586,171 @@ namespace Rehenz
 		}
 	}
 
-	DrawerV::DrawerV(uint* _buffer, int _width, int _height, float* _zbuffer)
-		: DrawerBase(_buffer, _width, _height), zbuffer(_zbuffer)
+	DrawerV::VertexPlane::VertexPlane(const Vertex& v)
+		: a{ v.p.x, v.p.y, v.p.z, v.n.x, v.n.y, v.n.z, v.c.x, v.c.y, v.c.z, v.c.w, v.uv.x, v.uv.y, v.uv2.x, v.uv2.y, v.coef, 0 }
+	{
+	}
+
+	void DrawerV::Quad(int x, int y, int mask, const VertexPlane& v, const VertexPlane& ddx, const VertexPlane& ddy,
+		PixelShaderPacket& pixel_shader)
+	{
+		const int n = PixelPacket::size;
+		const float ox[n]{ 0, 1, 0, 1 };
+		const float oy[n]{ 0, 0, 1, 1 };
+		int index[n]{ y * w + x, y * w + x + 1, (y + 1) * w + x, (y + 1) * w + x + 1 };
+		uint* pixels[n]{ buffer + y * pitch + x, buffer + y * pitch + x + 1, buffer + (y + 1) * pitch + x, buffer + (y + 1) * pitch + x + 1 };
+
+		// early z test
+		float z[n];
+		for (int i = 0; i < n; i++)
+			z[i] = zbuffer.Quantize(v.a[2] + ddx.a[2] * ox[i] + ddy.a[2] * oy[i]);
+		for (int i = 0; i < n; i++)
+		{
+			if ((mask & (1 << i)) && !ZTest(z[i], zbuffer.Load(index[i])))
+				mask &= ~(1 << i);
+		}
+		if (mask == 0)
+			return;
+
+		// evaluate attributes, and divide by coef to recover them
+		PixelPacket pp;
+		pp.mask = mask;
+		float f[n];
+		for (int i = 0; i < n; i++)
+			f[i] = 1 / (v.a[14] + ddx.a[14] * ox[i] + ddy.a[14] * oy[i]);
+		float* const dst[16]{ pp.px, pp.py, pp.pz, pp.nx, pp.ny, pp.nz, pp.r, pp.g, pp.b, pp.a, pp.u, pp.v, pp.u2, pp.v2 };
+		for (int k = 0; k < 3; k++)
+		{
+			for (int i = 0; i < n; i++)
+				dst[k][i] = v.a[k] + ddx.a[k] * ox[i] + ddy.a[k] * oy[i];
+		}
+		for (int k = 3; k < 14; k++)
+		{
+			for (int i = 0; i < n; i++)
+				dst[k][i] = (v.a[k] + ddx.a[k] * ox[i] + ddy.a[k] * oy[i]) * f[i];
+		}
+
+		ColorPacket cp;
+		pixel_shader(*ps_data, pp, cp);
+
+		if (output == Output::Blend)
+		{
+			// blend all lanes, then write covered lanes
+			float r[n], g[n], b[n];
+			for (int i = 0; i < n; i++)
+			{
+				float a = Clamp(cp.a[i], 0.0f, 1.0f), f = (1 - a) / 0xff;
+				uint d = (mask & (1 << i)) ? *pixels[i] : 0;
+				r[i] = Clamp(cp.r[i], 0.0f, 1.0f) * a + ((d >> 16) & 0xff) * f;
+				g[i] = Clamp(cp.g[i], 0.0f, 1.0f) * a + ((d >> 8) & 0xff) * f;
+				b[i] = Clamp(cp.b[i], 0.0f, 1.0f) * a + ((d >> 0) & 0xff) * f;
+			}
+			for (int i = 0; i < n; i++)
+			{
+				if (mask & (1 << i))
+				{
+					*pixels[i] = ColorRGB(static_cast<int>(r[i] * 0xff + 0.5f),
+						static_cast<int>(g[i] * 0xff + 0.5f), static_cast<int>(b[i] * 0xff + 0.5f));
+					pixel_count++;
+				}
+			}
+			return;
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			if (mask & (1 << i))
+			{
+				if (output == Output::Opaque)
+				{
+					*pixels[i] = ColorRGB(cp.GetColor(i));
+					if (!z_equal)
+						zbuffer.Store(index[i], z[i]);
+				}
+				else
+					kbuffer->Insert(x + (i & 1), y + (i >> 1), z[i], cp.GetColor(i));
+				pixel_count++;
+			}
+		}
+	}
+
+	DrawerV::DrawerV(uint* _buffer, int _width, int _height, DepthBuffer _zbuffer, int _pitch)
+		: DrawerBase(_buffer, _width, _height, _pitch), zbuffer(_zbuffer)
 	{
 		ps = nullptr;
 		ps_data = nullptr;
+		output = Output::Opaque;
+		kbuffer = nullptr;
+		sample_buffer = nullptr;
+		sample_zbuffer = nullptr;
+		z_equal = false;
+		z_reversed = false;
+		// allow two steps of stored z for integer formats
+		z_epsilon = Max(1e-5f, zbuffer.GetPrecision() * 4);
+		pixel_count = 0;
+		shading_rate = ShadingRate::Rate1x1;
+		shading_rate_image = nullptr;
+		shading_rate_image_w = 0;
 	}
 
 	DrawerV::~DrawerV()
 	{
 	}
 
+	void DrawerV::SetZReversed(bool _z_reversed)
+	{
+		z_reversed = _z_reversed;
+		if (kbuffer != nullptr)
+			kbuffer->SetZReversed(z_reversed);
+	}
+
+	void DrawerV::SetOutput(Output _output, KBuffer* _kbuffer)
+	{
+		output = _output;
+		kbuffer = _kbuffer;
+		if (kbuffer != nullptr)
+			kbuffer->SetZReversed(z_reversed);
+	}
+
 	void DrawerV::FillZ(float z)
 	{
+		if (tile_clear != nullptr)
+		{
+			tile_clear->ClearZ(z);
+			return;
+		}
 		int s = w * h;
-		for (int i = 0; i < s; i++)
-			zbuffer[i] = z;
+		zbuffer.Fill(0, s, z);
+		if (sample_zbuffer != nullptr)
+			std::fill(sample_zbuffer, sample_zbuffer + s * msaa_samples, z);
+	}
+
+	void DrawerV::ResolveMsaa()
+	{
+		assert(sample_buffer != nullptr && msaa_samples == 4);
+		// samples of untouched tiles are stale, so only touched tiles are resolved
+		const int tile_size = TileClear::tile_size;
+		for (int y0 = 0; y0 < h; y0 += tile_size)
+		{
+			for (int x0 = 0; x0 < w; x0 += tile_size)
+			{
+				if (tile_clear != nullptr && tile_clear->IsColorPending(x0, y0))
+					continue;
+				int x1 = Min(x0 + tile_size, w), y1 = Min(y0 + tile_size, h);
+				for (int y = y0; y < y1; y++)
+				{
+					uint* row = buffer + y * pitch;
+					const uint* c = sample_buffer + (y * w + x0) * 4;
+					for (int x = x0; x < x1; x++, c += 4)
+					{
+						// sum r,b and g in separate 16 bits lanes, then round and divide by 4
+						uint rb = (c[0] & 0x00ff00ff) + (c[1] & 0x00ff00ff) + (c[2] & 0x00ff00ff) + (c[3] & 0x00ff00ff) + 0x00020002;
+						uint g = (c[0] & 0x0000ff00) + (c[1] & 0x0000ff00) + (c[2] & 0x0000ff00) + (c[3] & 0x0000ff00) + 0x00000200;
+						row[x] = ((rb >> 2) & 0x00ff00ff) | ((g >> 2) & 0x0000ff00);
+					}
+				}
+			}
+		}
 	}
 
 	void DrawerV::Triangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, PixelShader pixel_shader, const PixelShaderData& _ps_data)
@@ -471,6 +758,17 @@ namespace Rehenz
 		this->ps = pixel_shader;
 		this->ps_data = &_ps_data;
 
+		if (sample_buffer != nullptr)
+		{
+			TriangleMsaa(v1, v2, v3);
+			return;
+		}
+		if (shading_rate != ShadingRate::Rate1x1 || shading_rate_image != nullptr)
+		{
+			TriangleCoarse(v1, v2, v3);
+			return;
+		}
+
 		const Vertex* v_miny = &v1, * v_midy = &v2, * v_maxy = &v3;
 		if (v_maxy->p.y < v_midy->p.y)
 			std::swap(v_midy, v_maxy);
@@ -540,4 +838,531 @@ namespace Rehenz
 		}
 	}
 
-}
\ No newline at end of file
+	ShadingRate DrawerV::GetShadingRate(int x, int y)
+	{
+		if (shading_rate_image == nullptr)
+			return shading_rate;
+		int a = static_cast<int>(shading_rate);
+		int b = static_cast<int>(shading_rate_image[(y / shading_rate_tile) * shading_rate_image_w + x / shading_rate_tile]);
+		return static_cast<ShadingRate>(Max(a & 0xf0, b & 0xf0) | Max(a & 0x0f, b & 0x0f));
+	}
+
+	void DrawerV::Block(int x, int y, int bw, int bh, const float* left, const float* right,
+		const Point& p1, const VertexPlane& a1, const VertexPlane& ddx, const VertexPlane& ddy)
+	{
+		// pixels pass z test
+		int index[16], offset[16];
+		float z[16];
+		int n = 0;
+		float sx = 0, sy = 0;
+		for (int j = 0; j < bh && y + j < h; j++)
+		{
+			float yc = y + j + 0.5f;
+			for (int i = 0; i < bw && x + i < w; i++)
+			{
+				float xc = x + i + 0.5f;
+				if (!(left[j] <= xc && xc < right[j]))
+					continue;
+				float zq = zbuffer.Quantize(a1.a[2] + ddx.a[2] * (xc - p1.x) + ddy.a[2] * (yc - p1.y));
+				int k = (y + j) * w + x + i;
+				if (!ZTest(zq, zbuffer.Load(k)))
+					continue;
+				index[n] = k;
+				offset[n] = (y + j) * pitch + x + i;
+				z[n] = zq;
+				n++;
+				sx += xc;
+				sy += yc;
+			}
+		}
+		if (n == 0)
+			return;
+
+		// centers are in the triangle, so is their mean, then attributes are not extrapolated
+		float xs = sx / n, ys = sy / n;
+		float a[15];
+		for (int k = 0; k < 15; k++)
+			a[k] = a1.a[k] + ddx.a[k] * (xs - p1.x) + ddy.a[k] * (ys - p1.y);
+		Vertex v(Point(a[0], a[1], a[2]), Vector(a[3], a[4], a[5]), Color(a[6], a[7], a[8], a[9]),
+			UV(a[10], a[11]), UV(a[12], a[13]), a[14]);
+		Color c = ps(*ps_data, VertexRecover(v));
+
+		if (output == Output::Opaque)
+		{
+			uint u = ColorRGB(c);
+			for (int i = 0; i < n; i++)
+			{
+				buffer[offset[i]] = u;
+				if (!z_equal)
+					zbuffer.Store(index[i], z[i]);
+			}
+		}
+		else if (output == Output::Blend)
+		{
+			for (int i = 0; i < n; i++)
+				buffer[offset[i]] = ColorBlend(buffer[offset[i]], c);
+		}
+		else
+		{
+			for (int i = 0; i < n; i++)
+				kbuffer->Insert(index[i] % w, index[i] / w, z[i], c);
+		}
+		pixel_count += n;
+	}
+
+	void DrawerV::TriangleCoarse(const Vertex& v1, const Vertex& v2, const Vertex& v3)
+	{
+		const Vertex* v_miny = &v1, * v_midy = &v2, * v_maxy = &v3;
+		if (v_maxy->p.y < v_midy->p.y)
+			std::swap(v_midy, v_maxy);
+		if (v_midy->p.y < v_miny->p.y)
+			std::swap(v_miny, v_midy);
+		if (v_maxy->p.y < v_midy->p.y)
+			std::swap(v_midy, v_maxy);
+		const Point& p1 = v_miny->p, & p2 = v_midy->p, & p3 = v_maxy->p;
+
+		// plane equations, see packet version of Triangle
+		float dx12 = p2.x - p1.x, dy12 = p2.y - p1.y;
+		float dx13 = p3.x - p1.x, dy13 = p3.y - p1.y;
+		float det = dx12 * dy13 - dx13 * dy12;
+		if (det == 0)
+			return;
+		VertexPlane a1(*v_miny), a2(*v_midy), a3(*v_maxy), ddx, ddy;
+		for (int k = 0; k < 15; k++)
+		{
+			float e12 = a2.a[k] - a1.a[k], e13 = a3.a[k] - a1.a[k];
+			ddx.a[k] = (e12 * dy13 - e13 * dy12) / det;
+			ddy.a[k] = (e13 * dx12 - e12 * dx13) / det;
+		}
+
+		// blocks of every rate are aligned in 4x4 pixels
+		const int n = 4;
+		int row_begin = static_cast<int>(NextHalf(p1.y));
+		int row_end = Min(static_cast<int>(ceilf(p3.y - 0.5f)), h);
+		for (int y = row_begin & ~(n - 1); y < row_end; y += n)
+		{
+			float left[n], right[n];
+			int x_begin = w, x_end = 0;
+			for (int j = 0; j < n; j++)
+			{
+				int row = y + j;
+				left[j] = 1.0f, right[j] = 0.0f; // empty
+				if (row < row_begin || row >= row_end)
+					continue;
+				TriangleSpan(p1, p2, p3, row + 0.5f, left[j], right[j]);
+				int xb = static_cast<int>(NextHalf(left[j]));
+				int xe = Min(static_cast<int>(ceilf(right[j] - 0.5f)), w);
+				if (xb < xe)
+				{
+					if (tile_clear != nullptr)
+						tile_clear->Touch(row, xb, xe);
+					x_begin = Min(x_begin, xb);
+					x_end = Max(x_end, xe);
+				}
+			}
+
+			for (int x = x_begin & ~(n - 1); x < x_end; x += n)
+			{
+				ShadingRate rate = GetShadingRate(x, y);
+				int bw = static_cast<int>(rate) >> 4, bh = static_cast<int>(rate) & 0x0f;
+				for (int by = 0; by < n; by += bh)
+				{
+					for (int bx = 0; bx < n; bx += bw)
+						Block(x + bx, y + by, bw, bh, left + by, right + by, p1, a1, ddx, ddy);
+				}
+			}
+		}
+	}
+
+	void DrawerV::Triangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, PixelShaderPacket pixel_shader, const PixelShaderData& _ps_data)
+	{
+		assert(sample_buffer == nullptr);
+		this->ps_data = &_ps_data;
+
+		const Vertex* v_miny = &v1, * v_midy = &v2, * v_maxy = &v3;
+		if (v_maxy->p.y < v_midy->p.y)
+			std::swap(v_midy, v_maxy);
+		if (v_midy->p.y < v_miny->p.y)
+			std::swap(v_miny, v_midy);
+		if (v_maxy->p.y < v_midy->p.y)
+			std::swap(v_midy, v_maxy);
+		const Point& p1 = v_miny->p, & p2 = v_midy->p, & p3 = v_maxy->p;
+
+		// all attributes are multiplied by 1/w, so they are linear in screen space
+		// v(x,y) = v1 + ddx * (x - x1) + ddy * (y - y1)
+		float dx12 = p2.x - p1.x, dy12 = p2.y - p1.y;
+		float dx13 = p3.x - p1.x, dy13 = p3.y - p1.y;
+		float det = dx12 * dy13 - dx13 * dy12;
+		if (det == 0)
+			return;
+		VertexPlane a1(*v_miny), a2(*v_midy), a3(*v_maxy), ddx, ddy;
+		for (int k = 0; k < 15; k++)
+		{
+			float e12 = a2.a[k] - a1.a[k], e13 = a3.a[k] - a1.a[k];
+			ddx.a[k] = (e12 * dy13 - e13 * dy12) / det;
+			ddy.a[k] = (e13 * dx12 - e12 * dx13) / det;
+		}
+
+		// rows whose center is in [y1,y3), quads are aligned to even pixels
+		int row_begin = static_cast<int>(NextHalf(p1.y));
+		int row_end = static_cast<int>(ceilf(p3.y - 0.5f)); // last row + 1
+		row_end = Min(row_end, h);
+		for (int y = row_begin & ~1; y < row_end; y += 2)
+		{
+			float left[2], right[2];
+			int x_begin = w, x_end = 0;
+			for (int j = 0; j < 2; j++)
+			{
+				int row = y + j;
+				left[j] = 1.0f, right[j] = 0.0f; // empty
+				if (row < row_begin || row >= row_end)
+					continue;
+				TriangleSpan(p1, p2, p3, row + 0.5f, left[j], right[j]);
+				if (left[j] < right[j])
+				{
+					x_begin = Min(x_begin, static_cast<int>(NextHalf(left[j])));
+					x_end = Max(x_end, static_cast<int>(ceilf(right[j] - 0.5f)));
+				}
+			}
+			x_end = Min(x_end, w);
+			if (x_begin >= x_end)
+				continue;
+			if (tile_clear != nullptr)
+			{
+				tile_clear->Touch(y, x_begin & ~1, Min(x_end + 1, w));
+				if (y + 1 < h)
+					tile_clear->Touch(y + 1, x_begin & ~1, Min(x_end + 1, w));
+			}
+
+			float yc = y + 0.5f;
+			for (int x = x_begin & ~1; x < x_end; x += 2)
+			{
+				float xc = x + 0.5f;
+				int mask = 0;
+				if (left[0] <= xc && xc < right[0]) mask |= 1;
+				if (left[0] <= xc + 1 && xc + 1 < right[0] && x + 1 < w) mask |= 2;
+				if (left[1] <= xc && xc < right[1]) mask |= 4;
+				if (left[1] <= xc + 1 && xc + 1 < right[1] && x + 1 < w) mask |= 8;
+				if (mask == 0)
+					continue;
+				VertexPlane v;
+				for (int k = 0; k < 15; k++)
+					v.a[k] = a1.a[k] + ddx.a[k] * (xc - p1.x) + ddy.a[k] * (yc - p1.y);
+				Quad(x, y, mask, v, ddx, ddy, pixel_shader);
+			}
+		}
+	}
+
+	const float DrawerV::msaa_offset_x[DrawerV::msaa_samples]{ -2 / 16.0f, 6 / 16.0f, -6 / 16.0f, 2 / 16.0f };
+	const float DrawerV::msaa_offset_y[DrawerV::msaa_samples]{ -6 / 16.0f, -2 / 16.0f, 2 / 16.0f, 6 / 16.0f };
+
+	void DrawerV::TriangleMsaa(const Vertex& v1, const Vertex& v2, const Vertex& v3)
+	{
+		const int n = msaa_samples;
+		const Vertex* v_miny = &v1, * v_midy = &v2, * v_maxy = &v3;
+		if (v_maxy->p.y < v_midy->p.y)
+			std::swap(v_midy, v_maxy);
+		if (v_midy->p.y < v_miny->p.y)
+			std::swap(v_miny, v_midy);
+		if (v_maxy->p.y < v_midy->p.y)
+			std::swap(v_midy, v_maxy);
+		const Point& p1 = v_miny->p, & p2 = v_midy->p, & p3 = v_maxy->p;
+
+		// plane equations, see packet version of Triangle
+		float dx12 = p2.x - p1.x, dy12 = p2.y - p1.y;
+		float dx13 = p3.x - p1.x, dy13 = p3.y - p1.y;
+		float det = dx12 * dy13 - dx13 * dy12;
+		if (det == 0)
+			return;
+		VertexPlane a1(*v_miny), a2(*v_midy), a3(*v_maxy), ddx, ddy;
+		for (int k = 0; k < 15; k++)
+		{
+			float e12 = a2.a[k] - a1.a[k], e13 = a3.a[k] - a1.a[k];
+			ddx.a[k] = (e12 * dy13 - e13 * dy12) / det;
+			ddy.a[k] = (e13 * dx12 - e12 * dx13) / det;
+		}
+
+		// each sample follows rasterization rule of pixel center
+		int row_begin = Max(static_cast<int>(floorf(p1.y - 1)), 0);
+		int row_end = Min(static_cast<int>(ceilf(p3.y + 1)), h);
+		for (int y = row_begin; y < row_end; y++)
+		{
+			float left[n], right[n];
+			float x_min = static_cast<float>(w), x_max = 0;
+			for (int s = 0; s < n; s++)
+			{
+				float ys = y + 0.5f + msaa_offset_y[s];
+				left[s] = 1.0f, right[s] = 0.0f; // empty
+				if (ys < p1.y || ys >= p3.y)
+					continue;
+				TriangleSpan(p1, p2, p3, ys, left[s], right[s]);
+				if (left[s] < right[s])
+				{
+					x_min = Min(x_min, left[s]);
+					x_max = Max(x_max, right[s]);
+				}
+			}
+			int x_begin = Max(static_cast<int>(floorf(x_min - 1)), 0);
+			int x_end = Min(static_cast<int>(ceilf(x_max + 1)), w);
+			if (tile_clear != nullptr)
+				tile_clear->Touch(y, x_begin, x_end);
+
+			float yc = y + 0.5f;
+			for (int x = x_begin; x < x_end; x++)
+			{
+				float xc = x + 0.5f;
+				int i = (y * w + x) * n;
+				float zc = a1.a[2] + ddx.a[2] * (xc - p1.x) + ddy.a[2] * (yc - p1.y);
+				float z[n];
+				int mask = 0;
+				for (int s = 0; s < n; s++)
+				{
+					float xs = xc + msaa_offset_x[s];
+					z[s] = zc + ddx.a[2] * msaa_offset_x[s] + ddy.a[2] * msaa_offset_y[s];
+					if (left[s] <= xs && xs < right[s] && ZTest(z[s], sample_zbuffer[i + s]))
+						mask |= 1 << s;
+				}
+				if (mask == 0)
+					continue;
+
+				// shade at pixel center even if it is outside
+				float a[15];
+				for (int k = 0; k < 15; k++)
+					a[k] = a1.a[k] + ddx.a[k] * (xc - p1.x) + ddy.a[k] * (yc - p1.y);
+				Vertex v(Point(a[0], a[1], a[2]), Vector(a[3], a[4], a[5]), Color(a[6], a[7], a[8], a[9]),
+					UV(a[10], a[11]), UV(a[12], a[13]), a[14]);
+				Color c = ps(*ps_data, VertexRecover(v));
+
+				if (output == Output::Opaque)
+				{
+					uint u = ColorRGB(c);
+					for (int s = 0; s < n; s++)
+					{
+						if (mask & (1 << s))
+						{
+							sample_buffer[i + s] = u;
+							if (!z_equal)
+								sample_zbuffer[i + s] = z[s];
+						}
+					}
+				}
+				else if (output == Output::Blend)
+				{
+					for (int s = 0; s < n; s++)
+					{
+						if (mask & (1 << s))
+							sample_buffer[i + s] = ColorBlend(sample_buffer[i + s], c);
+					}
+				}
+				else
+				{
+					// k-buffer is per pixel, so weight alpha by coverage
+					int count = 0;
+					for (int s = 0; s < n; s++)
+						count += (mask >> s) & 1;
+					c.w *= static_cast<float>(count) / n;
+					kbuffer->Insert(x, y, zc, c);
+				}
+				pixel_count++;
+			}
+		}
+	}
+
+	DrawerZ::DrawerZ(DepthBuffer _zbuffer, int _width, int _height)
+		: zbuffer(_zbuffer), w(_width), h(_height), tile_clear(nullptr), z_reversed(false)
+	{
+	}
+
+	DrawerZ::~DrawerZ()
+	{
+	}
+
+	void DrawerZ::FillZ(float z)
+	{
+		if (tile_clear != nullptr)
+		{
+			tile_clear->ClearZ(z);
+			return;
+		}
+		zbuffer.Fill(0, w * h, z);
+	}
+
+	void DrawerZ::Triangle(Point p1, Point p2, Point p3)
+	{
+		if (p3.y < p2.y)
+			std::swap(p2, p3);
+		if (p2.y < p1.y)
+			std::swap(p1, p2);
+		if (p3.y < p2.y)
+			std::swap(p2, p3);
+		// now p1.y <= p2.y <= p3.y
+
+		// z(x,y) = z1 + dzdx * (x - x1) + dzdy * (y - y1)
+		float dx12 = p2.x - p1.x, dy12 = p2.y - p1.y, dz12 = p2.z - p1.z;
+		float dx13 = p3.x - p1.x, dy13 = p3.y - p1.y, dz13 = p3.z - p1.z;
+		float det = dx12 * dy13 - dx13 * dy12;
+		if (det == 0)
+			return;
+		float dzdx = (dz12 * dy13 - dz13 * dy12) / det;
+		float dzdy = (dz13 * dx12 - dz12 * dx13) / det;
+
+		for (float yc = NextHalf(p1.y); yc < p3.y; yc += 1.0f)
+		{
+			float left, right;
+			TriangleSpan(p1, p2, p3, yc, left, right);
+			int x_begin = static_cast<int>(NextHalf(left));
+			int x_end = Min(static_cast<int>(ceilf(right - 0.5f)), w);
+			if (tile_clear != nullptr)
+				tile_clear->Touch(static_cast<int>(yc), x_begin, x_end);
+			int row = static_cast<int>(yc) * w;
+			float z = p1.z + dzdx * (x_begin + 0.5f - p1.x) + dzdy * (yc - p1.y);
+			switch (zbuffer.format)
+			{
+			case DepthFormat::Unorm16:
+				if (z_reversed)
+					DepthSpanUnorm<word, 0xffff, true>(static_cast<word*>(zbuffer.data) + row, x_begin, x_end, z, dzdx);
+				else
+					DepthSpanUnorm<word, 0xffff, false>(static_cast<word*>(zbuffer.data) + row, x_begin, x_end, z, dzdx);
+				break;
+			case DepthFormat::Unorm24:
+				if (z_reversed)
+					DepthSpanUnorm<uint, 0xffffff, true>(static_cast<uint*>(zbuffer.data) + row, x_begin, x_end, z, dzdx);
+				else
+					DepthSpanUnorm<uint, 0xffffff, false>(static_cast<uint*>(zbuffer.data) + row, x_begin, x_end, z, dzdx);
+				break;
+			default:
+			{
+				float* zrow = static_cast<float*>(zbuffer.data) + row;
+				if (z_reversed)
+				{
+					for (int x = x_begin; x < x_end; x++)
+					{
+						zrow[x] = Max(zrow[x], z);
+						z += dzdx;
+					}
+				}
+				else
+				{
+					for (int x = x_begin; x < x_end; x++)
+					{
+						zrow[x] = Min(zrow[x], z);
+						z += dzdx;
+					}
+				}
+			}
+			}
+		}
+	}
+
+	uint KBuffer::Pack(const float c[4])
+	{
+		uint u = 0;
+		for (int i = 0; i < 4; i++)
+			u = (u << 8) | static_cast<uint>(Clamp(c[i], 0.0f, 1.0f) * 0xff + 0.5f);
+		return u;
+	}
+
+	uint KBuffer::Over(uint front, uint back)
+	{
+		// front + back * (1 - front.a), two channels per multiply
+		// premultiplied channels never exceed alpha, so the sum never carries
+		uint f = 0xff - (front >> 24);
+		uint rb = (back & 0x00ff00ff) * f + 0x00800080;
+		rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+		uint ag = ((back >> 8) & 0x00ff00ff) * f + 0x00800080;
+		ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+		return front + rb + ag;
+	}
+
+	KBuffer::KBuffer(int _width, int _height)
+		: w(_width), h(_height),
+		tiles_x((_width + tile_size - 1) / tile_size), tiles_y((_height + tile_size - 1) / tile_size),
+		z_reversed(false), tiles(static_cast<size_t>(tiles_x) * tiles_y)
+	{
+	}
+
+	KBuffer::~KBuffer()
+	{
+	}
+
+	void KBuffer::Insert(int x, int y, float z, Color c)
+	{
+		assert(x >= 0 && x < w && y >= 0 && y < h);
+		int t = (y / tile_size) * tiles_x + x / tile_size;
+		auto& tile = tiles[t];
+		if (tile == nullptr)
+			tile = std::make_unique<Tile>(); // zero initialized
+		if (!tile->touched)
+		{
+			tile->touched = true;
+			touched.push_back(t);
+		}
+
+		int i = (y % tile_size) * tile_size + x % tile_size;
+		int n = tile->count[i];
+		Fragment* frags = tile->fragments[i];
+
+		// a, r, g, b
+		float a = Clamp(c.w, 0.0f, 1.0f);
+		float pc[4]{ a, c.x * a, c.y * a, c.z * a };
+		// fragments are kept by ascending z, so reversed z is negated to keep nearest first
+		if (z_reversed)
+			z = -z;
+		Fragment frag{ z, Pack(pc) };
+
+		// insert sorted by z, nearest first
+		int j = n;
+		if (n == k)
+		{
+			if (z >= frags[k - 1].z)
+			{
+				frags[k - 1].c = Over(frags[k - 1].c, frag.c);
+				return;
+			}
+			// the last one is pushed out, merge it with its front
+			frags[k - 1].c = Over(frags[k - 2].z > z ? frags[k - 2].c : frag.c, frags[k - 1].c);
+			if (frags[k - 2].z <= z)
+			{
+				frags[k - 1].z = z;
+				return;
+			}
+			frags[k - 1].z = frags[k - 2].z;
+			j = k - 2;
+		}
+		else
+			tile->count[i]++;
+		for (; j > 0 && frags[j - 1].z > z; j--)
+			frags[j] = frags[j - 1];
+		frags[j] = frag;
+	}
+
+	void KBuffer::Resolve(uint* buffer, int pitch)
+	{
+		if (pitch == 0)
+			pitch = w;
+		for (int t : touched)
+		{
+			Tile& tile = *tiles[t];
+			int x0 = (t % tiles_x) * tile_size, y0 = (t / tiles_x) * tile_size;
+			int x1 = Min(x0 + tile_size, w), y1 = Min(y0 + tile_size, h);
+			for (int y = y0; y < y1; y++)
+			{
+				for (int x = x0; x < x1; x++)
+				{
+					int i = (y - y0) * tile_size + (x - x0);
+					int n = tile.count[i];
+					if (n == 0)
+						continue;
+					// alpha of buffer is 0, and is cleared after blending
+					uint c = buffer[y * pitch + x] & 0x00ffffff;
+					for (int j = n - 1; j >= 0; j--)
+						c = Over(tile.fragments[i][j].c, c);
+					buffer[y * pitch + x] = c & 0x00ffffff;
+					tile.count[i] = 0;
+				}
+			}
+			tile.touched = false;
+		}
+		touched.clear();
+	}
+}
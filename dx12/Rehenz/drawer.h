@@ -9,9 +9,154 @@ namespace Rehenz
 	class Drawer;
 	class DrawerF;
 	class DrawerV;
+	class DrawerZ;
+	class KBuffer;
+	class TileClear;
+	class DepthBuffer;
 
 
 
+	// Float32 : float
+	// Unorm16 : 16 bits unorm, half memory of Float32
+	// Unorm24 : 24 bits unorm in low bits of 32 bits, same precision at any depth
+	enum class DepthFormat { Float32, Unorm16, Unorm24 };
+
+	// pixels shaded once, width x height, high 4 bits are width and low 4 bits are height
+	enum class ShadingRate : uchar { Rate1x1 = 0x11, Rate1x2 = 0x12, Rate2x1 = 0x21, Rate2x2 = 0x22, Rate4x4 = 0x44 };
+
+	// z-buffer of drawers, z is in [0,1], and quantized to format when stored
+	class DepthBuffer
+	{
+	public:
+		DepthFormat format;
+		void* data;
+
+		DepthBuffer() : format(DepthFormat::Float32), data(nullptr) {}
+		DepthBuffer(float* zbuffer) : format(DepthFormat::Float32), data(zbuffer) {}
+		DepthBuffer(DepthFormat _format, void* _data) : format(_format), data(_data) {}
+
+		// bytes per pixel
+		static int PixelSize(DepthFormat format);
+
+		// max error of stored z
+		inline float GetPrecision() const
+		{
+			return (format == DepthFormat::Unorm16) ? 0.5f / 0xffff : (format == DepthFormat::Unorm24) ? 0.5f / 0xffffff : 0.0f;
+		}
+
+		inline float Load(int i) const
+		{
+			switch (format)
+			{
+			case DepthFormat::Unorm16:
+				return static_cast<const word*>(data)[i] * (1.0f / 0xffff);
+			case DepthFormat::Unorm24:
+				return static_cast<const uint*>(data)[i] * (1.0f / 0xffffff);
+			default:
+				return static_cast<const float*>(data)[i];
+			}
+		}
+
+		inline void Store(int i, float z) const
+		{
+			switch (format)
+			{
+			case DepthFormat::Unorm16:
+				static_cast<word*>(data)[i] = static_cast<word>(Clamp(z, 0.0f, 1.0f) * 0xffff + 0.5f);
+				break;
+			case DepthFormat::Unorm24:
+				static_cast<uint*>(data)[i] = static_cast<uint>(Clamp(z, 0.0f, 1.0f) * 0xffffff + 0.5f);
+				break;
+			default:
+				static_cast<float*>(data)[i] = z;
+			}
+		}
+
+		// z after store and load
+		inline float Quantize(float z) const
+		{
+			switch (format)
+			{
+			case DepthFormat::Unorm16:
+				return static_cast<word>(Clamp(z, 0.0f, 1.0f) * 0xffff + 0.5f) * (1.0f / 0xffff);
+			case DepthFormat::Unorm24:
+				return static_cast<uint>(Clamp(z, 0.0f, 1.0f) * 0xffffff + 0.5f) * (1.0f / 0xffffff);
+			default:
+				return z;
+			}
+		}
+
+		// fill [begin,end)
+		void Fill(int begin, int end, float z) const;
+	};
+
+	// clear buffers lazily by tiles, then a clear costs O(tiles) rather than O(pixels)
+	// a tile is cleared when drawers first touch it, and Finish fills color of tiles nothing drew
+	class TileClear
+	{
+	public:
+		static const int tile_size = 16;
+
+	private:
+		static const uchar pending_color = 1;
+		static const uchar pending_z = 2;
+
+		const int w;
+		const int h;
+		const int tiles_x;
+		const int tiles_y;
+		std::vector<uchar> flags;
+
+		uint* buffer;
+		int pitch;
+		DepthBuffer zbuffer;
+		uint* sample_buffer;
+		float* sample_zbuffer;
+		int samples;
+		uint color;
+		float z;
+
+		void ClearTile(int t);
+
+	public:
+		TileClear(int _width, int _height);
+		~TileClear();
+
+		inline int GetWidth() { return w; }
+		inline int GetHeight() { return h; }
+
+		// buffers to clear, nullptr if not used
+		// sample buffers have _samples values per pixel, see DrawerV::SetMsaa
+		// _pitch is row stride of buffer in pixels, 0 means width
+		void SetBuffers(uint* _buffer, DepthBuffer _zbuffer, uint* _sample_buffer = nullptr, float* _sample_zbuffer = nullptr,
+			int _samples = 1, int _pitch = 0);
+
+		// mark all tiles, and clear them later
+		void ClearColor(uint _color);
+		void ClearZ(float _z);
+
+		// call it before drawing pixels [x_begin,x_end) of row y
+		inline void Touch(int y, int x_begin, int x_end)
+		{
+			if (x_begin >= x_end)
+				return;
+			int row = (y / tile_size) * tiles_x;
+			for (int t = row + x_begin / tile_size; t <= row + (x_end - 1) / tile_size; t++)
+			{
+				if (flags[t])
+					ClearTile(t);
+			}
+		}
+
+		// fill color of tiles which are not touched
+		void Finish();
+		// true if tile of pixel (x,y) is not touched, so Finish fills its color
+		inline bool IsColorPending(int x, int y) const
+		{
+			return buffer != nullptr && (flags[(y / tile_size) * tiles_x + x / tile_size] & pending_color);
+		}
+	};
+
 	// drawer base class, provide Fill, Pixel, ColorRGB, and some colors
 	class DrawerBase
 	{
@@ -19,12 +164,17 @@ namespace Rehenz
 		uint* const buffer;
 		const int w;
 		const int h;
+		// row stride of buffer in pixels, other buffers such as z-buffer are packed by w
+		const int pitch;
+		// clear lazily if not nullptr
+		TileClear* tile_clear;
 
 	public:
-		DrawerBase(uint* _buffer, int _width, int _height);
+		// _pitch is row stride of buffer in pixels, 0 means _width
+		DrawerBase(uint* _buffer, int _width, int _height, int _pitch = 0);
 		~DrawerBase();
 
-		inline static uint ColorRGB(int r, int g, int b)
+		constexpr static uint ColorRGB(int r, int g, int b)
 		{
 			return ((r & 0xff) << 16) | ((g & 0xff) << 8) | ((b & 0xff) << 0);
 		}
@@ -32,15 +182,30 @@ namespace Rehenz
 		{
 			return ColorRGB(static_cast<int>(c.x * 0xff), static_cast<int>(c.y * 0xff), static_cast<int>(c.z * 0xff));
 		}
+		// blend src over dst by alpha of src
+		inline static uint ColorBlend(uint dst, Color src)
+		{
+			float a = Clamp(src.w, 0.0f, 1.0f), f = (1 - a) / 0xff;
+			float r = Clamp(src.x, 0.0f, 1.0f) * a + ((dst >> 16) & 0xff) * f;
+			float g = Clamp(src.y, 0.0f, 1.0f) * a + ((dst >> 8) & 0xff) * f;
+			float b = Clamp(src.z, 0.0f, 1.0f) * a + ((dst >> 0) & 0xff) * f;
+			return ColorRGB(static_cast<int>(r * 0xff + 0.5f), static_cast<int>(g * 0xff + 0.5f), static_cast<int>(b * 0xff + 0.5f));
+		}
 
-		static uint white, black, red, green, blue, yellow, magenta, cyan;
-		static uint red_l;
-		static uint yellow_l;
-		static uint blue_l;
-		static uint green_l;
-		static uint purple_l;
-		static uint pink_l;
-		static uint orange_l;
+		// same as ColorRGB, which can not be called before the class is complete
+		static constexpr uint white = 0xffffff, black = 0x000000, red = 0xff0000, green = 0x00ff00;
+		static constexpr uint blue = 0x0000ff, yellow = 0xffff00, magenta = 0xff00ff, cyan = 0x00ffff;
+		static constexpr uint red_l = 0xf28180; // (242, 129, 128)
+		static constexpr uint yellow_l = 0xdfda81; // (223, 218, 129)
+		static constexpr uint blue_l = 0x8ddbfe; // (141, 219, 254)
+		static constexpr uint green_l = 0x95e081; // (149, 224, 129)
+		static constexpr uint purple_l = 0x8d85fd; // (141, 133, 253)
+		static constexpr uint pink_l = 0xe7a2f4; // (231, 162, 244)
+		static constexpr uint orange_l = 0xffb27d; // (255, 178, 125)
+
+		// use lazy clear for Fill, FillZ, and all drawing, nullptr to disable
+		// buffers of tile clear must be same with drawer
+		inline void SetTileClear(TileClear* _tile_clear) { tile_clear = _tile_clear; }
 
 		// fill with a color
 		void Fill(uint color);
@@ -68,7 +233,7 @@ namespace Rehenz
 			int& x2, int& x2_offset, int dx2, int dy2, uint color);
 
 	public:
-		Drawer(uint* _buffer, int _width, int _height);
+		Drawer(uint* _buffer, int _width, int _height, int _pitch = 0);
 		~Drawer();
 
 		// draw line including all end points
@@ -103,7 +268,7 @@ namespace Rehenz
 		void Trapezoid(float& y, float y_bottom, float& x1, float a1, float& x2, float a2, uint color);
 
 	public:
-		DrawerF(uint* _buffer, int _width, int _height);
+		DrawerF(uint* _buffer, int _width, int _height, int _pitch = 0);
 		~DrawerF();
 
 		using DrawerBase::Pixel;
@@ -137,12 +302,46 @@ namespace Rehenz
 	// use z-buffer
 	class DrawerV : public DrawerBase
 	{
+	public:
+		// Opaque : write color and z-buffer
+		// Blend  : blend color over buffer, keep z-buffer
+		// OIT    : insert color into k-buffer, keep z-buffer
+		enum class Output { Opaque, Blend, OIT };
+
 	private:
-		float* const zbuffer;
+		const DepthBuffer zbuffer;
+
+		Output output;
+		KBuffer* kbuffer;
+
+		// 4x msaa, see SetMsaa
+		uint* sample_buffer;
+		float* sample_zbuffer;
 
 		PixelShader ps;
 		const PixelShaderData* ps_data;
 
+		// z test, see SetZEqual and SetZReversed
+		bool z_equal;
+		bool z_reversed;
+		float z_epsilon;
+		// count of pixels passed z test and shaded
+		size_t pixel_count;
+
+		// coarse shading, see SetShadingRate and SetShadingRateImage
+		ShadingRate shading_rate;
+		const ShadingRate* shading_rate_image;
+		int shading_rate_image_w;
+
+		// pass if z is nearer, or equal to z-buffer in z_equal mode
+		inline bool ZTest(float z, float z0)
+		{
+			// the depth pre-pass computes z along other way, so allow small error
+			if (z_reversed)
+				return z_equal ? (z >= z0 - z_epsilon) : (z > z0);
+			return z_equal ? (z <= z0 + z_epsilon) : (z < z0);
+		}
+
 		// 3.3f -> 3.5f
 		// 4.5f -> 4.5f
 		// 5.7f -> 6.5f
@@ -157,22 +356,202 @@ namespace Rehenz
 		// draw a pixel
 		void Pixel(const Vertex& v);
 
+		// flat vertex attributes for packets
+		//   px py pz, nx ny nz, r g b a, u v, u2 v2, coef, (unused)
+		struct VertexPlane
+		{
+			alignas(16) float a[16];
+			VertexPlane() : a{} {}
+			explicit VertexPlane(const Vertex& v);
+		};
+
+		// draw 2x2 pixels from (x,y), v is vertex at center of (x,y)
+		// ddx, ddy are vertex gradients along screen x, y
+		// mask is coverage, see PixelPacket
+		void Quad(int x, int y, int mask, const VertexPlane& v, const VertexPlane& ddx, const VertexPlane& ddy,
+			PixelShaderPacket& pixel_shader);
+
 		// y must be aligned to .5
 		// (vi, ai = dv/dy) define line
 		// line1 must be to the left of line2
 		// output v1, v2, y pos when stop
 		void Trapezoid(float& y, float y_bottom, Vertex& v1, const Vertex& a1, Vertex& v2, const Vertex& a2);
 
+		// draw triangle to sample buffers
+		void TriangleMsaa(const Vertex& v1, const Vertex& v2, const Vertex& v3);
+
+		// rate of 4x4 pixels from (x,y), coarser one of draw and image in each axis
+		ShadingRate GetShadingRate(int x, int y);
+
+		// draw bw x bh pixels from (x,y), row j is covered in [left[j],right[j])
+		// pixels pass z test are shaded once at the mean of their centers
+		void Block(int x, int y, int bw, int bh, const float* left, const float* right,
+			const Point& p1, const VertexPlane& a1, const VertexPlane& ddx, const VertexPlane& ddy);
+
+		// draw triangle with coarse shading
+		void TriangleCoarse(const Vertex& v1, const Vertex& v2, const Vertex& v3);
+
 	public:
-		DrawerV(uint* _buffer, int _width, int _height, float* _zbuffer);
+		static const int msaa_samples = 4;
+		// sample positions relative to pixel center, standard 4x pattern of d3d
+		static const float msaa_offset_x[msaa_samples];
+		static const float msaa_offset_y[msaa_samples];
+
+		// msaa samples always use float z, see SetMsaa
+		DrawerV(uint* _buffer, int _width, int _height, DepthBuffer _zbuffer, int _pitch = 0);
 		~DrawerV();
 
 		// fill z-buffer
 		void FillZ(float z);
 
+		// false (default): z test pass when nearer, and write z-buffer
+		// true           : z test pass when equal, and keep z-buffer
+		//                  use it after a depth pre-pass, then each pixel is shaded once
+		inline void SetZEqual(bool _z_equal) { z_equal = _z_equal; }
+
+		// false (default): smaller z is nearer, clear z-buffer to 1
+		// true           : larger z is nearer, for reversed-z projection, clear z-buffer to 0
+		// k-buffer of Output::OIT follows it
+		void SetZReversed(bool _z_reversed);
+
+		inline size_t GetPixelCount() { return pixel_count; }
+
+		// set how to output color of pixel shader, _kbuffer is required by Output::OIT
+		void SetOutput(Output _output, KBuffer* _kbuffer = nullptr);
+
+		// draw to 4 samples per pixel rather than buffer and z-buffer, nullptr to disable
+		// coverage and z are tested per sample, and pixel shader runs once per pixel at its center
+		// samples of pixel (x,y) are [(y*w+x)*4, (y*w+x)*4+4), call ResolveMsaa to get the image
+		inline void SetMsaa(uint* _sample_buffer, float* _sample_zbuffer)
+		{
+			sample_buffer = _sample_buffer;
+			sample_zbuffer = _sample_zbuffer;
+		}
+		inline bool GetMsaa() { return sample_buffer != nullptr; }
+
+		// average samples to buffer, tiles that TileClear::Finish will fill are skipped
+		void ResolveMsaa();
+
+		// tile size of shading rate image
+		static const int shading_rate_tile = 16;
+
+		// shade blocks of pixels once and broadcast the color, z is still tested per pixel
+		// only used by Triangle with PixelShader, and not used with msaa
+		inline void SetShadingRate(ShadingRate _shading_rate) { shading_rate = _shading_rate; }
+		// one rate per shading_rate_tile x shading_rate_tile pixels, ceil(w/tile) rates per row, nullptr to disable
+		// rate of a pixel is the coarser one of SetShadingRate and image in each axis
+		inline void SetShadingRateImage(const ShadingRate* _image)
+		{
+			shading_rate_image = _image;
+			shading_rate_image_w = (w + shading_rate_tile - 1) / shading_rate_tile;
+		}
+
 		// draw triangle
 		// rasterization rule is same with DrawerF::Triangle, see it to get more info
 		void Triangle(const Vertex& v1, const Vertex& v2, const Vertex& v3,
 			PixelShader pixel_shader, const PixelShaderData& _ps_data);
+
+		// draw triangle by 2x2 pixels packets, each packet invoke pixel shader once
+		// rasterization rule is same with above, msaa is not supported
+		// attributes are evaluated by plane equations rather than step along edges
+		void Triangle(const Vertex& v1, const Vertex& v2, const Vertex& v3,
+			PixelShaderPacket pixel_shader, const PixelShaderData& _ps_data);
+	};
+
+	// draw depth only, for shadow map or depth pre-pass, draw region: [0,w]x[0,h]
+	// only z of position is interpolated, and no pixel shader
+	class DrawerZ
+	{
+	private:
+		const DepthBuffer zbuffer;
+		const int w;
+		const int h;
+		// clear lazily if not nullptr
+		TileClear* tile_clear;
+		// keep the largest z rather than the smallest
+		bool z_reversed;
+
+		// 3.3f -> 3.5f
+		// 4.5f -> 4.5f
+		// 5.7f -> 6.5f
+		inline float NextHalf(float x)
+		{
+			float x2 = static_cast<int>(x + 0.5f) + 0.5f;
+			if (x2 == x + 1.0f)
+				x2 = x;
+			return x2;
+		}
+
+	public:
+		DrawerZ(DepthBuffer _zbuffer, int _width, int _height);
+		~DrawerZ();
+
+		// see DrawerBase::SetTileClear
+		inline void SetTileClear(TileClear* _tile_clear) { tile_clear = _tile_clear; }
+		// see DrawerV::SetZReversed
+		inline void SetZReversed(bool _z_reversed) { z_reversed = _z_reversed; }
+
+		// fill z-buffer
+		void FillZ(float z);
+
+		// draw triangle, keep the nearest z
+		// rasterization rule is same with DrawerF::Triangle, see it to get more info
+		void Triangle(Point p1, Point p2, Point p3);
+	};
+
+	// k-buffer for order independent transparency, draw region: [0,w-1]x[0,h-1]
+	// keep k nearest fragments of each pixel, merge the farthest two when it overflows
+	// memory is allocated per tile when the tile is first touched, and kept for reuse
+	class KBuffer
+	{
+	public:
+		static const int k = 4;
+		static const int tile_size = 16;
+
+	private:
+		// color is premultiplied by alpha, packed as argb
+		struct Fragment
+		{
+			float z;
+			uint c;
+		};
+		struct Tile
+		{
+			bool touched;
+			uchar count[tile_size * tile_size];
+			Fragment fragments[tile_size * tile_size][k];
+		};
+
+		const int w;
+		const int h;
+		const int tiles_x;
+		const int tiles_y;
+		// larger z is nearer
+		bool z_reversed;
+		std::vector<std::unique_ptr<Tile>> tiles;
+		// indices of tiles which have fragments
+		std::vector<int> touched;
+
+		// argb
+		static uint Pack(const float c[4]);
+		// front over back
+		static uint Over(uint front, uint back);
+
+	public:
+		KBuffer(int _width, int _height);
+		~KBuffer();
+
+		inline int GetWidth() { return w; }
+		inline int GetHeight() { return h; }
+
+		// false (default): smaller z is nearer, true: larger z is nearer, see DrawerV::SetZReversed
+		inline void SetZReversed(bool _z_reversed) { z_reversed = _z_reversed; }
+
+		// add a fragment, c is not premultiplied
+		void Insert(int x, int y, float z, Color c);
+
+		// blend fragments from back to front over buffer, then clear them
+		// only touched tiles are visited, pitch is row stride of buffer in pixels, 0 means width
+		void Resolve(uint* buffer, int pitch = 0);
 	};
-}
\ No newline at end of file
+}
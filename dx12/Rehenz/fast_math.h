@@ -0,0 +1,264 @@
+#pragma once
+#include "math.h"
+#include <cstring>
+
+#if defined(REHENZ_SIMD) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+#define REHENZ_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// approximations of sin, cos, atan2 and rsqrt, callers choose an accuracy tier
+// scalar versions are branch-free so loops over arrays can be vectorized by compiler,
+// __m128 versions compute 4 values with the same operations
+namespace Rehenz
+{
+	// accuracy tiers of fast math, bounds are measured against libm
+	//   Low    : sin, cos, atan2 absolute error < 1e-3, rsqrt relative error < 1e-3
+	//   Medium : sin, cos, atan2 absolute error < 1e-6, rsqrt relative error < 1e-6
+	//   Full   : call libm
+	// sin and cos reduce angle by pi/2, they keep the bounds for |x| < 1e5
+	enum class MathAccuracy
+	{
+		Low,
+		Medium,
+		Full
+	};
+
+	// reduce x to r in [-pi/4,pi/4], x = r + q * pi/2, subtraction is done in double to keep bits
+	inline float FastReduceAngle(float x, int& q)
+	{
+		float qf = x * 0.636619772f;
+		q = static_cast<int>(qf + (qf < 0 ? -0.5f : 0.5f));
+		return static_cast<float>(x - q * 1.5707963267948966);
+	}
+
+	// c0 + x * (c1 + x * (c2 + ...))
+	inline float PolyEval(float, float c)
+	{
+		return c;
+	}
+
+	template <typename... C>
+	inline float PolyEval(float x, float c0, C... c)
+	{
+		return c0 + x * PolyEval(x, c...);
+	}
+
+#ifdef REHENZ_SIMD_SSE2
+	inline __m128 PolyEval(__m128, float c)
+	{
+		return _mm_set1_ps(c);
+	}
+
+	template <typename... C>
+	inline __m128 PolyEval(__m128 x, float c0, C... c)
+	{
+		return _mm_add_ps(_mm_set1_ps(c0), _mm_mul_ps(x, PolyEval(x, c...)));
+	}
+#endif
+
+	// polynomials of each tier, T is float or __m128
+	//   sin(r) = r * Sin(r^2), cos(r) = Cos(r^2) for r in [-pi/4,pi/4]
+	//   atan(t) = t * Atan(t^2) for t in [0,1]
+	template <MathAccuracy acc>
+	struct FastMathPoly;
+
+	template <>
+	struct FastMathPoly<MathAccuracy::Low>
+	{
+		// taylor series of degree 5 and 4
+		template <typename T> static T Sin(T r2) { return PolyEval(r2, 1.0f, -1.0f / 6, 1.0f / 120); }
+		template <typename T> static T Cos(T r2) { return PolyEval(r2, 1.0f, -0.5f, 1.0f / 24); }
+		// minimax of degree 5
+		template <typename T> static T Atan(T t2) { return PolyEval(t2, 0.995354f, -0.288679f, 0.079331f); }
+		// rsqrt estimate needs no refinement
+		static const int rsqrt_newton = 0;
+	};
+
+	template <>
+	struct FastMathPoly<MathAccuracy::Medium>
+	{
+		// taylor series of degree 7 and 8
+		template <typename T> static T Sin(T r2) { return PolyEval(r2, 1.0f, -1.0f / 6, 1.0f / 120, -1.0f / 5040); }
+		template <typename T> static T Cos(T r2) { return PolyEval(r2, 1.0f, -0.5f, 1.0f / 24, -1.0f / 720, 1.0f / 40320); }
+		// Abramowitz and Stegun 4.4.49, degree 15
+		template <typename T> static T Atan(T t2)
+		{
+			return PolyEval(t2, 0.9999993329f, -0.3332985605f, 0.1994653599f, -0.1390853351f,
+				0.0964200441f, -0.0559098861f, 0.0218612288f, -0.0040540580f);
+		}
+		// one newton step after rsqrt estimate
+		static const int rsqrt_newton = 1;
+	};
+
+	// sin and cos of x
+	template <MathAccuracy acc = MathAccuracy::Medium>
+	inline void FastSinCos(float x, float& s, float& c)
+	{
+		int q = 0;
+		float r = FastReduceAngle(x, q);
+		float r2 = r * r;
+		float sr = r * FastMathPoly<acc>::Sin(r2);
+		float cr = FastMathPoly<acc>::Cos(r2);
+		// rotate by q quadrants
+		float ss = (q & 1) ? cr : sr;
+		float cc = (q & 1) ? sr : cr;
+		s = (q & 2) ? -ss : ss;
+		c = ((q + 1) & 2) ? -cc : cc;
+	}
+
+	template <>
+	inline void FastSinCos<MathAccuracy::Full>(float x, float& s, float& c)
+	{
+		s = sinf(x);
+		c = cosf(x);
+	}
+
+	// sin of x
+	template <MathAccuracy acc = MathAccuracy::Medium>
+	inline float FastSin(float x)
+	{
+		float s = 0, c = 0;
+		FastSinCos<acc>(x, s, c);
+		return s;
+	}
+
+	// cos of x
+	template <MathAccuracy acc = MathAccuracy::Medium>
+	inline float FastCos(float x)
+	{
+		float s = 0, c = 0;
+		FastSinCos<acc>(x, s, c);
+		return c;
+	}
+
+	// atan2 of y and x in [-pi,pi], signed zeros give same results as atan2f
+	template <MathAccuracy acc = MathAccuracy::Medium>
+	inline float FastAtan2(float y, float x)
+	{
+		float ax = fabsf(x), ay = fabsf(y);
+		float hi = Max(ax, ay), lo = Min(ax, ay);
+		float t = (hi > 0) ? lo / hi : 0.0f;
+		float r = t * FastMathPoly<acc>::Atan(t * t);
+		r = (ay > ax) ? pi_div2 - r : r;
+		r = std::signbit(x) ? pi - r : r;
+		return copysignf(r, y);
+	}
+
+	template <>
+	inline float FastAtan2<MathAccuracy::Full>(float y, float x)
+	{
+		return atan2f(y, x);
+	}
+
+	// 1 / sqrt(x) for x > 0
+	template <MathAccuracy acc = MathAccuracy::Medium>
+	inline float FastRsqrt(float x)
+	{
+#ifdef REHENZ_SIMD
+		// hardware estimate has relative error < 1.5 * 2^-12
+		float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+		for (int i = 0; i < FastMathPoly<acc>::rsqrt_newton; i++)
+			y = y * (1.5f - 0.5f * x * y * y);
+#else
+		// bit trick estimate has relative error < 1.8e-3, one more newton step for each tier
+		unsigned int bits = 0;
+		memcpy(&bits, &x, sizeof(float));
+		bits = 0x5f375a86 - (bits >> 1);
+		float y = 0;
+		memcpy(&y, &bits, sizeof(float));
+		for (int i = 0; i < FastMathPoly<acc>::rsqrt_newton + 2; i++)
+			y = y * (1.5f - 0.5f * x * y * y);
+#endif
+		return y;
+	}
+
+	template <>
+	inline float FastRsqrt<MathAccuracy::Full>(float x)
+	{
+		return 1 / sqrtf(x);
+	}
+
+#ifdef REHENZ_SIMD_SSE2
+	// select a where mask is set, else b
+	inline __m128 SimdSelect(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// sin and cos of 4 values
+	template <MathAccuracy acc = MathAccuracy::Medium>
+	inline void FastSinCos(__m128 x, __m128& s, __m128& c)
+	{
+		__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.636619772f)));
+		__m128 qf = _mm_cvtepi32_ps(q);
+		// pi/2 is split into 4 parts, first 3 have 8 bits so products are exact for |q| < 2^16
+		__m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(1.5703125f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(4.82559204e-4f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(1.26659870e-6f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(9.92093518e-10f)));
+		__m128 r2 = _mm_mul_ps(r, r);
+		__m128 sr = _mm_mul_ps(r, FastMathPoly<acc>::Sin(r2));
+		__m128 cr = FastMathPoly<acc>::Cos(r2);
+		// rotate by q quadrants
+		__m128i one = _mm_set1_epi32(1);
+		__m128 odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+		__m128 sign_s = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+		__m128 sign_c = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), _mm_set1_epi32(2)), 30));
+		s = _mm_xor_ps(SimdSelect(odd, cr, sr), sign_s);
+		c = _mm_xor_ps(SimdSelect(odd, sr, cr), sign_c);
+	}
+
+	template <>
+	inline void FastSinCos<MathAccuracy::Full>(__m128 x, __m128& s, __m128& c)
+	{
+		alignas(16) float xv[4], sv[4], cv[4];
+		_mm_store_ps(xv, x);
+		for (int i = 0; i < 4; i++)
+			FastSinCos<MathAccuracy::Full>(xv[i], sv[i], cv[i]);
+		s = _mm_load_ps(sv);
+		c = _mm_load_ps(cv);
+	}
+
+	// atan2 of 4 values
+	template <MathAccuracy acc = MathAccuracy::Medium>
+	inline __m128 FastAtan2(__m128 y, __m128 x)
+	{
+		__m128 sign_bit = _mm_set1_ps(-0.0f);
+		__m128 ax = _mm_andnot_ps(sign_bit, x), ay = _mm_andnot_ps(sign_bit, y);
+		__m128 hi = _mm_max_ps(ax, ay), lo = _mm_min_ps(ax, ay);
+		__m128 t = _mm_and_ps(_mm_cmpgt_ps(hi, _mm_setzero_ps()), _mm_div_ps(lo, hi));
+		__m128 r = _mm_mul_ps(t, FastMathPoly<acc>::Atan(_mm_mul_ps(t, t)));
+		r = SimdSelect(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(pi_div2), r), r);
+		r = SimdSelect(_mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(x), 31)), _mm_sub_ps(_mm_set1_ps(pi), r), r);
+		return _mm_or_ps(r, _mm_and_ps(sign_bit, y));
+	}
+
+	template <>
+	inline __m128 FastAtan2<MathAccuracy::Full>(__m128 y, __m128 x)
+	{
+		alignas(16) float yv[4], xv[4], rv[4];
+		_mm_store_ps(yv, y);
+		_mm_store_ps(xv, x);
+		for (int i = 0; i < 4; i++)
+			rv[i] = atan2f(yv[i], xv[i]);
+		return _mm_load_ps(rv);
+	}
+
+	// 1 / sqrt(x) of 4 values
+	template <MathAccuracy acc = MathAccuracy::Medium>
+	inline __m128 FastRsqrt(__m128 x)
+	{
+		__m128 y = _mm_rsqrt_ps(x);
+		for (int i = 0; i < FastMathPoly<acc>::rsqrt_newton; i++)
+			y = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(y, y))));
+		return y;
+	}
+
+	template <>
+	inline __m128 FastRsqrt<MathAccuracy::Full>(__m128 x)
+	{
+		return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(x));
+	}
+#endif
+}
@@ -0,0 +1,348 @@
+#include "glb_file.h"
+#include <cstring>
+
+namespace Rehenz
+{
+	namespace
+	{
+		inline uint ReadUint(const char* p)
+		{
+			uint x = 0;
+			memcpy(&x, p, sizeof(uint));
+			return x;
+		}
+
+		inline int ComponentSize(int component_type)
+		{
+			switch (component_type)
+			{
+			case GlbComponent::int8: case GlbComponent::uint8: return 1;
+			case GlbComponent::int16: case GlbComponent::uint16: return 2;
+			case GlbComponent::uint32: case GlbComponent::float32: return 4;
+			}
+			return 0;
+		}
+
+		inline int ComponentCount(const std::string& type)
+		{
+			if (type == "SCALAR")
+				return 1;
+			if (type == "VEC2")
+				return 2;
+			if (type == "VEC3")
+				return 3;
+			if (type == "VEC4")
+				return 4;
+			return 0;
+		}
+
+		// floats of a stream for all merged primitives, or a pointer into file if there is one packed primitive
+		struct GlbStream
+		{
+		public:
+			int components;
+			float def;
+			std::vector<GlbAccessor> accessors;
+			std::vector<float> buffer;
+			const float* data;
+
+			GlbStream(int _components, float _def) : components(_components), def(_def), data(nullptr) {}
+		};
+	}
+
+	GlbAccessor::GlbAccessor() : data(nullptr), count(0), stride(0), components(0), component_type(0), normalized(false)
+	{
+	}
+
+	float GlbAccessor::GetFloat(size_t i, int c) const
+	{
+		const uchar* p = data + i * stride + c * ComponentSize(component_type);
+		switch (component_type)
+		{
+		case GlbComponent::float32: { float x; memcpy(&x, p, 4); return x; }
+		case GlbComponent::uint8: return normalized ? *p / 255.0f : *p;
+		case GlbComponent::int8: { signed char x = static_cast<signed char>(*p); return normalized ? Max(x / 127.0f, -1.0f) : x; }
+		case GlbComponent::uint16: { unsigned short x; memcpy(&x, p, 2); return normalized ? x / 65535.0f : x; }
+		case GlbComponent::int16: { short x; memcpy(&x, p, 2); return normalized ? Max(x / 32767.0f, -1.0f) : x; }
+		case GlbComponent::uint32: { uint x; memcpy(&x, p, 4); return static_cast<float>(x); }
+		}
+		return 0;
+	}
+
+	uint GlbAccessor::GetUint(size_t i) const
+	{
+		const uchar* p = data + i * stride;
+		switch (component_type)
+		{
+		case GlbComponent::uint8: return *p;
+		case GlbComponent::uint16: { unsigned short x; memcpy(&x, p, 2); return x; }
+		case GlbComponent::uint32: { uint x; memcpy(&x, p, 4); return x; }
+		}
+		return 0;
+	}
+
+	GlbFile::GlbFile(const std::string& filename) : file(filename), json(), bin(nullptr), bin_size(0), valid(false)
+	{
+		// header : magic "glTF", version, length, then chunks : length, type, data
+		const char* data = file.Data();
+		size_t size = file.Size();
+		if (data == nullptr || size < 20 || memcmp(data, "glTF", 4) != 0 || ReadUint(data + 4) != 2)
+			return;
+		size = Min(size, static_cast<size_t>(ReadUint(data + 8)));
+		size_t json_size = ReadUint(data + 12);
+		if (memcmp(data + 16, "JSON", 4) != 0 || json_size > size - 20)
+			return;
+		if (!ParseJson(data + 20, json_size, json))
+			return;
+		size_t bin_offset = 20 + ((json_size + 3) & ~static_cast<size_t>(3));
+		if (bin_offset + 8 <= size && memcmp(data + bin_offset + 4, "BIN\0", 4) == 0)
+		{
+			bin_size = Min(static_cast<size_t>(ReadUint(data + bin_offset)), size - bin_offset - 8);
+			bin = reinterpret_cast<const uchar*>(data + bin_offset + 8);
+		}
+		valid = true;
+	}
+
+	GlbFile::~GlbFile()
+	{
+	}
+
+	GlbAccessor GlbFile::GetAccessor(int index) const
+	{
+		GlbAccessor view;
+		const JsonValue& accessor = json["accessors"].At(index);
+		if (accessor.IsNull() || !accessor["sparse"].IsNull())
+			return view;
+		const JsonValue& buffer_view = json["bufferViews"].At(accessor["bufferView"].GetInt(-1));
+		// only the binary chunk of .glb is loaded, external buffers are not
+		if (buffer_view.IsNull() || buffer_view["buffer"].GetInt(0) != 0 || !json["buffers"].At(0)["uri"].IsNull())
+			return view;
+
+		int component_type = accessor["componentType"].GetInt();
+		int components = ComponentCount(accessor["type"].string);
+		size_t element_size = ComponentSize(component_type) * components;
+		double count = accessor["count"].GetNumber(-1);
+		double view_offset = buffer_view["byteOffset"].GetNumber(0), view_length = buffer_view["byteLength"].GetNumber(-1);
+		double offset = accessor["byteOffset"].GetNumber(0);
+		double stride = buffer_view["byteStride"].GetNumber(static_cast<double>(element_size));
+		if (element_size == 0 || count < 0 || view_offset < 0 || offset < 0 || stride < element_size || view_length < 0
+			|| view_offset + view_length > bin_size)
+			return view;
+		if (count > 0 && offset + stride * (count - 1) + element_size > view_length)
+			return view;
+
+		view.data = bin + static_cast<size_t>(view_offset + offset);
+		view.count = static_cast<size_t>(count);
+		view.stride = static_cast<size_t>(stride);
+		view.components = components;
+		view.component_type = component_type;
+		view.normalized = accessor["normalized"].boolean;
+		return view;
+	}
+
+	std::shared_ptr<Mesh> GlbFile::CreateMesh(int mesh_index) const
+	{
+		const char* attributes[5]{ "POSITION", "NORMAL", "COLOR_0", "TEXCOORD_0", "TEXCOORD_1" };
+		GlbStream streams[5]{ GlbStream(3, 0.0f), GlbStream(3, 0.0f), GlbStream(4, 1.0f), GlbStream(2, 0.0f), GlbStream(2, 0.0f) };
+		std::vector<GlbAccessor> index_accessors;
+		bool any[5]{};
+
+		// collect triangle primitives with positions
+		const JsonValue& primitives = json["meshes"].At(mesh_index)["primitives"];
+		for (size_t i = 0; i < primitives.Size(); i++)
+		{
+			const JsonValue& primitive = primitives.At(i);
+			if (primitive["mode"].GetInt(4) != 4)
+				continue;
+			GlbAccessor views[5];
+			for (int s = 0; s < 5; s++)
+			{
+				int index = primitive["attributes"][attributes[s]].GetInt(-1);
+				if (index >= 0)
+					views[s] = GetAccessor(index);
+			}
+			if (views[0].data == nullptr || views[0].components != 3)
+				continue;
+			for (int s = 1; s < 5; s++)
+			{
+				// colors can be VEC3
+				bool match = views[s].components == streams[s].components || (s == 2 && views[s].components == 3);
+				if (views[s].data == nullptr || !match || views[s].count != views[0].count)
+					views[s] = GlbAccessor();
+				any[s] = any[s] || views[s].data != nullptr;
+			}
+			GlbAccessor indices;
+			if (!primitive["indices"].IsNull())
+			{
+				indices = GetAccessor(primitive["indices"].GetInt(-1));
+				if (indices.data == nullptr || indices.components != 1 || indices.component_type == GlbComponent::float32)
+					continue;
+			}
+			for (int s = 0; s < 5; s++)
+				streams[s].accessors.push_back(views[s]);
+			index_accessors.push_back(indices);
+		}
+
+		// streams need conversion only if there are several primitives or data is not packed float
+		size_t primitive_count = index_accessors.size(), vertex_count = 0;
+		for (auto& view : streams[0].accessors)
+			vertex_count += view.count;
+		for (int s = 0; s < 5; s++)
+		{
+			GlbStream& stream = streams[s];
+			stream.data = nullptr;
+			if (!any[s] && s != 0)
+				continue;
+			if (primitive_count == 1 && stream.accessors[0].IsPackedFloat() && stream.accessors[0].components == stream.components)
+			{
+				stream.data = reinterpret_cast<const float*>(stream.accessors[0].data);
+				continue;
+			}
+			stream.buffer.resize(vertex_count * stream.components);
+			float* dst = stream.buffer.empty() ? nullptr : &stream.buffer[0];
+			for (size_t i = 0; i < primitive_count; i++)
+			{
+				const GlbAccessor& view = stream.accessors[i];
+				for (size_t v = 0; v < streams[0].accessors[i].count; v++, dst += stream.components)
+				{
+					for (int c = 0; c < stream.components; c++)
+						dst[c] = (view.data != nullptr && c < view.components) ? view.GetFloat(v, c) : stream.def;
+				}
+			}
+			if (dst != nullptr)
+				stream.data = &stream.buffer[0];
+		}
+
+		// indices with vertex offsets of merged primitives, triangles out of range are dropped
+		// glTF front faces are counter-clockwise, the z mirror keeps that on screen, so b and c are swapped
+		std::vector<int> triangles;
+		size_t base = 0;
+		for (size_t i = 0; i < primitive_count; i++)
+		{
+			const GlbAccessor& view = index_accessors[i];
+			size_t count = streams[0].accessors[i].count;
+			size_t n = view.data ? view.count : count;
+			triangles.reserve(triangles.size() + n / 3 * 3);
+			for (size_t t = 0; t + 2 < n; t += 3)
+			{
+				uint a = view.data ? view.GetUint(t) : static_cast<uint>(t);
+				uint b = view.data ? view.GetUint(t + 1) : static_cast<uint>(t + 1);
+				uint c = view.data ? view.GetUint(t + 2) : static_cast<uint>(t + 2);
+				if (a >= count || b >= count || c >= count)
+					continue;
+				triangles.push_back(static_cast<int>(base + a));
+				triangles.push_back(static_cast<int>(base + c));
+				triangles.push_back(static_cast<int>(base + b));
+			}
+			base += count;
+		}
+
+		auto mesh = std::make_shared<Mesh>();
+		if (vertex_count > 0)
+			mesh->SetStreams(vertex_count, streams[0].data, streams[1].data, streams[2].data, streams[3].data, streams[4].data);
+		if (!triangles.empty())
+			mesh->SetTriangles(&triangles[0], triangles.size());
+		return mesh;
+	}
+
+	void GlbFile::GetNodeMatrices(std::vector<Matrix>& matrices, std::vector<bool>& in_scene) const
+	{
+		const JsonValue& nodes = json["nodes"];
+		size_t n = nodes.Size();
+		matrices.assign(n, Matrix());
+		in_scene.assign(n, false);
+
+		// roots of default scene, or nodes which are not children
+		std::vector<int> stack;
+		const JsonValue& scene = json["scenes"].At(json["scene"].GetInt(0));
+		if (!scene.IsNull())
+		{
+			for (size_t i = 0; i < scene["nodes"].Size(); i++)
+				stack.push_back(scene["nodes"].At(i).GetInt(-1));
+		}
+		else
+		{
+			std::vector<bool> is_child(n, false);
+			for (size_t i = 0; i < n; i++)
+			{
+				const JsonValue& children = nodes.At(i)["children"];
+				for (size_t c = 0; c < children.Size(); c++)
+				{
+					int child = children.At(c).GetInt(-1);
+					if (child >= 0 && static_cast<size_t>(child) < n)
+						is_child[child] = true;
+				}
+			}
+			for (size_t i = 0; i < n; i++)
+			{
+				if (!is_child[i])
+					stack.push_back(static_cast<int>(i));
+			}
+		}
+
+		// glTF is right-handed, mirror z to Rehenz space above the roots
+		const Matrix mirror = GetMatrixS(1, 1, -1);
+		std::vector<int> parents(stack.size(), -1);
+		while (!stack.empty())
+		{
+			int i = stack.back(), parent = parents.back();
+			stack.pop_back();
+			parents.pop_back();
+			if (i < 0 || static_cast<size_t>(i) >= n || in_scene[i])
+				continue;
+			in_scene[i] = true;
+
+			// local matrix for row vectors, glTF matrix is column-major for column vectors, so it reads as transposed
+			const JsonValue& node = nodes.At(i);
+			Matrix local;
+			if (node["matrix"].Size() == 16)
+			{
+				for (int k = 0; k < 16; k++)
+					local(k / 4, k % 4) = static_cast<float>(node["matrix"].At(k).GetNumber());
+			}
+			else
+			{
+				const JsonValue& t = node["translation"], & r = node["rotation"], & s = node["scale"];
+				Quaternion q(static_cast<float>(r.At(3).GetNumber(1)), static_cast<float>(r.At(0).GetNumber()),
+					static_cast<float>(r.At(1).GetNumber()), static_cast<float>(r.At(2).GetNumber()));
+				local = GetMatrixS(static_cast<float>(s.At(0).GetNumber(1)), static_cast<float>(s.At(1).GetNumber(1)), static_cast<float>(s.At(2).GetNumber(1)))
+					* MatrixTranspose(GetMatrixR(q))
+					* GetMatrixT(static_cast<float>(t.At(0).GetNumber()), static_cast<float>(t.At(1).GetNumber()), static_cast<float>(t.At(2).GetNumber()));
+			}
+			matrices[i] = local * (parent >= 0 ? matrices[parent] : mirror);
+
+			const JsonValue& children = node["children"];
+			for (size_t c = 0; c < children.Size(); c++)
+			{
+				stack.push_back(children.At(c).GetInt(-1));
+				parents.push_back(i);
+			}
+		}
+	}
+
+	std::vector<std::shared_ptr<RenderObject>> CreateRenderObjectsFromGlbFile(const std::string& filename)
+	{
+		std::vector<std::shared_ptr<RenderObject>> objects;
+		GlbFile file(filename);
+		if (!file.IsValid())
+			return objects;
+
+		std::vector<Matrix> matrices;
+		std::vector<bool> in_scene;
+		file.GetNodeMatrices(matrices, in_scene);
+		const JsonValue& nodes = file.GetJson()["nodes"];
+		std::vector<std::shared_ptr<Mesh>> meshes(file.GetJson()["meshes"].Size());
+		for (size_t i = 0; i < nodes.Size(); i++)
+		{
+			int mesh_index = nodes.At(i)["mesh"].GetInt(-1);
+			if (!in_scene[i] || mesh_index < 0 || static_cast<size_t>(mesh_index) >= meshes.size())
+				continue;
+			if (!meshes[mesh_index])
+				meshes[mesh_index] = file.CreateMesh(mesh_index);
+			auto obj = std::make_shared<RenderObject>(meshes[mesh_index]);
+			obj->transform.SetTransformMatrix(matrices[i]);
+			objects.push_back(obj);
+		}
+		return objects;
+	}
+}
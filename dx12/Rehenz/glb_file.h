@@ -0,0 +1,79 @@
+#pragma once
+#include "render_soft.h"
+#include "mapped_file.h"
+#include "json.h"
+
+// binary glTF 2.0 (.glb) loading
+// meshes keep glTF coordinates (right-handed, y up), the mirror to left-handed Rehenz space is in
+// transforms of render objects, so vertex data needs no conversion, only triangle winding is reversed
+namespace Rehenz
+{
+	// glTF componentType
+	struct GlbComponent
+	{
+	public:
+		static const int int8 = 5120;
+		static const int uint8 = 5121;
+		static const int int16 = 5122;
+		static const int uint16 = 5123;
+		static const int uint32 = 5125;
+		static const int float32 = 5126;
+	};
+
+	// typed view of a glTF accessor into the mapped file, no copy
+	struct GlbAccessor
+	{
+	public:
+		// nullptr if accessor is missing or broken
+		const uchar* data;
+		size_t count;
+		// distance between two elements in bytes
+		size_t stride;
+		// 1 for SCALAR, 2 for VEC2, 3 for VEC3, 4 for VEC4
+		int components;
+		int component_type;
+		bool normalized;
+
+		GlbAccessor();
+
+		// component c of element i as float, normalized integers are mapped to [0,1] or [-1,1]
+		float GetFloat(size_t i, int c) const;
+		// element i of integer scalar accessor
+		uint GetUint(size_t i) const;
+		// elements are tightly packed floats, can be copied as they are
+		inline bool IsPackedFloat() const { return component_type == GlbComponent::float32 && stride == components * sizeof(float); }
+	};
+
+	class GlbFile
+	{
+	private:
+		MappedFile file;
+		JsonValue json;
+		const uchar* bin;
+		size_t bin_size;
+		bool valid;
+
+	public:
+		explicit GlbFile(const std::string& filename);
+		GlbFile(const GlbFile&) = delete;
+		GlbFile& operator=(const GlbFile&) = delete;
+		~GlbFile();
+
+		// file is glTF 2.0 binary with valid json
+		inline bool IsValid() const { return valid; }
+		inline const JsonValue& GetJson() const { return json; }
+		// view of accessor, data is nullptr if index or its buffer view is invalid
+		GlbAccessor GetAccessor(int index) const;
+
+		// mesh of glTF mesh index, all triangle primitives are merged
+		// pos, normal, color, uv, uv2 from POSITION, NORMAL, COLOR_0, TEXCOORD_0, TEXCOORD_1
+		std::shared_ptr<Mesh> CreateMesh(int mesh_index) const;
+		// world matrix of each node in Rehenz space, in_scene is false for nodes not in scene
+		// uses default scene, or all root nodes if there is none
+		void GetNodeMatrices(std::vector<Matrix>& matrices, std::vector<bool>& in_scene) const;
+	};
+
+	// create render objects for nodes with mesh in default scene of .glb file
+	// meshes used by several nodes are shared, materials are not loaded
+	std::vector<std::shared_ptr<RenderObject>> CreateRenderObjectsFromGlbFile(const std::string& filename);
+}
@@ -0,0 +1,248 @@
+#include "json.h"
+#include "obj_file.h"
+#include <cstring>
+
+namespace Rehenz
+{
+	namespace
+	{
+		const JsonValue json_null;
+
+		class JsonParser
+		{
+		private:
+			const char* p;
+			const char* end;
+			int depth;
+
+			void SkipSpace()
+			{
+				while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+					p++;
+			}
+
+			bool Match(const char* word)
+			{
+				size_t n = strlen(word);
+				if (static_cast<size_t>(end - p) < n || memcmp(p, word, n) != 0)
+					return false;
+				p += n;
+				return true;
+			}
+
+			static int Hex(char c)
+			{
+				if (c >= '0' && c <= '9')
+					return c - '0';
+				if (c >= 'a' && c <= 'f')
+					return c - 'a' + 10;
+				if (c >= 'A' && c <= 'F')
+					return c - 'A' + 10;
+				return -1;
+			}
+
+			bool ParseString(std::string& s)
+			{
+				if (p == end || *p != '"')
+					return false;
+				p++;
+				while (p < end && *p != '"')
+				{
+					if (*p != '\\')
+					{
+						s.push_back(*p++);
+						continue;
+					}
+					if (++p == end)
+						return false;
+					char c = *p++;
+					switch (c)
+					{
+					case 'b': s.push_back('\b'); break;
+					case 'f': s.push_back('\f'); break;
+					case 'n': s.push_back('\n'); break;
+					case 'r': s.push_back('\r'); break;
+					case 't': s.push_back('\t'); break;
+					case 'u':
+					{
+						// code point to utf-8, surrogate pairs are kept as two code points
+						if (end - p < 4)
+							return false;
+						uint code = 0;
+						for (int i = 0; i < 4; i++)
+						{
+							int h = Hex(*p++);
+							if (h < 0)
+								return false;
+							code = code * 16 + h;
+						}
+						if (code < 0x80)
+							s.push_back(static_cast<char>(code));
+						else if (code < 0x800)
+						{
+							s.push_back(static_cast<char>(0xc0 | (code >> 6)));
+							s.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+						}
+						else
+						{
+							s.push_back(static_cast<char>(0xe0 | (code >> 12)));
+							s.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+							s.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+						}
+						break;
+					}
+					default: s.push_back(c); break;
+					}
+				}
+				if (p == end)
+					return false;
+				p++;
+				return true;
+			}
+
+			bool ParseValue(JsonValue& v)
+			{
+				// limit nesting, broken files must not overflow stack
+				if (++depth > 256)
+					return false;
+				SkipSpace();
+				if (p == end)
+					return false;
+				bool ok = true;
+				if (*p == '{')
+				{
+					v.type = JsonValue::Type::Object;
+					p++;
+					SkipSpace();
+					if (p < end && *p == '}')
+						p++;
+					else
+					{
+						while (ok)
+						{
+							SkipSpace();
+							v.members.emplace_back();
+							ok = ParseString(v.members.back().first);
+							SkipSpace();
+							ok = ok && p < end && *p++ == ':' && ParseValue(v.members.back().second);
+							SkipSpace();
+							if (!ok || p == end)
+								return false;
+							if (*p == '}')
+							{
+								p++;
+								break;
+							}
+							ok = (*p++ == ',');
+						}
+					}
+				}
+				else if (*p == '[')
+				{
+					v.type = JsonValue::Type::Array;
+					p++;
+					SkipSpace();
+					if (p < end && *p == ']')
+						p++;
+					else
+					{
+						while (ok)
+						{
+							v.items.emplace_back();
+							ok = ParseValue(v.items.back());
+							SkipSpace();
+							if (!ok || p == end)
+								return false;
+							if (*p == ']')
+							{
+								p++;
+								break;
+							}
+							ok = (*p++ == ',');
+						}
+					}
+				}
+				else if (*p == '"')
+				{
+					v.type = JsonValue::Type::String;
+					ok = ParseString(v.string);
+				}
+				else if (Match("true"))
+				{
+					v.type = JsonValue::Type::Bool;
+					v.boolean = true;
+				}
+				else if (Match("false"))
+					v.type = JsonValue::Type::Bool;
+				else if (Match("null"))
+					v.type = JsonValue::Type::Null;
+				else
+				{
+					float f = 0;
+					const char* next = ParseFloat(p, end, f);
+					if (next == p)
+						return false;
+					// integers are parsed exactly, they are indices and byte offsets
+					bool integer = true;
+					double x = 0;
+					for (const char* q = (*p == '-') ? p + 1 : p; q < next; q++)
+					{
+						if (*q < '0' || *q > '9')
+						{
+							integer = false;
+							break;
+						}
+						x = x * 10 + (*q - '0');
+					}
+					v.type = JsonValue::Type::Number;
+					v.number = integer ? ((*p == '-') ? -x : x) : f;
+					p = next;
+				}
+				depth--;
+				return ok;
+			}
+
+		public:
+			JsonParser(const char* text, size_t size) : p(text), end(text + size), depth(0) {}
+
+			bool Parse(JsonValue& v)
+			{
+				if (!ParseValue(v))
+					return false;
+				SkipSpace();
+				return p == end;
+			}
+		};
+	}
+
+	JsonValue::JsonValue() : type(Type::Null), boolean(false), number(0)
+	{
+	}
+
+	const JsonValue& JsonValue::operator[](const char* key) const
+	{
+		if (type == Type::Object)
+		{
+			for (auto& member : members)
+			{
+				if (member.first == key)
+					return member.second;
+			}
+		}
+		return json_null;
+	}
+
+	const JsonValue& JsonValue::At(size_t index) const
+	{
+		if (type == Type::Array && index < items.size())
+			return items[index];
+		return json_null;
+	}
+
+	bool ParseJson(const char* text, size_t size, JsonValue& value)
+	{
+		value = JsonValue();
+		JsonParser parser(text, size);
+		return parser.Parse(value);
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "type.h"
+#include <vector>
+
+namespace Rehenz
+{
+	// json document tree, for small metadata like glTF headers
+	struct JsonValue
+	{
+	public:
+		enum class Type { Null, Bool, Number, String, Array, Object };
+
+		Type type;
+		bool boolean;
+		double number;
+		std::string string;
+		std::vector<JsonValue> items;
+		std::vector<std::pair<std::string, JsonValue>> members;
+
+		JsonValue();
+
+		// member of object, null value if missing or not an object
+		const JsonValue& operator[](const char* key) const;
+		// item of array, null value if out of range or not an array
+		const JsonValue& At(size_t index) const;
+
+		inline bool IsNull() const { return type == Type::Null; }
+		inline size_t Size() const { return type == Type::Array ? items.size() : 0; }
+		// number or default value if not a number
+		inline double GetNumber(double def = 0) const { return type == Type::Number ? number : def; }
+		inline int GetInt(int def = 0) const { return type == Type::Number ? static_cast<int>(number) : def; }
+	};
+
+	// parse json text, return false if text is not valid json
+	bool ParseJson(const char* text, size_t size, JsonValue& value);
+}
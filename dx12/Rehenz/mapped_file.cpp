@@ -0,0 +1,111 @@
+#include "mapped_file.h"
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Rehenz
+{
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string& filename) : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr)
+	{
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+			return;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+			return;
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (data != nullptr)
+			size = static_cast<size_t>(file_size.QuadPart);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (data != nullptr)
+			UnmapViewOfFile(data);
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+	}
+#else
+	MappedFile::MappedFile(const std::string& filename) : data(nullptr), size(0), fd(-1)
+	{
+		fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+			return;
+		void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+			return;
+		madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+		data = static_cast<const char*>(p);
+		size = static_cast<size_t>(st.st_size);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (data != nullptr)
+			munmap(const_cast<char*>(data), size);
+		if (fd >= 0)
+			close(fd);
+	}
+#endif
+
+	namespace
+	{
+		const ullong hash_prime1 = 0x9e3779b185ebca87ull;
+		const ullong hash_prime2 = 0xc2b2ae3d27d4eb4full;
+
+		inline ullong HashRound(ullong acc, ullong word)
+		{
+			acc += word * hash_prime2;
+			acc = (acc << 31) | (acc >> 33);
+			return acc * hash_prime1;
+		}
+	}
+
+	ullong HashBytes(const void* data, size_t size, ullong seed)
+	{
+		// 4 independent lanes of 8 bytes, so multiplies of lanes overlap
+		const char* p = static_cast<const char*>(data);
+		const char* end = p + size;
+		ullong lanes[4]{ seed + hash_prime1 + hash_prime2, seed + hash_prime2, seed, seed - hash_prime1 };
+		for (; end - p >= 32; p += 32)
+		{
+			ullong words[4];
+			memcpy(words, p, 32);
+			for (int i = 0; i < 4; i++)
+				lanes[i] = HashRound(lanes[i], words[i]);
+		}
+		ullong h = static_cast<ullong>(size);
+		for (int i = 0; i < 4; i++)
+			h = HashRound(h ^ HashRound(0, lanes[i]), hash_prime1);
+		for (; end - p >= 8; p += 8)
+		{
+			ullong word;
+			memcpy(&word, p, 8);
+			h = HashRound(h, word);
+		}
+		for (; p < end; p++)
+			h = HashRound(h, static_cast<unsigned char>(*p));
+		// final avalanche
+		h ^= h >> 33;
+		h *= hash_prime2;
+		h ^= h >> 29;
+		return h;
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "type.h"
+
+namespace Rehenz
+{
+	// read-only memory-mapped file, pages are loaded by os on first access
+	// Data() is nullptr if file can not be opened or is empty
+	class MappedFile
+	{
+	private:
+		const char* data;
+		size_t size;
+#ifdef _WIN32
+		void* file;
+		void* mapping;
+#else
+		int fd;
+#endif
+
+	public:
+		explicit MappedFile(const std::string& filename);
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+
+		inline const char* Data() const { return data; }
+		inline size_t Size() const { return size; }
+	};
+
+	// 64-bit hash of bytes for content keys, not cryptographic
+	ullong HashBytes(const void* data, size_t size, ullong seed = 0);
+}
@@ -1,224 +1,15 @@
 #include "math.h"
 #include <cmath>
+#include <cassert>
+#ifdef REHENZ_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 namespace Rehenz
 {
-	Matrix::Matrix()
-	{
-		float* p = (float*)m;
-		for (int i = 0; i < 16; i++)
-			(*(p++)) = 0.0f;
-		m[0][0] = 1.0f;
-		m[1][1] = 1.0f;
-		m[2][2] = 1.0f;
-		m[3][3] = 1.0f;
-	}
-
-	Matrix::Matrix(float value)
-	{
-		m[0][0] = value; // for ignore C26495 warn
-		float* p = (float*)m;
-		for (int i = 0; i < 16; i++)
-			(*(p++)) = value;
-	}
-
-	Matrix::Matrix(float _00, float _01, float _02, float _03,
-		float _10, float _11, float _12, float _13,
-		float _20, float _21, float _22, float _23,
-		float _30, float _31, float _32, float _33)
-	{
-		m[0][0] = _00; m[0][1] = _01; m[0][2] = _02; m[0][3] = _03;
-		m[1][0] = _10; m[1][1] = _11; m[1][2] = _12; m[1][3] = _13;
-		m[2][0] = _20; m[2][1] = _21; m[2][2] = _22; m[2][3] = _23;
-		m[3][0] = _30; m[3][1] = _31; m[3][2] = _32; m[3][3] = _33;
-	}
-
-	float& Matrix::operator()(int row, int col)
-	{
-		//	if (row < 0 || row >= 4 || col < 0 || col >= 4)
-		//		return m[0][0];
-		return m[row][col];
-	}
-
-	float Matrix::operator()(int row, int col) const
-	{
-		return m[row][col];
-	}
-
-	Matrix& Matrix::operator=(const Matrix& matrix0)
-	{
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				m[i][j] = matrix0(i, j);
-		return (*this);
-	}
-
-	Matrix& Matrix::operator*=(const Matrix& matrix0)
-	{
-		Matrix result;
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				result(i, j) = m[i][0] * matrix0(0, j) + m[i][1] * matrix0(1, j) + m[i][2] * matrix0(2, j) + m[i][3] * matrix0(3, j);
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				m[i][j] = result(i, j);
-		return (*this);
-	}
-
-	Matrix& Matrix::operator+=(const Matrix& matrix0)
-	{
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				m[i][j] = m[i][j] + matrix0(i, j);
-		return (*this);
-	}
-
-	Matrix& Matrix::operator-=(const Matrix& matrix0)
-	{
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				m[i][j] = m[i][j] - matrix0(i, j);
-		return (*this);
-	}
-
-	Matrix& Matrix::operator*=(float f0)
-	{
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				m[i][j] = m[i][j] * f0;
-		return (*this);
-	}
-
-	Matrix& Matrix::operator/=(float f0)
-	{
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				m[i][j] = m[i][j] / f0;
-		return (*this);
-	}
-
-	Matrix Matrix::operator-() const
-	{
-		Matrix result;
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				result(i, j) = -m[i][j];
-		return result;
-	}
-
-	Matrix Matrix::operator*(const Matrix& matrix0) const
-	{
-		Matrix result;
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				result(i, j) = m[i][0] * matrix0(0, j) + m[i][1] * matrix0(1, j) + m[i][2] * matrix0(2, j) + m[i][3] * matrix0(3, j);
-		return result;
-	}
-
-	Matrix Matrix::operator+(const Matrix& matrix0) const
-	{
-		Matrix result;
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				result(i, j) = m[i][j] + matrix0(i, j);
-		return result;
-	}
-
-	Matrix Matrix::operator-(const Matrix& matrix0) const
-	{
-		Matrix result;
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				result(i, j) = m[i][j] - matrix0(i, j);
-		return result;
-	}
-
-	Matrix Matrix::operator*(float f0) const
-	{
-		Matrix result;
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				result(i, j) = m[i][j] * f0;
-		return result;
-	}
-
-	Matrix Matrix::operator/(float f0) const
-	{
-		Matrix result;
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				result(i, j) = m[i][j] / f0;
-		return result;
-	}
-
-	bool Matrix::operator==(const Matrix& matrix0) const
-	{
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				if (m[i][j] != matrix0(i, j))
-					return false;
-		return true;
-	}
-
-	bool Matrix::operator!=(const Matrix& matrix0) const
-	{
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				if (m[i][j] != matrix0(i, j))
-					return true;
-		return false;
-	}
-
-	Matrix operator*(float f0, const Matrix& matrix0)
-	{
-		return matrix0 * f0;
-	}
-
-	Matrix MatrixTranspose(const Matrix& m)
-	{
-		Matrix result;
-		for (int i = 0; i < 4; i++)
-			for (int j = 0; j < 4; j++)
-				result(i, j) = m(j, i);
-		return result;
-	}
-
-	Matrix GetMatrixT(float tx, float ty, float tz)
-	{
-		Matrix result;
-		result(3, 0) = tx;
-		result(3, 1) = ty;
-		result(3, 2) = tz;
-		return result;
-	}
-
-	Matrix GetInverseMatrixT(float tx, float ty, float tz)
-	{
-		Matrix result;
-		result(3, 0) = -tx;
-		result(3, 1) = -ty;
-		result(3, 2) = -tz;
-		return result;
-	}
-
-	Matrix GetMatrixT(Vector translation)
-	{
-		Matrix result;
-		result(3, 0) = translation.x;
-		result(3, 1) = translation.y;
-		result(3, 2) = translation.z;
-		return result;
-	}
-
-	Matrix GetInverseMatrixT(Vector translation)
-	{
-		Matrix result;
-		result(3, 0) = -translation.x;
-		result(3, 1) = -translation.y;
-		result(3, 2) = -translation.z;
-		return result;
-	}
-
 	Matrix GetMatrixR(Quaternion q)
 	{
 		Matrix result;
@@ -294,105 +85,62 @@ namespace Rehenz
 		return result;
 	}
 
-	Matrix GetMatrixRx(float theta)
-	{
-		Matrix result;
-		result(1, 1) = cosf(theta);
-		result(1, 2) = sinf(theta);
-		result(2, 1) = -result(1, 2);
-		result(2, 2) = result(1, 1);
-		return result;
-	}
-
-	Matrix GetMatrixRy(float theta)
-	{
-		Matrix result;
-		result(0, 0) = cosf(theta);
-		result(2, 0) = sinf(theta);
-		result(0, 2) = -result(2, 0);
-		result(2, 2) = result(0, 0);
-		return result;
-	}
-
-	Matrix GetMatrixRz(float theta)
-	{
-		Matrix result;
-		result(0, 0) = cosf(theta);
-		result(0, 1) = sinf(theta);
-		result(1, 0) = -result(0, 1);
-		result(1, 1) = result(0, 0);
-		return result;
-	}
-
-	Matrix GetMatrixS(float scaleX, float scaleY, float scaleZ)
-	{
-		Matrix result;
-		result(0, 0) = scaleX;
-		result(1, 1) = scaleY;
-		result(2, 2) = scaleZ;
-		return result;
-	}
-
-	Matrix GetInverseMatrixS(float scaleX, float scaleY, float scaleZ)
-	{
-		Matrix result;
-		result(0, 0) = 1 / scaleX;
-		result(1, 1) = 1 / scaleY;
-		result(2, 2) = 1 / scaleZ;
-		return result;
-	}
-
-	Matrix GetMatrixS(float scaleXYZ)
+	Matrix GetMatrixP(float fovy, float aspect, float z_near, float z_far)
 	{
-		Matrix result;
-		result(0, 0) = scaleXYZ;
-		result(1, 1) = scaleXYZ;
-		result(2, 2) = scaleXYZ;
+		Matrix result(0.0f);
+		float f1 = 1 / tanf(fovy * 0.5f);
+		result(0, 0) = (float)(f1 / aspect);
+		result(1, 1) = (float)(f1);
+		result(2, 2) = z_far / (z_far - z_near);
+		result(3, 2) = -z_near * z_far / (z_far - z_near);
+		result(2, 3) = 1.0f;
 		return result;
 	}
 
-	Matrix GetInverseMatrixS(float scaleXYZ)
+	Matrix GetInverseMatrixP(float fovy, float aspect, float z_near, float z_far)
 	{
-		Matrix result;
-		result(0, 0) = 1 / scaleXYZ;
-		result(1, 1) = 1 / scaleXYZ;
-		result(2, 2) = 1 / scaleXYZ;
+		Matrix result(0.0f);
+		float f1 = 1 / tanf(fovy * 0.5f);
+		result(0, 0) = aspect / f1;
+		result(1, 1) = 1 / f1;
+		result(3, 2) = 1.0f;
+		result(2, 3) = -(z_far - z_near) / (z_near * z_far);
+		result(3, 3) = 1 / z_near;
 		return result;
 	}
 
-	Matrix GetMatrixS(Vector scale)
+	Point GetOriginP(float z_near, float z_far)
 	{
-		Matrix result;
-		result(0, 0) = scale.x;
-		result(1, 1) = scale.y;
-		result(2, 2) = scale.z;
-		return result;
+		return Point(0, 0, -z_near * z_far / (z_far - z_near), 0);
 	}
 
-	Matrix GetInverseMatrixS(Vector scale)
+	Matrix GetMatrixPReversed(float fovy, float aspect, float z_near, float z_far)
 	{
-		Matrix result;
-		result(0, 0) = 1 / scale.x;
-		result(1, 1) = 1 / scale.y;
-		result(2, 2) = 1 / scale.z;
+		Matrix result(0.0f);
+		float f1 = 1 / tanf(fovy * 0.5f);
+		result(0, 0) = (float)(f1 / aspect);
+		result(1, 1) = (float)(f1);
+		result(2, 2) = z_near / (z_near - z_far);
+		result(3, 2) = z_near * z_far / (z_far - z_near);
+		result(2, 3) = 1.0f;
 		return result;
 	}
 
-	Matrix GetMatrixP(float fovy, float aspect, float z_near, float z_far)
+	Matrix GetInverseMatrixPReversed(float fovy, float aspect, float z_near, float z_far)
 	{
 		Matrix result(0.0f);
 		float f1 = 1 / tanf(fovy * 0.5f);
-		result(0, 0) = (float)(f1 / aspect);
-		result(1, 1) = (float)(f1);
-		result(2, 2) = z_far / (z_far - z_near);
-		result(3, 2) = -z_near * z_far / (z_far - z_near);
-		result(2, 3) = 1.0f;
+		result(0, 0) = aspect / f1;
+		result(1, 1) = 1 / f1;
+		result(3, 2) = 1.0f;
+		result(2, 3) = (z_far - z_near) / (z_near * z_far);
+		result(3, 3) = 1 / z_far;
 		return result;
 	}
 
-	Point GetOriginP(float z_near, float z_far)
+	Point GetOriginPReversed(float z_near, float z_far)
 	{
-		return Point(0, 0, -z_near * z_far / (z_far - z_near), 0);
+		return Point(0, 0, z_near * z_far / (z_far - z_near), 0);
 	}
 
 	Matrix GetMatrixE(float psi, float theta, float phi)
@@ -431,154 +179,240 @@ namespace Rehenz
 		return GetMatrixRy(-aircraft_axes.yaw) * GetMatrixRx(-aircraft_axes.pitch) * GetMatrixRz(-aircraft_axes.roll);
 	}
 
-	Vector::Vector()
-	{
-		v[0] = 0.0f;
-		v[1] = 0.0f;
-		v[2] = 0.0f;
-		v[3] = 0.0f;
-	}
-
-	Vector::Vector(float value)
-	{
-		v[0] = value;
-		v[1] = value;
-		v[2] = value;
-		v[3] = value;
-	}
-
-	Vector::Vector(float _x, float _y, float _z, float _w)
-	{
-		x = _x;
-		y = _y;
-		z = _z;
-		w = _w;
-	}
-
-	float& Vector::operator()(int index)
-	{
-		//	if (index < 0 || index >= 4)
-		//		return v[0];
-		return v[index];
-	}
-
-	float Vector::operator()(int index) const
-	{
-		return v[index];
-	}
-
-	Vector& Vector::operator=(Vector vector0)
-	{
-		for (int i = 0; i < 4; i++)
-			v[i] = vector0(i);
-		return (*this);
-	}
-
-	Vector& Vector::operator*=(const Matrix& matrix0)
-	{
-		Vector result;
-		for (int i = 0; i < 4; i++)
-			result(i) = v[0] * matrix0(0, i) + v[1] * matrix0(1, i) + v[2] * matrix0(2, i) + v[3] * matrix0(3, i);
-		for (int i = 0; i < 4; i++)
-			v[i] = result(i);
-		return (*this);
-	}
-
-	Vector& Vector::operator+=(Vector vector0)
-	{
-		for (int i = 0; i < 4; i++)
-			v[i] = v[i] + vector0(i);
-		return (*this);
-	}
-
-	Vector& Vector::operator-=(Vector vector0)
-	{
-		for (int i = 0; i < 4; i++)
-			v[i] = v[i] - vector0(i);
-		return (*this);
-	}
-
-	Vector& Vector::operator*=(float f0)
-	{
-		for (int i = 0; i < 4; i++)
-			v[i] = v[i] * f0;
-		return (*this);
-	}
-
-	Vector& Vector::operator/=(float f0)
+	AircraftAxes GetAircraftAxes(const Matrix& rotation)
 	{
-		for (int i = 0; i < 4; i++)
-			v[i] = v[i] / f0;
-		return (*this);
-	}
-
-	Vector Vector::operator-() const
-	{
-		Vector result;
-		for (int i = 0; i < 4; i++)
-			result(i) = -v[i];
-		return result;
-	}
-
-	Vector Vector::operator*(const Matrix& matrix0) const
-	{
-		Vector result;
-		for (int i = 0; i < 4; i++)
-			result(i) = v[0] * matrix0(0, i) + v[1] * matrix0(1, i) + v[2] * matrix0(2, i) + v[3] * matrix0(3, i);
-		return result;
-	}
-
-	Vector Vector::operator+(Vector vector0) const
-	{
-		Vector result;
-		for (int i = 0; i < 4; i++)
-			result(i) = v[i] + vector0(i);
+		// rotation = Rz(roll) * Rx(pitch) * Ry(yaw), row 2 is (cos(pitch)sin(yaw), -sin(pitch), cos(pitch)cos(yaw))
+		// pitch from atan2 of cos(pitch), which keeps precision near +-pi/2 where asin does not
+		AircraftAxes result;
+		float cos_pitch = sqrtf(rotation(2, 0) * rotation(2, 0) + rotation(2, 2) * rotation(2, 2));
+		result.pitch = atan2f(-rotation(2, 1), cos_pitch);
+		if (cos_pitch > 1e-6f)
+		{
+			result.yaw = atan2f(rotation(2, 0), rotation(2, 2));
+			result.roll = atan2f(rotation(0, 1), rotation(1, 1));
+		}
+		else
+		{
+			// gimbal lock, only yaw - roll or yaw + roll is known, so put it all into yaw
+			result.yaw = atan2f(-rotation(0, 2), rotation(0, 0));
+			result.roll = 0;
+		}
 		return result;
 	}
 
-	Vector Vector::operator-(Vector vector0) const
+	float MatrixDeterminant(const Matrix& m)
+	{
+		// 2x2 determinants of upper two rows and lower two rows
+		float s0 = m(0, 0) * m(1, 1) - m(1, 0) * m(0, 1);
+		float s1 = m(0, 0) * m(1, 2) - m(1, 0) * m(0, 2);
+		float s2 = m(0, 0) * m(1, 3) - m(1, 0) * m(0, 3);
+		float s3 = m(0, 1) * m(1, 2) - m(1, 1) * m(0, 2);
+		float s4 = m(0, 1) * m(1, 3) - m(1, 1) * m(0, 3);
+		float s5 = m(0, 2) * m(1, 3) - m(1, 2) * m(0, 3);
+		float c0 = m(2, 0) * m(3, 1) - m(3, 0) * m(2, 1);
+		float c1 = m(2, 0) * m(3, 2) - m(3, 0) * m(2, 2);
+		float c2 = m(2, 0) * m(3, 3) - m(3, 0) * m(2, 3);
+		float c3 = m(2, 1) * m(3, 2) - m(3, 1) * m(2, 2);
+		float c4 = m(2, 1) * m(3, 3) - m(3, 1) * m(2, 3);
+		float c5 = m(2, 2) * m(3, 3) - m(3, 2) * m(2, 3);
+		return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	}
+
+#ifdef REHENZ_SIMD
+	namespace
+	{
+		// 2x2 matrices are stored in one register as (m00, m01, m10, m11)
+
+		// a * b
+		inline __m128 Mat2Mul(__m128 a, __m128 b)
+		{
+			return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+				_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+		}
+
+		// adjugate(a) * b
+		inline __m128 Mat2AdjMul(__m128 a, __m128 b)
+		{
+			return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+				_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+		}
+
+		// a * adjugate(b)
+		inline __m128 Mat2MulAdj(__m128 a, __m128 b)
+		{
+			return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+				_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+		}
+
+		// a x b, w = 0
+		inline __m128 SimdCross(__m128 a, __m128 b)
+		{
+			__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+			return _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+		}
+
+		// dot of x,y,z in all lanes
+		inline __m128 SimdDot3(__m128 a, __m128 b)
+		{
+			__m128 p = _mm_mul_ps(a, b);
+			__m128 s = _mm_add_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)));
+			return _mm_add_ps(s, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)));
+		}
+	}
+#endif
+
+	Matrix MatrixInverse(const Matrix& m)
 	{
-		Vector result;
-		for (int i = 0; i < 4; i++)
-			result(i) = v[i] - vector0(i);
+		Matrix result;
+#ifdef REHENZ_SIMD
+		// blockwise inversion of m = | A B |, inverse = 1/|m| * | X Y |
+		//                            | C D |                    | Z W |
+		__m128 r0 = _mm_loadu_ps(m.m[0]), r1 = _mm_loadu_ps(m.m[1]), r2 = _mm_loadu_ps(m.m[2]), r3 = _mm_loadu_ps(m.m[3]);
+		__m128 a = _mm_movelh_ps(r0, r1), b = _mm_movehl_ps(r1, r0);
+		__m128 c = _mm_movelh_ps(r2, r3), d = _mm_movehl_ps(r3, r2);
+		// (|A|, |B|, |C|, |D|)
+		__m128 det_sub = _mm_sub_ps(
+			_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+			_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+		__m128 det_a = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 det_b = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 det_c = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 det_d = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(3, 3, 3, 3));
+		__m128 d_c = Mat2AdjMul(d, c);
+		__m128 a_b = Mat2AdjMul(a, b);
+		// adjugates of X, Y, Z, W
+		__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), Mat2Mul(b, d_c));
+		__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), Mat2Mul(c, a_b));
+		__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), Mat2MulAdj(d, a_b));
+		__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), Mat2MulAdj(a, d_c));
+		// |m| = |A||D| + |B||C| - tr(adjugate(A)B adjugate(D)C)
+		__m128 tr = _mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(3, 1, 2, 0)));
+		tr = _mm_add_ps(tr, _mm_movehl_ps(tr, tr));
+		tr = _mm_add_ss(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 1, 1, 1)));
+		__m128 det = _mm_sub_ss(_mm_add_ss(_mm_mul_ss(det_a, det_d), _mm_mul_ss(det_b, det_c)), tr);
+		det = _mm_shuffle_ps(det, det, _MM_SHUFFLE(0, 0, 0, 0));
+		// adjugate of 2x2 is (m11, -m01, -m10, m00), signs go with 1/|m| and order goes with the stores
+		__m128 rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+		x = _mm_mul_ps(x, rdet);
+		y = _mm_mul_ps(y, rdet);
+		z = _mm_mul_ps(z, rdet);
+		w = _mm_mul_ps(w, rdet);
+		_mm_storeu_ps(result.m[0], _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_storeu_ps(result.m[1], _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+		_mm_storeu_ps(result.m[2], _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_storeu_ps(result.m[3], _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+#else
+		// adjugate by 2x2 determinants of upper two rows and lower two rows
+		float s0 = m(0, 0) * m(1, 1) - m(1, 0) * m(0, 1);
+		float s1 = m(0, 0) * m(1, 2) - m(1, 0) * m(0, 2);
+		float s2 = m(0, 0) * m(1, 3) - m(1, 0) * m(0, 3);
+		float s3 = m(0, 1) * m(1, 2) - m(1, 1) * m(0, 2);
+		float s4 = m(0, 1) * m(1, 3) - m(1, 1) * m(0, 3);
+		float s5 = m(0, 2) * m(1, 3) - m(1, 2) * m(0, 3);
+		float c0 = m(2, 0) * m(3, 1) - m(3, 0) * m(2, 1);
+		float c1 = m(2, 0) * m(3, 2) - m(3, 0) * m(2, 2);
+		float c2 = m(2, 0) * m(3, 3) - m(3, 0) * m(2, 3);
+		float c3 = m(2, 1) * m(3, 2) - m(3, 1) * m(2, 2);
+		float c4 = m(2, 1) * m(3, 3) - m(3, 1) * m(2, 3);
+		float c5 = m(2, 2) * m(3, 3) - m(3, 2) * m(2, 3);
+		float rdet = 1 / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+		result(0, 0) = (m(1, 1) * c5 - m(1, 2) * c4 + m(1, 3) * c3) * rdet;
+		result(0, 1) = (-m(0, 1) * c5 + m(0, 2) * c4 - m(0, 3) * c3) * rdet;
+		result(0, 2) = (m(3, 1) * s5 - m(3, 2) * s4 + m(3, 3) * s3) * rdet;
+		result(0, 3) = (-m(2, 1) * s5 + m(2, 2) * s4 - m(2, 3) * s3) * rdet;
+		result(1, 0) = (-m(1, 0) * c5 + m(1, 2) * c2 - m(1, 3) * c1) * rdet;
+		result(1, 1) = (m(0, 0) * c5 - m(0, 2) * c2 + m(0, 3) * c1) * rdet;
+		result(1, 2) = (-m(3, 0) * s5 + m(3, 2) * s2 - m(3, 3) * s1) * rdet;
+		result(1, 3) = (m(2, 0) * s5 - m(2, 2) * s2 + m(2, 3) * s1) * rdet;
+		result(2, 0) = (m(1, 0) * c4 - m(1, 1) * c2 + m(1, 3) * c0) * rdet;
+		result(2, 1) = (-m(0, 0) * c4 + m(0, 1) * c2 - m(0, 3) * c0) * rdet;
+		result(2, 2) = (m(3, 0) * s4 - m(3, 1) * s2 + m(3, 3) * s0) * rdet;
+		result(2, 3) = (-m(2, 0) * s4 + m(2, 1) * s2 - m(2, 3) * s0) * rdet;
+		result(3, 0) = (-m(1, 0) * c3 + m(1, 1) * c1 - m(1, 2) * c0) * rdet;
+		result(3, 1) = (m(0, 0) * c3 - m(0, 1) * c1 + m(0, 2) * c0) * rdet;
+		result(3, 2) = (-m(3, 0) * s3 + m(3, 1) * s1 - m(3, 2) * s0) * rdet;
+		result(3, 3) = (m(2, 0) * s3 - m(2, 1) * s1 + m(2, 2) * s0) * rdet;
+#endif
 		return result;
 	}
 
-	Vector Vector::operator*(float f0) const
+	Matrix MatrixInverseAffine(const Matrix& m)
 	{
-		Vector result;
-		for (int i = 0; i < 4; i++)
-			result(i) = v[i] * f0;
+		// inverse of upper 3x3 A has columns (r1 x r2, r2 x r0, r0 x r1) / |A|, r is row of A
+		// translation is -t * inverse(A)
+		Matrix result;
+#ifdef REHENZ_SIMD
+		__m128 r0 = _mm_loadu_ps(m.m[0]), r1 = _mm_loadu_ps(m.m[1]), r2 = _mm_loadu_ps(m.m[2]);
+		__m128 c0 = SimdCross(r1, r2), c1 = SimdCross(r2, r0), c2 = SimdCross(r0, r1);
+		__m128 rdet = _mm_div_ps(_mm_set1_ps(1.0f), SimdDot3(r0, c0));
+		c0 = _mm_mul_ps(c0, rdet);
+		c1 = _mm_mul_ps(c1, rdet);
+		c2 = _mm_mul_ps(c2, rdet);
+		__m128 c3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		__m128 t = _mm_loadu_ps(m.m[3]);
+		__m128 tinv = _mm_mul_ps(_mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)), c0);
+		tinv = _mm_add_ps(tinv, _mm_mul_ps(_mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1)), c1));
+		tinv = _mm_add_ps(tinv, _mm_mul_ps(_mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2)), c2));
+		_mm_storeu_ps(result.m[0], c0);
+		_mm_storeu_ps(result.m[1], c1);
+		_mm_storeu_ps(result.m[2], c2);
+		_mm_storeu_ps(result.m[3], _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), tinv));
+#else
+		float c00 = m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1), c01 = m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2), c02 = m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0);
+		float c10 = m(2, 1) * m(0, 2) - m(2, 2) * m(0, 1), c11 = m(2, 2) * m(0, 0) - m(2, 0) * m(0, 2), c12 = m(2, 0) * m(0, 1) - m(2, 1) * m(0, 0);
+		float c20 = m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1), c21 = m(0, 2) * m(1, 0) - m(0, 0) * m(1, 2), c22 = m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0);
+		float rdet = 1 / (m(0, 0) * c00 + m(0, 1) * c01 + m(0, 2) * c02);
+		result(0, 0) = c00 * rdet; result(0, 1) = c10 * rdet; result(0, 2) = c20 * rdet;
+		result(1, 0) = c01 * rdet; result(1, 1) = c11 * rdet; result(1, 2) = c21 * rdet;
+		result(2, 0) = c02 * rdet; result(2, 1) = c12 * rdet; result(2, 2) = c22 * rdet;
+		for (int j = 0; j < 3; j++)
+			result(3, j) = -(m(3, 0) * result(0, j) + m(3, 1) * result(1, j) + m(3, 2) * result(2, j));
+#endif
 		return result;
 	}
 
-	Vector Vector::operator/(float f0) const
+	Matrix MatrixNormal(const Matrix& m)
 	{
-		Vector result;
-		for (int i = 0; i < 4; i++)
-			result(i) = v[i] / f0;
+		// transpose of inverse of upper 3x3, rows are (r1 x r2, r2 x r0, r0 x r1) / |A|, see MatrixInverseAffine
+		Matrix result;
+#ifdef REHENZ_SIMD
+		__m128 r0 = _mm_loadu_ps(m.m[0]), r1 = _mm_loadu_ps(m.m[1]), r2 = _mm_loadu_ps(m.m[2]);
+		__m128 c0 = SimdCross(r1, r2);
+		__m128 rdet = _mm_div_ps(_mm_set1_ps(1.0f), SimdDot3(r0, c0));
+		_mm_storeu_ps(result.m[0], _mm_mul_ps(c0, rdet));
+		_mm_storeu_ps(result.m[1], _mm_mul_ps(SimdCross(r2, r0), rdet));
+		_mm_storeu_ps(result.m[2], _mm_mul_ps(SimdCross(r0, r1), rdet));
+#else
+		float c00 = m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1), c01 = m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2), c02 = m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0);
+		float rdet = 1 / (m(0, 0) * c00 + m(0, 1) * c01 + m(0, 2) * c02);
+		result(0, 0) = c00 * rdet; result(0, 1) = c01 * rdet; result(0, 2) = c02 * rdet;
+		result(1, 0) = (m(2, 1) * m(0, 2) - m(2, 2) * m(0, 1)) * rdet;
+		result(1, 1) = (m(2, 2) * m(0, 0) - m(2, 0) * m(0, 2)) * rdet;
+		result(1, 2) = (m(2, 0) * m(0, 1) - m(2, 1) * m(0, 0)) * rdet;
+		result(2, 0) = (m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1)) * rdet;
+		result(2, 1) = (m(0, 2) * m(1, 0) - m(0, 0) * m(1, 2)) * rdet;
+		result(2, 2) = (m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0)) * rdet;
+#endif
 		return result;
 	}
 
-	bool Vector::operator==(Vector vector0) const
+	void MatrixDecompose(const Matrix& m, Vector& scale, Matrix& rotation, Vector& translation)
 	{
-		for (int i = 0; i < 4; i++)
-			if (v[i] != vector0(i))
-				return false;
-		return true;
-	}
-
-	bool Vector::operator!=(Vector vector0) const
-	{
-		for (int i = 0; i < 4; i++)
-			if (v[i] != vector0(i))
-				return true;
-		return false;
-	}
-
-	Vector operator*(float f0, Vector vector0)
-	{
-		return vector0 * f0;
+		// rows of upper 3x3 are rows of rotation multiplied by scale
+		Vector r0(m(0, 0), m(0, 1), m(0, 2)), r1(m(1, 0), m(1, 1), m(1, 2)), r2(m(2, 0), m(2, 1), m(2, 2));
+		scale = Vector(VectorLength(r0), VectorLength(r1), VectorLength(r2));
+		if (VectorDot(r0, VectorCross(r1, r2)) < 0)
+			scale.x = -scale.x;
+		rotation = Matrix();
+		for (int i = 0; i < 3; i++)
+		{
+			float rs = (scale(i) != 0) ? 1 / scale(i) : 0.0f;
+			for (int j = 0; j < 3; j++)
+				rotation(i, j) = m(i, j) * rs;
+		}
+		translation = Vector(m(3, 0), m(3, 1), m(3, 2));
 	}
 
 	Quaternion::Quaternion()
@@ -762,24 +596,6 @@ namespace Rehenz
 		return GetQuaternionZ(roll) * GetQuaternionX(pitch) * GetQuaternionY(yaw);
 	}
 
-	Vector2::Vector2()
-	{
-		x = 0;
-		y = 0;
-	}
-
-	Vector2::Vector2(const Vector& v)
-	{
-		x = v.x;
-		y = v.y;
-	}
-
-	Vector2::Vector2(float _x, float _y)
-	{
-		x = _x;
-		y = _y;
-	}
-
 	Vector2& Vector2::operator+=(Vector2 v)
 	{
 		x += v.x;
@@ -851,27 +667,6 @@ namespace Rehenz
 		return v * f;
 	}
 
-	Vector3::Vector3()
-	{
-		x = 0;
-		y = 0;
-		z = 0;
-	}
-
-	Vector3::Vector3(const Vector& v)
-	{
-		x = v.x;
-		y = v.y;
-		z = v.z;
-	}
-
-	Vector3::Vector3(float _x, float _y, float _z)
-	{
-		x = _x;
-		y = _y;
-		z = _z;
-	}
-
 	Vector3& Vector3::operator+=(Vector3 v)
 	{
 		x += v.x;
@@ -949,11 +744,6 @@ namespace Rehenz
 		return v * f;
 	}
 
-	float VectorLength(Vector v1)
-	{
-		return sqrtf(v1.x * v1.x + v1.y * v1.y + v1.z * v1.z + v1.w * v1.w);
-	}
-
 	float VectorLength(Vector2 v)
 	{
 		return sqrtf(v.x * v.x + v.y * v.y);
@@ -964,11 +754,6 @@ namespace Rehenz
 		return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
 	}
 
-	float VectorDot(Vector v1, Vector v2)
-	{
-		return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + v1.w * v2.w;
-	}
-
 	float VectorDot(Vector2 v1, Vector2 v2)
 	{
 		return v1.x * v2.x + v1.y * v2.y;
@@ -979,16 +764,6 @@ namespace Rehenz
 		return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
 	}
 
-	Vector VectorCross(Vector v1, Vector v2)
-	{
-		Vector result;
-		result.x = v1.y * v2.z - v1.z * v2.y;
-		result.y = v1.z * v2.x - v1.x * v2.z;
-		result.z = v1.x * v2.y - v1.y * v2.x;
-		result.w = 0.0f;
-		return result;
-	}
-
 	Vector3 VectorCross(Vector3 v1, Vector3 v2)
 	{
 		Vector3 result;
@@ -998,26 +773,6 @@ namespace Rehenz
 		return result;
 	}
 
-	Vector VectorLerp(Vector v1, Vector v2, float t)
-	{
-		Vector result;
-		result.x = Lerp(v1.x, v2.x, t);
-		result.y = Lerp(v1.y, v2.y, t);
-		result.z = Lerp(v1.z, v2.z, t);
-		result.w = Lerp(v1.w, v2.w, t);
-		return result;
-	}
-
-	Vector VectorNormalize(Vector v1)
-	{
-		Vector result;
-		float length = VectorLength(v1);
-		if (length == 0)
-			return v1;
-
-		return v1 / length;
-	}
-
 	Vector3 VectorNormalize(Vector3 v)
 	{
 		float length = VectorLength(v);
@@ -1027,16 +782,6 @@ namespace Rehenz
 		return v / length;
 	}
 
-	Point PointLerp(Point p1, Point p2, float t)
-	{
-		Point result;
-		result.x = Lerp(p1.x, p2.x, t);
-		result.y = Lerp(p1.y, p2.y, t);
-		result.z = Lerp(p1.z, p2.z, t);
-		result.w = Lerp(p1.w, p2.w, t);
-		return result;
-	}
-
 	/*Point PointStandard(Point p1, float w)
 	{
 		Point result;
@@ -1067,9 +812,313 @@ namespace Rehenz
 		return VectorLength(p1 - p2);
 	}
 
-	Vector TrianglesNormal(Point p1, Point p2, Point p3)
+	namespace
+	{
+		// how to finish a batch transform
+		enum class BatchOp { None, Project, Clip };
+
+		// input is points of stride floats, w is read if stride is 4, or it is w
+		struct BatchIn
+		{
+			const float* data;
+			int stride;
+			float w;
+		};
+
+		// output to aos if it is not nullptr, or to soa
+		struct BatchOut
+		{
+			float* aos;
+			float* x;
+			float* y;
+			float* z;
+			float* w;
+			unsigned char* outcodes;
+		};
+
+		// same as ComputeClipState of clipper
+		inline unsigned char ClipOutcode(float x, float y, float z, float w)
+		{
+			int code = 0;
+			if (x < -w)     code |= 1;
+			else if (x > w) code |= 2;
+			if (y < -w)     code |= 4;
+			else if (y > w) code |= 8;
+			if (z < 0)      code |= 16;
+			else if (z > w) code |= 32;
+			return static_cast<unsigned char>(code);
+		}
+
+		template <BatchOp op, int stride>
+		void TransformBatchScalar(const Matrix& m, BatchIn in, BatchOut out, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				const float* p = in.data + static_cast<size_t>(i) * stride;
+				Vector r = Vector(p[0], p[1], p[2], (stride == 4) ? p[3] : in.w) * m;
+				if (op == BatchOp::Project)
+				{
+					float f = 1 / r.w;
+					r.x *= f, r.y *= f, r.z *= f, r.w = f;
+				}
+				else if (op == BatchOp::Clip)
+					out.outcodes[i] = ClipOutcode(r.x, r.y, r.z, r.w);
+				if (out.aos != nullptr)
+				{
+					for (int j = 0; j < 4; j++)
+						out.aos[static_cast<size_t>(i) * 4 + j] = r.v[j];
+				}
+				else
+				{
+					out.x[i] = r.x, out.y[i] = r.y, out.z[i] = r.z;
+					if (out.w != nullptr)
+						out.w[i] = r.w;
+				}
+			}
+		}
+
+		template <BatchOp op>
+		void TransformBatchScalar(const Matrix& m, BatchIn in, BatchOut out, int begin, int end)
+		{
+			if (in.stride == 4)
+				TransformBatchScalar<op, 4>(m, in, out, begin, end);
+			else
+				TransformBatchScalar<op, 3>(m, in, out, begin, end);
+		}
+
+#ifdef REHENZ_SIMD
+#if defined(__GNUC__) || defined(__clang__)
+#define REHENZ_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define REHENZ_TARGET_AVX2
+#endif
+
+		bool CpuSupportsAvx2()
+		{
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+			__cpuid(info, 1);
+			bool fma = (info[2] & (1 << 12)) != 0;
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			__cpuidex(info, 7, 0);
+			bool avx2 = (info[1] & (1 << 5)) != 0;
+			// os must save ymm registers
+			return fma && avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#elif defined(__GNUC__) || defined(__clang__)
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+			return false;
+#endif
+		}
+
+		// transpose 4x4 floats in each 128 bits lane
+		REHENZ_TARGET_AVX2 inline void Transpose4(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+		{
+			__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+			__m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+			r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+			r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		}
+
+		// aos output, 2 points per register, so no transpose is needed
+		template <BatchOp op>
+		REHENZ_TARGET_AVX2 void TransformBatchAvx2Aos(const Matrix& m, BatchIn in, BatchOut out, int count)
+		{
+			// each row in both lanes
+			__m256 row[4];
+			for (int j = 0; j < 4; j++)
+				row[j] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m.m[j]));
+			const __m256 in_w = _mm256_set1_ps(in.w);
+			// outcode of bits (x < -w, y < -w, z < 0) and (x > w, y > w, z > w) << 3
+			unsigned char outcode_table[64];
+			if (op == BatchOp::Clip)
+			{
+				for (int a = 0; a < 64; a++)
+					outcode_table[a] = static_cast<unsigned char>((a & 1) | ((a & 8) >> 2) | ((a & 2) << 1) | ((a & 16) >> 1) | ((a & 4) << 2) | (a & 32));
+			}
+
+			int i = 0;
+			// a Vector3 pair is loaded by 2 loads of 4 floats, the second one reads a float after the pair
+			int end = (in.stride == 4) ? count : count - 1;
+			for (; i + 2 <= end; i += 2)
+			{
+				const float* p = in.data + static_cast<size_t>(i) * in.stride;
+				__m256 v;
+				if (in.stride == 4)
+					v = _mm256_loadu_ps(p);
+				else
+				{
+					v = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 3), 1);
+					v = _mm256_blend_ps(v, in_w, 0x88);
+				}
+				__m256 r = _mm256_mul_ps(_mm256_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0)), row[0]);
+				r = _mm256_fmadd_ps(_mm256_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1)), row[1], r);
+				r = _mm256_fmadd_ps(_mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2)), row[2], r);
+				r = _mm256_fmadd_ps(_mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3)), row[3], r);
+
+				if (op == BatchOp::Project)
+				{
+					__m256 f = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_permute_ps(r, _MM_SHUFFLE(3, 3, 3, 3)));
+					r = _mm256_blend_ps(_mm256_mul_ps(r, f), f, 0x88);
+				}
+				else if (op == BatchOp::Clip)
+				{
+					// bits of x,y,z are (x < -w, y < -w, z < 0) and (x > w, y > w, z > w)
+					__m256 w = _mm256_permute_ps(r, _MM_SHUFFLE(3, 3, 3, 3));
+					__m256 neg_w = _mm256_blend_ps(_mm256_sub_ps(_mm256_setzero_ps(), w), _mm256_setzero_ps(), 0x44);
+					int lt = _mm256_movemask_ps(_mm256_cmp_ps(r, neg_w, _CMP_LT_OQ));
+					int gt = _mm256_movemask_ps(_mm256_cmp_ps(r, w, _CMP_GT_OQ)) & ~lt;
+					out.outcodes[i] = outcode_table[(lt & 7) | ((gt & 7) << 3)];
+					out.outcodes[i + 1] = outcode_table[((lt >> 4) & 7) | (((gt >> 4) & 7) << 3)];
+				}
+				_mm256_storeu_ps(out.aos + static_cast<size_t>(i) * 4, r);
+			}
+			TransformBatchScalar<op>(m, in, out, i, count);
+		}
+
+		// soa output, 8 points per loop, in struct of arrays layout in registers
+		REHENZ_TARGET_AVX2 void TransformBatchAvx2Soa(const Matrix& m, BatchIn in, BatchOut out, int count)
+		{
+			__m256 mm[4][4];
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					mm[i][j] = _mm256_set1_ps(m.m[i][j]);
+			const __m256i stride3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+
+			int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				const float* p = in.data + static_cast<size_t>(i) * in.stride;
+				__m256 x, y, z, w;
+				if (in.stride == 4)
+				{
+					// lane 0 has points 0-3, lane 1 has points 4-7
+					x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 0)), _mm_loadu_ps(p + 16), 1);
+					y = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 20), 1);
+					z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 24), 1);
+					w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 12)), _mm_loadu_ps(p + 28), 1);
+					Transpose4(x, y, z, w);
+				}
+				else
+				{
+					x = _mm256_i32gather_ps(p + 0, stride3, 4);
+					y = _mm256_i32gather_ps(p + 1, stride3, 4);
+					z = _mm256_i32gather_ps(p + 2, stride3, 4);
+					w = _mm256_set1_ps(in.w);
+				}
+
+				__m256 r[4];
+				for (int j = 0; j < 4; j++)
+					r[j] = _mm256_fmadd_ps(w, mm[3][j], _mm256_fmadd_ps(z, mm[2][j], _mm256_fmadd_ps(y, mm[1][j], _mm256_mul_ps(x, mm[0][j]))));
+				_mm256_storeu_ps(out.x + i, r[0]);
+				_mm256_storeu_ps(out.y + i, r[1]);
+				_mm256_storeu_ps(out.z + i, r[2]);
+				if (out.w != nullptr)
+					_mm256_storeu_ps(out.w + i, r[3]);
+			}
+			TransformBatchScalar<BatchOp::None>(m, in, out, i, count);
+		}
+#endif
+
+		template <BatchOp op>
+		void TransformBatch(const Matrix& m, BatchIn in, BatchOut out, int count)
+		{
+#ifdef REHENZ_SIMD
+			if (TransformUseAvx2())
+			{
+				if (out.aos != nullptr)
+					TransformBatchAvx2Aos<op>(m, in, out, count);
+				else
+				{
+					assert(op == BatchOp::None);
+					TransformBatchAvx2Soa(m, in, out, count);
+				}
+				return;
+			}
+#endif
+			TransformBatchScalar<op>(m, in, out, 0, count);
+		}
+
+		inline BatchIn MakeBatchIn(const Point* in)
+		{
+			return BatchIn{ in->v, 4, 1.0f };
+		}
+
+		inline BatchIn MakeBatchIn(const Vector3* in, float w)
+		{
+			return BatchIn{ &in->x, 3, w };
+		}
+
+		inline BatchOut MakeBatchOut(Vector* out, unsigned char* outcodes = nullptr)
+		{
+			return BatchOut{ out->v, nullptr, nullptr, nullptr, nullptr, outcodes };
+		}
+
+		inline BatchOut MakeBatchOut(float* x, float* y, float* z, float* w)
+		{
+			return BatchOut{ nullptr, x, y, z, w, nullptr };
+		}
+	}
+
+	void TransformPoints(const Matrix& m, const Point* in, Point* out, int count)
+	{
+		TransformBatch<BatchOp::None>(m, MakeBatchIn(in), MakeBatchOut(out), count);
+	}
+
+	void TransformPoints(const Matrix& m, const Vector3* in, Point* out, int count)
+	{
+		TransformBatch<BatchOp::None>(m, MakeBatchIn(in, 1.0f), MakeBatchOut(out), count);
+	}
+
+	void TransformPoints(const Matrix& m, const Point* in, float* out_x, float* out_y, float* out_z, float* out_w, int count)
 	{
-		return VectorCross(p2 - p1, p3 - p1);
+		TransformBatch<BatchOp::None>(m, MakeBatchIn(in), MakeBatchOut(out_x, out_y, out_z, out_w), count);
+	}
+
+	void TransformPoints(const Matrix& m, const Vector3* in, float* out_x, float* out_y, float* out_z, float* out_w, int count)
+	{
+		TransformBatch<BatchOp::None>(m, MakeBatchIn(in, 1.0f), MakeBatchOut(out_x, out_y, out_z, out_w), count);
+	}
+
+	void TransformVectors(const Matrix& m, const Vector3* in, Vector* out, int count)
+	{
+		TransformBatch<BatchOp::None>(m, MakeBatchIn(in, 0.0f), MakeBatchOut(out), count);
+	}
+
+	void TransformPointsProject(const Matrix& m, const Point* in, Point* out, int count)
+	{
+		TransformBatch<BatchOp::Project>(m, MakeBatchIn(in), MakeBatchOut(out), count);
+	}
+
+	void TransformPointsProject(const Matrix& m, const Vector3* in, Point* out, int count)
+	{
+		TransformBatch<BatchOp::Project>(m, MakeBatchIn(in, 1.0f), MakeBatchOut(out), count);
+	}
+
+	void TransformPointsClip(const Matrix& m, const Point* in, Point* out, unsigned char* outcodes, int count)
+	{
+		TransformBatch<BatchOp::Clip>(m, MakeBatchIn(in), MakeBatchOut(out, outcodes), count);
+	}
+
+	void TransformPointsClip(const Matrix& m, const Vector3* in, Point* out, unsigned char* outcodes, int count)
+	{
+		TransformBatch<BatchOp::Clip>(m, MakeBatchIn(in, 1.0f), MakeBatchOut(out, outcodes), count);
+	}
+
+	bool TransformUseAvx2()
+	{
+#ifdef REHENZ_SIMD
+		static const bool use = CpuSupportsAvx2();
+		return use;
+#else
+		return false;
+#endif
 	}
 
 	Quaternion QuaternionConjugate(Quaternion q)
@@ -1,67 +1,139 @@
 #pragma once
 #include <cmath>
 
+// Matrix and Vector use sse when it is available, define REHENZ_NO_SIMD to use scalar code
+// both compute each component with same operations in same order, so results are identical
+// unless the compiler contracts scalar code to fma
+// they are constexpr, and use scalar code in constant evaluation
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define REHENZ_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#endif
+#if !defined(REHENZ_CONSTANT_EVALUATED) && ((defined(__GNUC__) && __GNUC__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925))
+#define REHENZ_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+// without the builtin, always use the code for constant evaluation
+#ifndef REHENZ_CONSTANT_EVALUATED
+#define REHENZ_CONSTANT_EVALUATED() true
+#endif
+#if !defined(REHENZ_NO_SIMD) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__))
+#define REHENZ_SIMD
+#include <xmmintrin.h>
+#endif
+
 namespace Rehenz
 {
-	const float pi = 3.141592653590f;
-	const float pi_mul2 = 6.283185307180f;
-	const float pi_mul3 = 9.424777960769f;
-	const float pi_mul4 = 12.566370614359f;
-	const float pi_div2 = 1.570796326795f;
-	const float pi_div3 = 1.047197551197f;
-	const float pi_div4 = 0.785398163397f;
+	constexpr float pi = 3.141592653590f;
+	constexpr float pi_mul2 = 6.283185307180f;
+	constexpr float pi_mul3 = 9.424777960769f;
+	constexpr float pi_mul4 = 12.566370614359f;
+	constexpr float pi_div2 = 1.570796326795f;
+	constexpr float pi_div3 = 1.047197551197f;
+	constexpr float pi_div4 = 0.785398163397f;
 
 	template <typename T>
-	inline T Min(T a, T b)
+	constexpr T Min(T a, T b)
 	{
 		return (b < a) ? b : a;
 	}
 
 	template <typename T>
-	inline T Min(T a, T b, T c)
+	constexpr T Min(T a, T b, T c)
 	{
 		return Min(a, Min(b, c));
 	}
 
 	template <typename T>
-	inline T Max(T a, T b)
+	constexpr T Max(T a, T b)
 	{
 		return (a < b) ? b : a;
 	}
 
 	template <typename T>
-	inline T Max(T a, T b, T c)
+	constexpr T Max(T a, T b, T c)
 	{
 		return Max(a, Max(b, c));
 	}
 
 	// limit x to [min, max]
 	template <typename T>
-	inline T Clamp(T x, T min, T max)
+	constexpr T Clamp(T x, T min, T max)
 	{
 		return (x < min) ? min : ((max < x) ? max : x);
 	}
 
 	// interpolation
 	template <typename T>
-	inline T Lerp(T x1, T x2, float t)
+	constexpr T Lerp(T x1, T x2, float t)
 	{
 		return x1 + static_cast<decltype(x2 - x1)>((x2 - x1) * t);
 	}
 
 	// f(0)=0, f(1)=1, f(t) = 6*t^5 - 15*t^4 + 10*t^3
-	inline float Fade(float t)
+	constexpr float Fade(float t)
 	{
 		return t * t * t * (10 + t * (-15 + t * 6));
 	}
 
 	// smooth interpolation
 	template <typename T>
-	inline T Fade(T x1, T x2, float t)
+	constexpr T Fade(T x1, T x2, float t)
 	{
 		return Lerp(x1, x2, Fade(t));
 	}
 
+	// sqrt for constant expressions, x >= 0
+	constexpr float ConstSqrt(float x)
+	{
+		if (!(x > 0) || x + x == x)
+			return x > 0 ? x : 0 * x;
+		// newton iteration in double from above, stop when it no longer decreases
+		double r = x > 1 ? x : 1.0;
+		for (int i = 0; i < 256; i++)
+		{
+			double next = 0.5 * (r + x / r);
+			if (next >= r)
+				break;
+			r = next;
+		}
+		return static_cast<float>(r);
+	}
+
+	// reduce x to [-pi,pi] for ConstSin and ConstCos
+	constexpr double ConstReduceAngle(float x)
+	{
+		double t = x / 6.283185307179586;
+		long long n = static_cast<long long>(t < 0 ? t - 0.5 : t + 0.5);
+		return x - n * 6.283185307179586;
+	}
+
+	// sin for constant expressions, taylor series in double
+	constexpr float ConstSin(float x)
+	{
+		double t = ConstReduceAngle(x);
+		double term = t, sum = t;
+		for (int i = 1; i < 16; i++)
+		{
+			term *= -t * t / ((2 * i) * (2 * i + 1));
+			sum += term;
+		}
+		return static_cast<float>(sum);
+	}
+
+	// cos for constant expressions, taylor series in double
+	constexpr float ConstCos(float x)
+	{
+		double t = ConstReduceAngle(x);
+		double term = 1, sum = 1;
+		for (int i = 1; i < 16; i++)
+		{
+			term *= -t * t / ((2 * i - 1) * (2 * i));
+			sum += term;
+		}
+		return static_cast<float>(sum);
+	}
+
 
 
 	struct Matrix;
@@ -81,52 +153,66 @@ namespace Rehenz
 		float m[4][4];
 
 		// default unit matrix
-		Matrix();
-		explicit Matrix(float value);
-		explicit Matrix(float _00, float _01, float _02, float _03,
+		constexpr Matrix();
+		constexpr explicit Matrix(float value);
+		constexpr explicit Matrix(float _00, float _01, float _02, float _03,
 			float _10, float _11, float _12, float _13,
 			float _20, float _21, float _22, float _23,
 			float _30, float _31, float _32, float _33);
 
 		// access date
-		float& operator()(int row, int col);
-		float operator()(int row, int col) const;
-		Matrix& operator=(const Matrix&);
+		constexpr float& operator()(int row, int col);
+		constexpr float operator()(int row, int col) const;
 
 		// some operator
-		Matrix& operator*=(const Matrix&);
-		Matrix& operator+=(const Matrix&);
-		Matrix& operator-=(const Matrix&);
-		Matrix& operator*=(float);
-		Matrix& operator/=(float);
-
-		Matrix operator-() const;
-
-		Matrix operator*(const Matrix&) const;
-		Matrix operator+(const Matrix&) const;
-		Matrix operator-(const Matrix&) const;
-		Matrix operator*(float) const;
-		Matrix operator/(float) const;
-
-		bool operator==(const Matrix&) const;
-		bool operator!=(const Matrix&) const;
+		constexpr Matrix& operator*=(const Matrix&);
+		constexpr Matrix& operator+=(const Matrix&);
+		constexpr Matrix& operator-=(const Matrix&);
+		constexpr Matrix& operator*=(float);
+		constexpr Matrix& operator/=(float);
+
+		constexpr Matrix operator-() const;
+
+		constexpr Matrix operator*(const Matrix&) const;
+		constexpr Matrix operator+(const Matrix&) const;
+		constexpr Matrix operator-(const Matrix&) const;
+		constexpr Matrix operator*(float) const;
+		constexpr Matrix operator/(float) const;
+
+		constexpr bool operator==(const Matrix&) const;
+		constexpr bool operator!=(const Matrix&) const;
 	};
-	Matrix operator*(float, const Matrix&);
+	constexpr Matrix operator*(float, const Matrix&);
 
 	// matrix transpose
-	Matrix MatrixTranspose(const Matrix& m);
+	constexpr Matrix MatrixTranspose(const Matrix& m);
+
+	// matrix determinant
+	float MatrixDeterminant(const Matrix& m);
+
+	// inverse of general matrix, elements are inf or nan if m is singular
+	Matrix MatrixInverse(const Matrix& m);
+
+	// inverse of affine matrix whose last column is (0,0,0,1), much cheaper than MatrixInverse
+	Matrix MatrixInverseAffine(const Matrix& m);
+
+	// inverse transpose of upper 3x3 of affine matrix, transforms normals (w = 0) to the space of m
+	Matrix MatrixNormal(const Matrix& m);
+
+	// decompose affine matrix m = S * R * T, R is a rotation, a mirror is put into scale.x
+	void MatrixDecompose(const Matrix& m, Vector& scale, Matrix& rotation, Vector& translation);
 
 	// get matrix of translation
-	Matrix GetMatrixT(float tx, float ty, float tz);
+	constexpr Matrix GetMatrixT(float tx, float ty, float tz);
 
 	// get inverse matrix of translation
-	Matrix GetInverseMatrixT(float tx, float ty, float tz);
+	constexpr Matrix GetInverseMatrixT(float tx, float ty, float tz);
 
 	// get matrix of translation
-	Matrix GetMatrixT(Vector translation);
+	constexpr Matrix GetMatrixT(Vector translation);
 
 	// get inverse matrix of translation
-	Matrix GetInverseMatrixT(Vector translation);
+	constexpr Matrix GetInverseMatrixT(Vector translation);
 
 	// get matrix of rotation
 	Matrix GetMatrixR(Quaternion q);
@@ -141,38 +227,51 @@ namespace Rehenz
 	Matrix GetInverseMatrixR(Vector at, Vector up);
 
 	// get matrix of rotation around x axis
-	Matrix GetMatrixRx(float theta);
+	constexpr Matrix GetMatrixRx(float theta);
 
 	// get matrix of rotation around y axis
-	Matrix GetMatrixRy(float theta);
+	constexpr Matrix GetMatrixRy(float theta);
 
 	// get matrix of rotation around z axis
-	Matrix GetMatrixRz(float theta);
+	constexpr Matrix GetMatrixRz(float theta);
 
 	// get matrix of scale
-	Matrix GetMatrixS(float scaleX, float scaleY, float scaleZ);
+	constexpr Matrix GetMatrixS(float scaleX, float scaleY, float scaleZ);
 
 	// get inverse matrix of scale
-	Matrix GetInverseMatrixS(float scaleX, float scaleY, float scaleZ);
+	constexpr Matrix GetInverseMatrixS(float scaleX, float scaleY, float scaleZ);
 
 	// get matrix of scale
-	Matrix GetMatrixS(float scaleXYZ);
+	constexpr Matrix GetMatrixS(float scaleXYZ);
 
 	// get inverse matrix of scale
-	Matrix GetInverseMatrixS(float scaleXYZ);
+	constexpr Matrix GetInverseMatrixS(float scaleXYZ);
 
 	// get matrix of scale
-	Matrix GetMatrixS(Vector scale);
+	constexpr Matrix GetMatrixS(Vector scale);
 
 	// get inverse matrix of scale
-	Matrix GetInverseMatrixS(Vector scale);
+	constexpr Matrix GetInverseMatrixS(Vector scale);
 
 	// get matrix of perspective, project to Cube(-1,-1,0)(1,1,1)
 	Matrix GetMatrixP(float fovy, float aspect, float z_near, float z_far);
 
+	// get inverse matrix of perspective
+	Matrix GetInverseMatrixP(float fovy, float aspect, float z_near, float z_far);
+
 	// get origin point in perspective space
 	Point GetOriginP(float z_near, float z_far);
 
+	// get matrix of reversed-z perspective, z_near -> 1, z_far -> 0
+	// float z keeps more precision at distance, depth test must be flipped
+	Matrix GetMatrixPReversed(float fovy, float aspect, float z_near, float z_far);
+
+	// get inverse matrix of reversed-z perspective
+	Matrix GetInverseMatrixPReversed(float fovy, float aspect, float z_near, float z_far);
+
+	// get origin point in reversed-z perspective space
+	Point GetOriginPReversed(float z_near, float z_far);
+
 	// get matrix of rotation defined by eular angles
 	Matrix GetMatrixE(float psi, float theta, float phi);
 
@@ -191,6 +290,10 @@ namespace Rehenz
 	// get inverse matrix of rotation defined by aircraft principal axes
 	Matrix GetInverseMatrixA(AircraftAxes aircraft_axes);
 
+	// get aircraft principal axes of rotation matrix, GetMatrixA(GetAircraftAxes(r)) = r
+	// roll is 0 when pitch is +-pi/2
+	AircraftAxes GetAircraftAxes(const Matrix& rotation);
+
 	// 3-component vector with w = 1x4 matrix
 	struct Vector
 	{
@@ -208,46 +311,489 @@ namespace Rehenz
 #pragma warning(default:4201)
 
 		// default w = 0
-		Vector();
-		explicit Vector(float value);
-		explicit Vector(float _x, float _y, float _z, float _w = 0);
+		constexpr Vector();
+		constexpr explicit Vector(float value);
+		constexpr explicit Vector(float _x, float _y, float _z, float _w = 0);
 
 		// access date
-		float& operator()(int index);
-		float operator()(int index) const;
-		Vector& operator=(Vector);
+		constexpr float& operator()(int index);
+		constexpr float operator()(int index) const;
 
 		// some operator
-		Vector& operator*=(const Matrix&);
-		Vector& operator+=(Vector);
-		Vector& operator-=(Vector);
-		Vector& operator*=(float);
-		Vector& operator/=(float);
-
-		Vector operator-() const;
-
-		Vector operator*(const Matrix&) const;
-		Vector operator+(Vector) const;
-		Vector operator-(Vector) const;
-		Vector operator*(float) const;
-		Vector operator/(float) const;
-
-		bool operator==(Vector) const;
-		bool operator!=(Vector) const;
+		constexpr Vector& operator*=(const Matrix&);
+		constexpr Vector& operator+=(Vector);
+		constexpr Vector& operator-=(Vector);
+		constexpr Vector& operator*=(float);
+		constexpr Vector& operator/=(float);
+
+		constexpr Vector operator-() const;
+
+		constexpr Vector operator*(const Matrix&) const;
+		constexpr Vector operator+(Vector) const;
+		constexpr Vector operator-(Vector) const;
+		constexpr Vector operator*(float) const;
+		constexpr Vector operator/(float) const;
+
+		constexpr bool operator==(Vector) const;
+		constexpr bool operator!=(Vector) const;
 	};
-	Vector operator*(float, Vector);
+	constexpr Vector operator*(float, Vector);
 
 	// 3-component point with w = 1x4 matrix
 	struct Point : public Vector
 	{
 	public:
 		// default w = 1
-		Point() : Vector() { w = 1; }
-		Point(Vector v) : Vector(v) {}
-		explicit Point(float value) : Vector(value) {}
-		explicit Point(float _x, float _y, float _z, float _w = 1) : Vector(_x, _y, _z, _w) {}
+		constexpr Point() : Vector(0.0f, 0.0f, 0.0f, 1.0f) {}
+		constexpr Point(Vector v) : Vector(v) {}
+		constexpr explicit Point(float value) : Vector(value) {}
+		constexpr explicit Point(float _x, float _y, float _z, float _w = 1) : Vector(_x, _y, _z, _w) {}
 	};
 
+	// Matrix and Vector are defined inline, so vertex shaders can inline and keep them in registers
+	// in constant evaluation only v of Vector can be accessed, x,y,z,w are not the active member of union
+
+#ifdef REHENZ_SIMD
+	// load from components rather than memory, so a vector just built in registers is not stored and reloaded
+	inline __m128 SimdLoad(const Vector& v)
+	{
+		return _mm_setr_ps(v.v[0], v.v[1], v.v[2], v.v[3]);
+	}
+
+	// v * m, v is a row vector
+	inline __m128 SimdVectorMatrix(__m128 v, const Matrix& m)
+	{
+		__m128 r = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), _mm_loadu_ps(m.m[0]));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), _mm_loadu_ps(m.m[1])));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), _mm_loadu_ps(m.m[2])));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), _mm_loadu_ps(m.m[3])));
+		return r;
+	}
+#endif
+
+	constexpr Matrix::Matrix()
+		: m{ { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } }
+	{
+	}
+
+	constexpr Matrix::Matrix(float value)
+		: m{ { value, value, value, value }, { value, value, value, value }, { value, value, value, value }, { value, value, value, value } }
+	{
+	}
+
+	constexpr Matrix::Matrix(float _00, float _01, float _02, float _03,
+		float _10, float _11, float _12, float _13,
+		float _20, float _21, float _22, float _23,
+		float _30, float _31, float _32, float _33)
+		: m{ { _00, _01, _02, _03 }, { _10, _11, _12, _13 }, { _20, _21, _22, _23 }, { _30, _31, _32, _33 } }
+	{
+	}
+
+	constexpr float& Matrix::operator()(int row, int col)
+	{
+		return m[row][col];
+	}
+
+	constexpr float Matrix::operator()(int row, int col) const
+	{
+		return m[row][col];
+	}
+
+	constexpr Matrix Matrix::operator*(const Matrix& matrix0) const
+	{
+		Matrix result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			for (int i = 0; i < 4; i++)
+				_mm_storeu_ps(result.m[i], SimdVectorMatrix(_mm_loadu_ps(m[i]), matrix0));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				result.m[i][j] = m[i][0] * matrix0.m[0][j] + m[i][1] * matrix0.m[1][j] + m[i][2] * matrix0.m[2][j] + m[i][3] * matrix0.m[3][j];
+		return result;
+	}
+
+	constexpr Matrix Matrix::operator+(const Matrix& matrix0) const
+	{
+		Matrix result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			for (int i = 0; i < 4; i++)
+				_mm_storeu_ps(result.m[i], _mm_add_ps(_mm_loadu_ps(m[i]), _mm_loadu_ps(matrix0.m[i])));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				result.m[i][j] = m[i][j] + matrix0.m[i][j];
+		return result;
+	}
+
+	constexpr Matrix Matrix::operator-(const Matrix& matrix0) const
+	{
+		Matrix result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			for (int i = 0; i < 4; i++)
+				_mm_storeu_ps(result.m[i], _mm_sub_ps(_mm_loadu_ps(m[i]), _mm_loadu_ps(matrix0.m[i])));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				result.m[i][j] = m[i][j] - matrix0.m[i][j];
+		return result;
+	}
+
+	constexpr Matrix Matrix::operator*(float f0) const
+	{
+		Matrix result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			for (int i = 0; i < 4; i++)
+				_mm_storeu_ps(result.m[i], _mm_mul_ps(_mm_loadu_ps(m[i]), _mm_set1_ps(f0)));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				result.m[i][j] = m[i][j] * f0;
+		return result;
+	}
+
+	constexpr Matrix Matrix::operator/(float f0) const
+	{
+		Matrix result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			for (int i = 0; i < 4; i++)
+				_mm_storeu_ps(result.m[i], _mm_div_ps(_mm_loadu_ps(m[i]), _mm_set1_ps(f0)));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				result.m[i][j] = m[i][j] / f0;
+		return result;
+	}
+
+	constexpr Matrix Matrix::operator-() const
+	{
+		Matrix result;
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				result.m[i][j] = -m[i][j];
+		return result;
+	}
+
+	constexpr Matrix& Matrix::operator*=(const Matrix& matrix0)
+	{
+		return (*this) = (*this) * matrix0;
+	}
+
+	constexpr Matrix& Matrix::operator+=(const Matrix& matrix0)
+	{
+		return (*this) = (*this) + matrix0;
+	}
+
+	constexpr Matrix& Matrix::operator-=(const Matrix& matrix0)
+	{
+		return (*this) = (*this) - matrix0;
+	}
+
+	constexpr Matrix& Matrix::operator*=(float f0)
+	{
+		return (*this) = (*this) * f0;
+	}
+
+	constexpr Matrix& Matrix::operator/=(float f0)
+	{
+		return (*this) = (*this) / f0;
+	}
+
+	constexpr bool Matrix::operator==(const Matrix& matrix0) const
+	{
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				if (m[i][j] != matrix0(i, j))
+					return false;
+		return true;
+	}
+
+	constexpr bool Matrix::operator!=(const Matrix& matrix0) const
+	{
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				if (m[i][j] != matrix0(i, j))
+					return true;
+		return false;
+	}
+
+	constexpr Matrix operator*(float f0, const Matrix& matrix0)
+	{
+		return matrix0 * f0;
+	}
+
+	constexpr Vector::Vector() : v{ 0.0f, 0.0f, 0.0f, 0.0f }
+	{
+	}
+
+	constexpr Vector::Vector(float value) : v{ value, value, value, value }
+	{
+	}
+
+	constexpr Vector::Vector(float _x, float _y, float _z, float _w) : v{ _x, _y, _z, _w }
+	{
+	}
+
+	constexpr float& Vector::operator()(int index)
+	{
+		return v[index];
+	}
+
+	constexpr float Vector::operator()(int index) const
+	{
+		return v[index];
+	}
+
+	constexpr Vector Vector::operator*(const Matrix& matrix0) const
+	{
+		Vector result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			_mm_storeu_ps(result.v, SimdVectorMatrix(SimdLoad(*this), matrix0));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			result.v[i] = v[0] * matrix0.m[0][i] + v[1] * matrix0.m[1][i] + v[2] * matrix0.m[2][i] + v[3] * matrix0.m[3][i];
+		return result;
+	}
+
+	constexpr Vector Vector::operator+(Vector vector0) const
+	{
+		Vector result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			_mm_storeu_ps(result.v, _mm_add_ps(SimdLoad(*this), SimdLoad(vector0)));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			result.v[i] = v[i] + vector0.v[i];
+		return result;
+	}
+
+	constexpr Vector Vector::operator-(Vector vector0) const
+	{
+		Vector result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			_mm_storeu_ps(result.v, _mm_sub_ps(SimdLoad(*this), SimdLoad(vector0)));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			result.v[i] = v[i] - vector0.v[i];
+		return result;
+	}
+
+	constexpr Vector Vector::operator*(float f0) const
+	{
+		Vector result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			_mm_storeu_ps(result.v, _mm_mul_ps(SimdLoad(*this), _mm_set1_ps(f0)));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			result.v[i] = v[i] * f0;
+		return result;
+	}
+
+	constexpr Vector Vector::operator/(float f0) const
+	{
+		Vector result;
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			_mm_storeu_ps(result.v, _mm_div_ps(SimdLoad(*this), _mm_set1_ps(f0)));
+			return result;
+		}
+#endif
+		for (int i = 0; i < 4; i++)
+			result.v[i] = v[i] / f0;
+		return result;
+	}
+
+	constexpr Vector Vector::operator-() const
+	{
+		return Vector(-v[0], -v[1], -v[2], -v[3]);
+	}
+
+	constexpr Vector& Vector::operator*=(const Matrix& matrix0)
+	{
+		return (*this) = (*this) * matrix0;
+	}
+
+	constexpr Vector& Vector::operator+=(Vector vector0)
+	{
+		return (*this) = (*this) + vector0;
+	}
+
+	constexpr Vector& Vector::operator-=(Vector vector0)
+	{
+		return (*this) = (*this) - vector0;
+	}
+
+	constexpr Vector& Vector::operator*=(float f0)
+	{
+		return (*this) = (*this) * f0;
+	}
+
+	constexpr Vector& Vector::operator/=(float f0)
+	{
+		return (*this) = (*this) / f0;
+	}
+
+	constexpr bool Vector::operator==(Vector vector0) const
+	{
+		for (int i = 0; i < 4; i++)
+			if (v[i] != vector0(i))
+				return false;
+		return true;
+	}
+
+	constexpr bool Vector::operator!=(Vector vector0) const
+	{
+		for (int i = 0; i < 4; i++)
+			if (v[i] != vector0(i))
+				return true;
+		return false;
+	}
+
+	constexpr Vector operator*(float f0, Vector vector0)
+	{
+		return vector0 * f0;
+	}
+
+	constexpr Matrix MatrixTranspose(const Matrix& m)
+	{
+		Matrix result;
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				result(i, j) = m(j, i);
+		return result;
+	}
+
+	constexpr Matrix GetMatrixT(float tx, float ty, float tz)
+	{
+		Matrix result;
+		result(3, 0) = tx;
+		result(3, 1) = ty;
+		result(3, 2) = tz;
+		return result;
+	}
+
+	constexpr Matrix GetInverseMatrixT(float tx, float ty, float tz)
+	{
+		Matrix result;
+		result(3, 0) = -tx;
+		result(3, 1) = -ty;
+		result(3, 2) = -tz;
+		return result;
+	}
+
+	constexpr Matrix GetMatrixT(Vector translation)
+	{
+		return GetMatrixT(translation(0), translation(1), translation(2));
+	}
+
+	constexpr Matrix GetInverseMatrixT(Vector translation)
+	{
+		return GetInverseMatrixT(translation(0), translation(1), translation(2));
+	}
+
+	constexpr Matrix GetMatrixRx(float theta)
+	{
+		Matrix result;
+		result(1, 1) = REHENZ_CONSTANT_EVALUATED() ? ConstCos(theta) : cosf(theta);
+		result(1, 2) = REHENZ_CONSTANT_EVALUATED() ? ConstSin(theta) : sinf(theta);
+		result(2, 1) = -result(1, 2);
+		result(2, 2) = result(1, 1);
+		return result;
+	}
+
+	constexpr Matrix GetMatrixRy(float theta)
+	{
+		Matrix result;
+		result(0, 0) = REHENZ_CONSTANT_EVALUATED() ? ConstCos(theta) : cosf(theta);
+		result(2, 0) = REHENZ_CONSTANT_EVALUATED() ? ConstSin(theta) : sinf(theta);
+		result(0, 2) = -result(2, 0);
+		result(2, 2) = result(0, 0);
+		return result;
+	}
+
+	constexpr Matrix GetMatrixRz(float theta)
+	{
+		Matrix result;
+		result(0, 0) = REHENZ_CONSTANT_EVALUATED() ? ConstCos(theta) : cosf(theta);
+		result(0, 1) = REHENZ_CONSTANT_EVALUATED() ? ConstSin(theta) : sinf(theta);
+		result(1, 0) = -result(0, 1);
+		result(1, 1) = result(0, 0);
+		return result;
+	}
+
+	constexpr Matrix GetMatrixS(float scaleX, float scaleY, float scaleZ)
+	{
+		Matrix result;
+		result(0, 0) = scaleX;
+		result(1, 1) = scaleY;
+		result(2, 2) = scaleZ;
+		return result;
+	}
+
+	constexpr Matrix GetInverseMatrixS(float scaleX, float scaleY, float scaleZ)
+	{
+		Matrix result;
+		result(0, 0) = 1 / scaleX;
+		result(1, 1) = 1 / scaleY;
+		result(2, 2) = 1 / scaleZ;
+		return result;
+	}
+
+	constexpr Matrix GetMatrixS(float scaleXYZ)
+	{
+		return GetMatrixS(scaleXYZ, scaleXYZ, scaleXYZ);
+	}
+
+	constexpr Matrix GetInverseMatrixS(float scaleXYZ)
+	{
+		return GetInverseMatrixS(scaleXYZ, scaleXYZ, scaleXYZ);
+	}
+
+	constexpr Matrix GetMatrixS(Vector scale)
+	{
+		return GetMatrixS(scale(0), scale(1), scale(2));
+	}
+
+	constexpr Matrix GetInverseMatrixS(Vector scale)
+	{
+		return GetInverseMatrixS(scale(0), scale(1), scale(2));
+	}
+
 	// quaternion = a + bi + cj + dk
 	struct Quaternion
 	{
@@ -328,9 +874,9 @@ namespace Rehenz
 		float x;
 		float y;
 
-		Vector2();
-		Vector2(const Vector& v);
-		explicit Vector2(float _x, float _y);
+		constexpr Vector2() : x(0), y(0) {}
+		constexpr Vector2(const Vector& v) : x(v(0)), y(v(1)) {}
+		constexpr explicit Vector2(float _x, float _y) : x(_x), y(_y) {}
 
 		// some operator
 		Vector2& operator+=(Vector2);
@@ -361,9 +907,9 @@ namespace Rehenz
 		float y;
 		float z;
 
-		Vector3();
-		Vector3(const Vector& v);
-		explicit Vector3(float _x, float _y, float _z);
+		constexpr Vector3() : x(0), y(0), z(0) {}
+		constexpr Vector3(const Vector& v) : x(v(0)), y(v(1)), z(v(2)) {}
+		constexpr explicit Vector3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
 
 		// some operator
 		Vector3& operator+=(Vector3);
@@ -388,7 +934,11 @@ namespace Rehenz
 
 
 	// compute vector length
-	float VectorLength(Vector v1);
+	constexpr float VectorLength(Vector v1)
+	{
+		float s = v1(0) * v1(0) + v1(1) * v1(1) + v1(2) * v1(2) + v1(3) * v1(3);
+		return REHENZ_CONSTANT_EVALUATED() ? ConstSqrt(s) : sqrtf(s);
+	}
 
 	// compute vector length
 	float VectorLength(Vector2 v);
@@ -397,7 +947,21 @@ namespace Rehenz
 	float VectorLength(Vector3 v);
 
 	// vector dot
-	float VectorDot(Vector v1, Vector v2);
+	constexpr float VectorDot(Vector v1, Vector v2)
+	{
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			// x + y + z + w from left to right
+			__m128 p = _mm_mul_ps(SimdLoad(v1), SimdLoad(v2));
+			__m128 s = _mm_add_ss(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)));
+			s = _mm_add_ss(s, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)));
+			s = _mm_add_ss(s, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)));
+			return _mm_cvtss_f32(s);
+		}
+#endif
+		return v1(0) * v2(0) + v1(1) * v2(1) + v1(2) * v2(2) + v1(3) * v2(3);
+	}
 
 	// vector dot
 	float VectorDot(Vector2 v1, Vector2 v2);
@@ -406,22 +970,50 @@ namespace Rehenz
 	float VectorDot(Vector3 v1, Vector3 v2);
 
 	// vector cross (ignore w)
-	Vector VectorCross(Vector v1, Vector v2);
+	constexpr Vector VectorCross(Vector v1, Vector v2)
+	{
+#ifdef REHENZ_SIMD
+		if (!REHENZ_CONSTANT_EVALUATED())
+		{
+			Vector result;
+			__m128 a = SimdLoad(v1), b = SimdLoad(v2);
+			__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+			_mm_storeu_ps(result.v, _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+			result.w = 0.0f;
+			return result;
+		}
+#endif
+		return Vector(v1(1) * v2(2) - v1(2) * v2(1), v1(2) * v2(0) - v1(0) * v2(2), v1(0) * v2(1) - v1(1) * v2(0), 0.0f);
+	}
 
 	// vector cross
 	Vector3 VectorCross(Vector3 v1, Vector3 v2);
 
 	// vector lerp
-	Vector VectorLerp(Vector v1, Vector v2, float t);
+	constexpr Vector VectorLerp(Vector v1, Vector v2, float t)
+	{
+		return v1 + (v2 - v1) * t;
+	}
 
 	// vector normalize
-	Vector VectorNormalize(Vector v1);
+	constexpr Vector VectorNormalize(Vector v1)
+	{
+		float length = VectorLength(v1);
+		if (length == 0)
+			return v1;
+
+		return v1 / length;
+	}
 
 	// vector normalize
 	Vector3 VectorNormalize(Vector3 v);
 
 	// point lerp
-	Point PointLerp(Point p1, Point p2, float t);
+	constexpr Point PointLerp(Point p1, Point p2, float t)
+	{
+		return p1 + (p2 - p1) * t;
+	}
 
 	// point standardize
 	//Point PointStandard(Point p1, float w = 1);
@@ -436,7 +1028,45 @@ namespace Rehenz
 	float PointDistance(Point3 p1, Point3 p2);
 
 	// compute triangles normal vector (not auto standardize)
-	Vector TrianglesNormal(Point p1, Point p2, Point p3);
+	constexpr Vector TrianglesNormal(Point p1, Point p2, Point p3)
+	{
+		return VectorCross(p2 - p1, p3 - p1);
+	}
+
+	// batch transforms, out[i] = in[i] * m for i in [0,count)
+	// use avx2 and fma if cpu supports them, then results may differ from Vector * Matrix in last bits
+	// Vector3 input is a point with w = 1, out may be same as in for Point input
+
+	// transform points
+	void TransformPoints(const Matrix& m, const Point* in, Point* out, int count);
+
+	// transform points
+	void TransformPoints(const Matrix& m, const Vector3* in, Point* out, int count);
+
+	// transform points to struct of arrays, out_w can be nullptr
+	void TransformPoints(const Matrix& m, const Point* in, float* out_x, float* out_y, float* out_z, float* out_w, int count);
+
+	// transform points to struct of arrays, out_w can be nullptr
+	void TransformPoints(const Matrix& m, const Vector3* in, float* out_x, float* out_y, float* out_z, float* out_w, int count);
+
+	// transform vectors, w = 0
+	void TransformVectors(const Matrix& m, const Vector3* in, Vector* out, int count);
+
+	// transform points, then divide x,y,z by w, and w of out is 1/w
+	void TransformPointsProject(const Matrix& m, const Point* in, Point* out, int count);
+
+	// transform points, then divide x,y,z by w, and w of out is 1/w
+	void TransformPointsProject(const Matrix& m, const Vector3* in, Point* out, int count);
+
+	// transform points to clip space, and compute outcodes of Cohen-Sutherland clipper
+	//   1 : x < -w, 2 : x > w, 4 : y < -w, 8 : y > w, 16 : z < 0, 32 : z > w
+	void TransformPointsClip(const Matrix& m, const Point* in, Point* out, unsigned char* outcodes, int count);
+
+	// transform points to clip space, and compute outcodes of Cohen-Sutherland clipper
+	void TransformPointsClip(const Matrix& m, const Vector3* in, Point* out, unsigned char* outcodes, int count);
+
+	// true if batch transforms use avx2 and fma
+	bool TransformUseAvx2();
 
 	// quaternion conjugate
 	Quaternion QuaternionConjugate(Quaternion q);
@@ -1,7 +1,10 @@
 #include "mesh.h"
 #include "util.h"
-#include <fstream>
-#include <sstream>
+#include "fast_math.h"
+#include "obj_file.h"
+#include "mesh_file.h"
+#include "mapped_file.h"
+#include <algorithm>
 
 namespace Rehenz
 {
@@ -9,6 +12,7 @@ namespace Rehenz
 	{
 		Vertex v(v0);
 		v.p = v.p * data.transform;
+		v.uv = Vector(v.uv.x, v.uv.y, 0, 1) * data.mat_uv;
 		return v;
 	};
 
@@ -21,11 +25,42 @@ namespace Rehenz
 	PixelShader TexturePixelShader = [](const PixelShaderData& data, const Vertex& v0)->Color
 	{
 		if (data.texture != nullptr)
+		{
+			if (data.sampler != nullptr)
+				return data.texture->GetColor(v0.uv, *data.sampler);
 			return data.texture->GetColor(v0.uv);
+		}
 		else
 			return v0.c;
 	};
 
+	PixelShaderPacket DefaultPixelShaderPacket = [](const PixelShaderData& data, const PixelPacket& pp, ColorPacket& cp)
+	{
+		(data); // unreferenced
+		for (int i = 0; i < PixelPacket::size; i++)
+		{
+			cp.r[i] = pp.r[i];
+			cp.g[i] = pp.g[i];
+			cp.b[i] = pp.b[i];
+			cp.a[i] = pp.a[i];
+		}
+	};
+
+	PixelShaderPacket TexturePixelShaderPacket = [](const PixelShaderData& data, const PixelPacket& pp, ColorPacket& cp)
+	{
+		if (data.texture == nullptr)
+		{
+			DefaultPixelShaderPacket(data, pp, cp);
+			return;
+		}
+		const Sampler& sampler = (data.sampler != nullptr) ? *data.sampler : data.texture->sampler;
+		for (int i = 0; i < PixelPacket::size; i++)
+		{
+			if (pp.mask & (1 << i))
+				cp.SetColor(i, data.texture->GetColor(pp.u[i], pp.v[i], sampler));
+		}
+	};
+
 	Vertex::Vertex() : p(0, 0, 0), n(0, 0, 0), c(1, 1, 1), uv(0, 0), uv2(0, 0), coef(1)
 	{
 	}
@@ -104,25 +139,96 @@ namespace Rehenz
 
 
 
-	Mesh::Mesh() : vertices(), triangles()
+	Mesh::Mesh() : layout(MeshLayout::AoS), vertices(), stream_bits(MeshStreams::all), triangles(), bounds_valid(false)
 	{
 	}
-	Mesh::Mesh(const std::vector<Vertex>& _vertices, const std::vector<int>& _triangles) : vertices(_vertices), triangles(_triangles)
+	Mesh::Mesh(const std::vector<Vertex>& _vertices, const std::vector<int>& _triangles)
+		: layout(MeshLayout::AoS), vertices(_vertices), stream_bits(MeshStreams::all), triangles(_triangles), bounds_valid(false)
 	{
 	}
-	Mesh::Mesh(const std::vector<Vertex>&& _vertices, const std::vector<int>&& _triangles) : vertices(_vertices), triangles(_triangles)
+	Mesh::Mesh(std::vector<Vertex>&& _vertices, std::vector<int>&& _triangles)
+		: layout(MeshLayout::AoS), vertices(std::move(_vertices)), stream_bits(MeshStreams::all), triangles(std::move(_triangles)), bounds_valid(false)
 	{
 	}
 	Mesh::~Mesh()
 	{
 	}
+	Vertex Mesh::GetVertex(size_t i)
+	{
+		if (layout == MeshLayout::AoS)
+			return vertices[i];
+		Vertex v(Point(positions[i].x, positions[i].y, positions[i].z));
+		if (stream_bits & MeshStreams::normal)
+			v.n = Vector(normals[i].x, normals[i].y, normals[i].z);
+		if (stream_bits & MeshStreams::color)
+			v.c = colors[i];
+		if (stream_bits & MeshStreams::uv)
+			v.uv = uvs[i];
+		if (stream_bits & MeshStreams::uv2)
+			v.uv2 = uv2s[i];
+		return v;
+	}
+	MeshStreamView Mesh::GetStreamView(uint stream)
+	{
+		MeshStreamView view;
+		view.data = nullptr;
+		view.stride = 0;
+		if (layout == MeshLayout::AoS)
+		{
+			if (vertices.empty())
+				return view;
+			const Vertex& v = vertices[0];
+			view.stride = sizeof(Vertex) / sizeof(float);
+			switch (stream)
+			{
+			case MeshStreams::position: view.data = &v.p.x; break;
+			case MeshStreams::normal: view.data = &v.n.x; break;
+			case MeshStreams::color: view.data = &v.c.x; break;
+			case MeshStreams::uv: view.data = &v.uv.x; break;
+			case MeshStreams::uv2: view.data = &v.uv2.x; break;
+			}
+			return view;
+		}
+		if (!(stream & stream_bits) || positions.empty())
+			return view;
+		switch (stream)
+		{
+		case MeshStreams::position: view.data = &positions[0].x; view.stride = 3; break;
+		case MeshStreams::normal: view.data = &normals[0].x; view.stride = 3; break;
+		case MeshStreams::color: view.data = &colors[0].x; view.stride = 4; break;
+		case MeshStreams::uv: view.data = &uvs[0].x; view.stride = 2; break;
+		case MeshStreams::uv2: view.data = &uv2s[0].x; view.stride = 2; break;
+		}
+		return view;
+	}
 	void Mesh::AddVertex(Vertex vertex)
 	{
-		vertices.push_back(vertex);
+		bounds_valid = false;
+		if (layout == MeshLayout::AoS)
+		{
+			vertices.push_back(vertex);
+			return;
+		}
+		positions.push_back(Vector3(vertex.p));
+		if (stream_bits & MeshStreams::normal)
+			normals.push_back(Vector3(vertex.n));
+		if (stream_bits & MeshStreams::color)
+			colors.push_back(vertex.c);
+		if (stream_bits & MeshStreams::uv)
+			uvs.push_back(vertex.uv);
+		if (stream_bits & MeshStreams::uv2)
+			uv2s.push_back(vertex.uv2);
 	}
 	void Mesh::AddVertex(const std::vector<Vertex>& _vertices)
 	{
-		vertices.insert(vertices.end(), _vertices.begin(), _vertices.end());
+		bounds_valid = false;
+		if (layout == MeshLayout::AoS)
+		{
+			vertices.insert(vertices.end(), _vertices.begin(), _vertices.end());
+			return;
+		}
+		for (auto& v : _vertices)
+			AddVertex(v);
 	}
 	void Mesh::AddTriangle(int a, int b, int c)
 	{
@@ -134,9 +240,604 @@ namespace Rehenz
 	{
 		triangles.insert(triangles.end(), _triangles.begin(), _triangles.end());
 	}
+	uint Mesh::GetUsedStreams()
+	{
+		if (layout == MeshLayout::SoA)
+			return stream_bits;
+		// streams that are not all default
+		uint streams = MeshStreams::position;
+		const Vertex def;
+		for (auto& v : vertices)
+		{
+			if (v.n != def.n)
+				streams |= MeshStreams::normal;
+			if (v.c != def.c)
+				streams |= MeshStreams::color;
+			if (v.uv.x != 0 || v.uv.y != 0)
+				streams |= MeshStreams::uv;
+			if (v.uv2.x != 0 || v.uv2.y != 0)
+				streams |= MeshStreams::uv2;
+		}
+		return streams;
+	}
+	void Mesh::GetBounds(Point& pmin, Point& pmax)
+	{
+		if (!bounds_valid)
+		{
+			MeshStreamView pos = GetStreamView(MeshStreams::position);
+			size_t n = VertexCount();
+			bounds_min = bounds_max = Point();
+			for (size_t i = 0; i < n; i++)
+			{
+				const float* p = pos[i];
+				if (i == 0)
+					bounds_min = bounds_max = Point(p[0], p[1], p[2]);
+				bounds_min = Point(Min(bounds_min.x, p[0]), Min(bounds_min.y, p[1]), Min(bounds_min.z, p[2]));
+				bounds_max = Point(Max(bounds_max.x, p[0]), Max(bounds_max.y, p[1]), Max(bounds_max.z, p[2]));
+			}
+			bounds_valid = true;
+		}
+		pmin = bounds_min;
+		pmax = bounds_max;
+	}
+	void Mesh::SetBounds(Point pmin, Point pmax)
+	{
+		bounds_min = pmin;
+		bounds_max = pmax;
+		bounds_valid = true;
+	}
+	void Mesh::SetStreams(size_t count, const float* position, const float* normal, const float* color, const float* uv, const float* uv2)
+	{
+		static_assert(sizeof(Vector3) == 3 * sizeof(float) && sizeof(Color) == 4 * sizeof(float) && sizeof(UV) == 2 * sizeof(float), "stream element size");
+		std::vector<Vertex>().swap(vertices);
+		layout = MeshLayout::SoA;
+		stream_bits = MeshStreams::position | (normal ? MeshStreams::normal : 0) | (color ? MeshStreams::color : 0)
+			| (uv ? MeshStreams::uv : 0) | (uv2 ? MeshStreams::uv2 : 0);
+		positions.resize(count);
+		normals.resize(normal ? count : 0);
+		colors.resize(color ? count : 0);
+		uvs.resize(uv ? count : 0);
+		uv2s.resize(uv2 ? count : 0);
+		if (count > 0)
+		{
+			std::copy(position, position + count * 3, &positions[0].x);
+			if (normal)
+				std::copy(normal, normal + count * 3, &normals[0].x);
+			if (color)
+				std::copy(color, color + count * 4, &colors[0].x);
+			if (uv)
+				std::copy(uv, uv + count * 2, &uvs[0].x);
+			if (uv2)
+				std::copy(uv2, uv2 + count * 2, &uv2s[0].x);
+		}
+		bounds_valid = false;
+	}
+	void Mesh::SetStreams(std::vector<Vector3>&& position, std::vector<Vector3>&& normal, std::vector<Color>&& color, std::vector<UV>&& uv, std::vector<UV>&& uv2)
+	{
+		std::vector<Vertex>().swap(vertices);
+		layout = MeshLayout::SoA;
+		size_t count = position.size();
+		stream_bits = MeshStreams::position | (normal.size() == count && count > 0 ? MeshStreams::normal : 0)
+			| (color.size() == count && count > 0 ? MeshStreams::color : 0) | (uv.size() == count && count > 0 ? MeshStreams::uv : 0)
+			| (uv2.size() == count && count > 0 ? MeshStreams::uv2 : 0);
+		positions = std::move(position);
+		normals = (stream_bits & MeshStreams::normal) ? std::move(normal) : std::vector<Vector3>();
+		colors = (stream_bits & MeshStreams::color) ? std::move(color) : std::vector<Color>();
+		uvs = (stream_bits & MeshStreams::uv) ? std::move(uv) : std::vector<UV>();
+		uv2s = (stream_bits & MeshStreams::uv2) ? std::move(uv2) : std::vector<UV>();
+		bounds_valid = false;
+	}
+	void Mesh::SetTriangles(const int* indices, size_t count)
+	{
+		triangles.assign(indices, indices + count);
+	}
+	void Mesh::SetTriangles(std::vector<int>&& indices)
+	{
+		triangles = std::move(indices);
+	}
+	void Mesh::ConvertLayout(MeshLayout _layout)
+	{
+		if (_layout == layout)
+			return;
+		if (_layout == MeshLayout::SoA)
+		{
+			ConvertToSoA(GetUsedStreams());
+			return;
+		}
+		std::vector<Vertex> _vertices(positions.size());
+		for (size_t i = 0; i < _vertices.size(); i++)
+			_vertices[i] = GetVertex(i);
+		layout = MeshLayout::AoS;
+		stream_bits = MeshStreams::all;
+		vertices.swap(_vertices);
+		std::vector<Vector3>().swap(positions);
+		std::vector<Vector3>().swap(normals);
+		std::vector<Color>().swap(colors);
+		std::vector<UV>().swap(uvs);
+		std::vector<UV>().swap(uv2s);
+	}
+	void Mesh::ConvertToSoA(uint streams)
+	{
+		ConvertLayout(MeshLayout::AoS);
+		stream_bits = (streams & MeshStreams::all) | MeshStreams::position;
+		layout = MeshLayout::SoA;
+		positions.reserve(vertices.size());
+		if (stream_bits & MeshStreams::normal)
+			normals.reserve(vertices.size());
+		if (stream_bits & MeshStreams::color)
+			colors.reserve(vertices.size());
+		if (stream_bits & MeshStreams::uv)
+			uvs.reserve(vertices.size());
+		if (stream_bits & MeshStreams::uv2)
+			uv2s.reserve(vertices.size());
+		std::vector<Vertex> _vertices;
+		_vertices.swap(vertices);
+		AddVertex(_vertices);
+	}
+	namespace
+	{
+		inline bool VectorNear(const Vector& a, const Vector& b, float epsilon)
+		{
+			return fabsf(a.x - b.x) <= epsilon && fabsf(a.y - b.y) <= epsilon && fabsf(a.z - b.z) <= epsilon && fabsf(a.w - b.w) <= epsilon;
+		}
+
+		inline bool VertexNear(const Vertex& a, const Vertex& b, float epsilon)
+		{
+			return VectorNear(a.p, b.p, epsilon) && VectorNear(a.n, b.n, epsilon) && VectorNear(a.c, b.c, epsilon)
+				&& fabsf(a.uv.x - b.uv.x) <= epsilon && fabsf(a.uv.y - b.uv.y) <= epsilon
+				&& fabsf(a.uv2.x - b.uv2.x) <= epsilon && fabsf(a.uv2.y - b.uv2.y) <= epsilon
+				&& fabsf(a.coef - b.coef) <= epsilon;
+		}
+
+		inline uint CellHash(int x, int y, int z)
+		{
+			return static_cast<uint>(x) * 73856093u ^ static_cast<uint>(y) * 19349663u ^ static_cast<uint>(z) * 83492791u;
+		}
+	}
+	size_t Mesh::Weld(float epsilon)
+	{
+		MeshLayout old_layout = layout;
+		uint old_streams = stream_bits;
+		ConvertLayout(MeshLayout::AoS);
+		size_t n = vertices.size();
+		if (n == 0)
+			return 0;
+		epsilon = Max(epsilon, 0.0f);
+
+		// spatial hash of positions, cell is not smaller than epsilon so close vertices are in adjacent cells
+		// cell size also keeps about one vertex per cell in a uniform mesh
+		Vector pmin = vertices[0].p, pmax = vertices[0].p;
+		for (auto& v : vertices)
+		{
+			pmin = Vector(Min(pmin.x, v.p.x), Min(pmin.y, v.p.y), Min(pmin.z, v.p.z), 0);
+			pmax = Vector(Max(pmax.x, v.p.x), Max(pmax.y, v.p.y), Max(pmax.z, v.p.z), 0);
+		}
+		float extent = Max(pmax.x - pmin.x, Max(pmax.y - pmin.y, pmax.z - pmin.z));
+		float cell = Max(Max(epsilon, extent / cbrtf(static_cast<float>(n))), 1e-20f);
+		int radius = (epsilon > 0) ? 1 : 0;
+		uint mask = 1;
+		while (mask < n)
+			mask <<= 1;
+		mask--;
+
+		// bucket vertices by hash of cell, each bucket lists vertices in ascending order
+		std::vector<int> cell_x(n), cell_y(n), cell_z(n);
+		std::vector<int> bucket_start(mask + 2, 0), bucket_items(n);
+		ParallelFor(n, 4096, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					cell_x[i] = static_cast<int>(floorf((vertices[i].p.x - pmin.x) / cell));
+					cell_y[i] = static_cast<int>(floorf((vertices[i].p.y - pmin.y) / cell));
+					cell_z[i] = static_cast<int>(floorf((vertices[i].p.z - pmin.z) / cell));
+				}
+			});
+		for (size_t i = 0; i < n; i++)
+			bucket_start[(CellHash(cell_x[i], cell_y[i], cell_z[i]) & mask) + 1]++;
+		for (uint b = 0; b <= mask; b++)
+			bucket_start[b + 1] += bucket_start[b];
+		{
+			std::vector<int> fill(bucket_start.begin(), bucket_start.end() - 1);
+			for (size_t i = 0; i < n; i++)
+				bucket_items[fill[CellHash(cell_x[i], cell_y[i], cell_z[i]) & mask]++] = static_cast<int>(i);
+		}
+
+		// each vertex finds the first earlier vertex close to it in neighbor cells
+		std::vector<int> remap(n);
+		ParallelFor(n, 4096, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					// skip neighbor cells farther than epsilon
+					int lo[3], hi[3];
+					const float offset[3]{ vertices[i].p.x - pmin.x, vertices[i].p.y - pmin.y, vertices[i].p.z - pmin.z };
+					const int cell_i[3]{ cell_x[i], cell_y[i], cell_z[i] };
+					for (int axis = 0; axis < 3; axis++)
+					{
+						float f = offset[axis] - cell_i[axis] * cell;
+						lo[axis] = (f <= epsilon) ? -radius : 0;
+						hi[axis] = (f >= cell - epsilon) ? radius : 0;
+					}
+					int found = static_cast<int>(i);
+					for (int dz = lo[2]; dz <= hi[2]; dz++)
+						for (int dy = lo[1]; dy <= hi[1]; dy++)
+							for (int dx = lo[0]; dx <= hi[0]; dx++)
+							{
+								uint b = CellHash(cell_x[i] + dx, cell_y[i] + dy, cell_z[i] + dz) & mask;
+								for (int k = bucket_start[b]; k < bucket_start[b + 1] && bucket_items[k] < found; k++)
+								{
+									if (VertexNear(vertices[i], vertices[bucket_items[k]], epsilon))
+									{
+										found = bucket_items[k];
+										break;
+									}
+								}
+							}
+					remap[i] = found;
+				}
+			});
+
+		// follow merges to the kept vertex, then compact vertices
+		size_t kept = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (remap[i] == static_cast<int>(i))
+			{
+				vertices[kept] = vertices[i];
+				remap[i] = static_cast<int>(kept++);
+			}
+			else
+				remap[i] = remap[remap[i]];
+		}
+		vertices.resize(kept);
+		bounds_valid = false;
+
+		// remap triangles and remove degenerate ones
+		size_t tri_end = 0;
+		for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+		{
+			int a = remap[triangles[i]], b = remap[triangles[i + 1]], c = remap[triangles[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			triangles[tri_end++] = a;
+			triangles[tri_end++] = b;
+			triangles[tri_end++] = c;
+		}
+		triangles.resize(tri_end);
+
+		if (old_layout == MeshLayout::SoA)
+			ConvertToSoA(old_streams);
+		return n - kept;
+	}
+	namespace
+	{
+		// Forsyth's vertex score, by position in LRU cache (-1 if not cached) and count of triangles not drawn yet
+		// vertices of the last triangle get a fixed score, so the next triangle does not simply reuse the same edge
+		inline float ForsythVertexScore(int cache_position, int remaining, int cache_size)
+		{
+			if (remaining == 0)
+				return -1;
+			float score = 0;
+			if (cache_position >= 0)
+				score = (cache_position < 3) ? 0.75f : powf(1 - (cache_position - 3) / static_cast<float>(cache_size - 3), 1.5f);
+			return score + 2 / sqrtf(static_cast<float>(remaining));
+		}
+
+		// FIFO cache like post-transform caches of GPUs, a vertex is cached if it missed within last size misses
+		class FifoCacheSim
+		{
+		private:
+			std::vector<uint> stamps;
+			uint time;
+			uint size;
+
+		public:
+			FifoCacheSim(size_t vertex_count, int _size) : stamps(vertex_count, 0), time(_size + 1), size(_size) {}
+
+			inline int Misses(int a, int b, int c)
+			{
+				int misses = 0;
+				for (int v : { a, b, c })
+				{
+					if (time - stamps[v] > size)
+					{
+						stamps[v] = time++;
+						misses++;
+					}
+				}
+				return misses;
+			}
+			inline void Reset()
+			{
+				time += size + 1;
+			}
+		};
+
+		template <typename T>
+		void PermuteStream(std::vector<T>& stream, const std::vector<int>& order)
+		{
+			if (stream.empty())
+				return;
+			std::vector<T> result(order.size());
+			for (size_t i = 0; i < order.size(); i++)
+				result[i] = stream[order[i]];
+			stream.swap(result);
+		}
+	}
+	void Mesh::OptimizeVertexCache(int cache_size)
+	{
+		size_t tri_count = triangles.size() / 3, n = VertexCount();
+		if (tri_count == 0)
+			return;
+		cache_size = Clamp(cache_size, 4, 64);
 
+		// triangles of each vertex, the first remaining[v] of them are not drawn yet
+		std::vector<int> adjacency_start(n + 1, 0), adjacency(tri_count * 3), remaining(n, 0);
+		for (size_t i = 0; i < tri_count * 3; i++)
+			adjacency_start[triangles[i] + 1]++;
+		for (size_t v = 0; v < n; v++)
+			adjacency_start[v + 1] += adjacency_start[v];
+		for (size_t i = 0; i < tri_count * 3; i++)
+		{
+			int v = triangles[i];
+			adjacency[adjacency_start[v] + remaining[v]++] = static_cast<int>(i / 3);
+		}
+		std::vector<int> cache_position(n, -1);
+		std::vector<float> score(n);
+		for (size_t v = 0; v < n; v++)
+			score[v] = ForsythVertexScore(-1, remaining[v], cache_size);
 
+		// draw the best triangle touching the cache, or the next one in old order at a dead end
+		std::vector<uchar> drawn(tri_count, 0);
+		std::vector<int> cache, new_cache, result;
+		cache.reserve(cache_size + 3);
+		new_cache.reserve(cache_size + 3);
+		result.reserve(tri_count * 3);
+		int best = -1;
+		size_t cursor = 0;
+		for (size_t k = 0; k < tri_count; k++)
+		{
+			if (best < 0)
+			{
+				while (drawn[cursor])
+					cursor++;
+				best = static_cast<int>(cursor);
+			}
+			drawn[best] = 1;
+			const int* tri = &triangles[best * 3];
+			result.insert(result.end(), tri, tri + 3);
+			for (int c = 0; c < 3; c++)
+			{
+				int v = tri[c];
+				int* list = &adjacency[adjacency_start[v]];
+				int* found = std::find(list, list + remaining[v], best);
+				std::swap(*found, list[--remaining[v]]);
+			}
 
+			// vertices of drawn triangle move to front of cache, the last ones fall out
+			new_cache.assign(tri, tri + 3);
+			for (int v : cache)
+			{
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+					new_cache.push_back(v);
+			}
+			for (size_t i = 0; i < new_cache.size(); i++)
+			{
+				int v = new_cache[i];
+				cache_position[v] = (i < static_cast<size_t>(cache_size)) ? static_cast<int>(i) : -1;
+				score[v] = ForsythVertexScore(cache_position[v], remaining[v], cache_size);
+			}
+			cache.assign(new_cache.begin(), new_cache.begin() + Min(new_cache.size(), static_cast<size_t>(cache_size)));
+
+			best = -1;
+			float best_score = -1;
+			for (int v : cache)
+			{
+				for (int i = adjacency_start[v]; i < adjacency_start[v] + remaining[v]; i++)
+				{
+					int t = adjacency[i];
+					float s = score[triangles[t * 3]] + score[triangles[t * 3 + 1]] + score[triangles[t * 3 + 2]];
+					if (s > best_score)
+					{
+						best = t;
+						best_score = s;
+					}
+				}
+			}
+		}
+		// keep old order if it was better already, like rows of generated meshes
+		MeshCacheStats old_stats = GetCacheStats();
+		triangles.swap(result);
+		if (GetCacheStats().acmr > old_stats.acmr)
+			triangles.swap(result);
+	}
+	void Mesh::OptimizeOverdraw(float threshold)
+	{
+		size_t tri_count = triangles.size() / 3, n = VertexCount();
+		if (tri_count == 0)
+			return;
+		const int cache_size = 16;
+
+		// hard boundaries where a triangle misses all its vertices, the cache was flushed there anyway
+		std::vector<size_t> clusters;
+		{
+			FifoCacheSim cache(n, cache_size);
+			clusters.push_back(0);
+			cache.Misses(triangles[0], triangles[1], triangles[2]);
+			for (size_t t = 1; t < tri_count; t++)
+			{
+				if (cache.Misses(triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2]) == 3)
+					clusters.push_back(t);
+			}
+		}
+		// soft boundaries in each cluster, where ACMR from cluster start is within threshold of the whole cluster
+		std::vector<size_t> soft_clusters;
+		{
+			FifoCacheSim cache(n, cache_size);
+			for (size_t k = 0; k < clusters.size(); k++)
+			{
+				size_t begin = clusters[k], end = (k + 1 < clusters.size()) ? clusters[k + 1] : tri_count;
+				size_t misses = 0;
+				cache.Reset();
+				for (size_t t = begin; t < end; t++)
+					misses += cache.Misses(triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2]);
+				float cluster_threshold = threshold * misses / (end - begin);
+
+				soft_clusters.push_back(begin);
+				size_t running_misses = 0, running_count = 0;
+				cache.Reset();
+				for (size_t t = begin; t + 1 < end; t++)
+				{
+					running_misses += cache.Misses(triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2]);
+					running_count++;
+					if (running_misses <= cluster_threshold * running_count)
+					{
+						soft_clusters.push_back(t + 1);
+						running_misses = running_count = 0;
+						cache.Reset();
+					}
+				}
+			}
+		}
+
+		// clusters facing away from mesh center are drawn first, they likely hide the others
+		MeshStreamView pos = GetStreamView(MeshStreams::position);
+		auto corner = [&](size_t i) { const float* p = pos[triangles[i]]; return Vector3(p[0], p[1], p[2]); };
+		std::vector<Vector3> cluster_centers(soft_clusters.size()), cluster_normals(soft_clusters.size());
+		Vector3 center;
+		float total_area = 0;
+		for (size_t k = 0; k < soft_clusters.size(); k++)
+		{
+			size_t begin = soft_clusters[k], end = (k + 1 < soft_clusters.size()) ? soft_clusters[k + 1] : tri_count;
+			float area = 0;
+			for (size_t t = begin; t < end; t++)
+			{
+				Vector3 a = corner(t * 3), b = corner(t * 3 + 1), c = corner(t * 3 + 2);
+				Vector3 normal = VectorCross(b - a, c - a);
+				float tri_area = VectorLength(normal);
+				cluster_centers[k] += (a + b + c) * tri_area;
+				cluster_normals[k] += normal;
+				area += tri_area;
+			}
+			center += cluster_centers[k];
+			total_area += area;
+			cluster_centers[k] = (area > 0) ? cluster_centers[k] / (area * 3) : corner(begin * 3);
+		}
+		center = (total_area > 0) ? center / (total_area * 3) : Vector3();
+		std::vector<float> keys(soft_clusters.size());
+		std::vector<int> order(soft_clusters.size());
+		for (size_t k = 0; k < soft_clusters.size(); k++)
+		{
+			keys[k] = VectorDot(cluster_centers[k] - center, VectorNormalize(cluster_normals[k]));
+			order[k] = static_cast<int>(k);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return keys[a] > keys[b]; });
+
+		std::vector<int> result;
+		result.reserve(triangles.size());
+		for (int k : order)
+		{
+			size_t begin = soft_clusters[k], end = (k + 1 < static_cast<int>(soft_clusters.size())) ? soft_clusters[k + 1] : tri_count;
+			result.insert(result.end(), triangles.begin() + begin * 3, triangles.begin() + end * 3);
+		}
+
+		// cold caches at cluster starts cost more than threshold, keep old order
+		MeshCacheStats old_stats = GetCacheStats();
+		triangles.swap(result);
+		if (GetCacheStats().acmr > old_stats.acmr * threshold)
+			triangles.swap(result);
+	}
+	void Mesh::OptimizeVertexFetch()
+	{
+		std::vector<int> remap(VertexCount(), -1), order;
+		order.reserve(VertexCount());
+		for (auto& v : triangles)
+		{
+			if (remap[v] < 0)
+			{
+				remap[v] = static_cast<int>(order.size());
+				order.push_back(v);
+			}
+			v = remap[v];
+		}
+		PermuteStream(vertices, order);
+		PermuteStream(positions, order);
+		PermuteStream(normals, order);
+		PermuteStream(colors, order);
+		PermuteStream(uvs, order);
+		PermuteStream(uv2s, order);
+		bounds_valid = false;
+	}
+	void Mesh::Optimize()
+	{
+		OptimizeVertexCache();
+		OptimizeOverdraw();
+		OptimizeVertexFetch();
+	}
+	MeshCacheStats Mesh::GetCacheStats(int cache_size)
+	{
+		MeshCacheStats stats{ 0, 0 };
+		size_t tri_count = triangles.size() / 3, n = VertexCount();
+		if (tri_count == 0)
+			return stats;
+		FifoCacheSim cache(n, Max(cache_size, 1));
+		std::vector<uchar> used(n, 0);
+		size_t misses = 0, used_count = 0;
+		for (size_t t = 0; t < tri_count; t++)
+			misses += cache.Misses(triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2]);
+		for (int v : triangles)
+		{
+			used_count += used[v] ? 0 : 1;
+			used[v] = 1;
+		}
+		stats.acmr = static_cast<float>(misses) / tri_count;
+		stats.atvr = static_cast<float>(misses) / used_count;
+		return stats;
+	}
+
+
+
+	// corners of cube faces, four for each face, color is index of colors
+	struct CubeCorner
+	{
+		Point p;
+		Vector n;
+		int color;
+		UV uv;
+		UV uv2;
+	};
+	constexpr CubeCorner cube_corners[24] = {
+		// front
+		{ Point(-1, -1, -1), Vector(0, 0, -1), 0, UV(0, 1), UV(0.25f, 0.5f) },
+		{ Point(1, -1, -1), Vector(0, 0, -1), 1, UV(1, 1), UV(0.5f, 0.5f) },
+		{ Point(-1, 1, -1), Vector(0, 0, -1), 2, UV(0, 0), UV(0.25f, 0.25f) },
+		{ Point(1, 1, -1), Vector(0, 0, -1), 3, UV(1, 0), UV(0.5f, 0.25f) },
+		// down
+		{ Point(-1, -1, 1), Vector(0, -1, 0), 4, UV(0, 1), UV(0.25f, 0.75f) },
+		{ Point(1, -1, 1), Vector(0, -1, 0), 5, UV(1, 1), UV(0.5f, 0.75f) },
+		{ Point(-1, -1, -1), Vector(0, -1, 0), 0, UV(0, 0), UV(0.25f, 0.5f) },
+		{ Point(1, -1, -1), Vector(0, -1, 0), 1, UV(1, 0), UV(0.5f, 0.5f) },
+		// up
+		{ Point(-1, 1, -1), Vector(0, 1, 0), 2, UV(0, 1), UV(0.25f, 0.25f) },
+		{ Point(1, 1, -1), Vector(0, 1, 0), 3, UV(1, 1), UV(0.5f, 0.25f) },
+		{ Point(-1, 1, 1), Vector(0, 1, 0), 6, UV(0, 0), UV(0.25f, 0) },
+		{ Point(1, 1, 1), Vector(0, 1, 0), 7, UV(1, 0), UV(0.5f, 0) },
+		// back
+		{ Point(-1, 1, 1), Vector(0, 0, 1), 6, UV(0, 1), UV(0.25f, 1) },
+		{ Point(1, 1, 1), Vector(0, 0, 1), 7, UV(1, 1), UV(0.5f, 1) },
+		{ Point(-1, -1, 1), Vector(0, 0, 1), 4, UV(0, 0), UV(0.25f, 0.75f) },
+		{ Point(1, -1, 1), Vector(0, 0, 1), 5, UV(1, 0), UV(0.5f, 0.75f) },
+		// left
+		{ Point(-1, -1, 1), Vector(-1, 0, 0), 4, UV(0, 1), UV(0, 0.5f) },
+		{ Point(-1, -1, -1), Vector(-1, 0, 0), 0, UV(1, 1), UV(0.25f, 0.5f) },
+		{ Point(-1, 1, 1), Vector(-1, 0, 0), 6, UV(0, 0), UV(0, 0.25f) },
+		{ Point(-1, 1, -1), Vector(-1, 0, 0), 2, UV(1, 0), UV(0.25f, 0.25f) },
+		// right
+		{ Point(1, -1, -1), Vector(1, 0, 0), 1, UV(0, 1), UV(0.5f, 0.5f) },
+		{ Point(1, -1, 1), Vector(1, 0, 0), 5, UV(1, 1), UV(0.75f, 0.5f) },
+		{ Point(1, 1, -1), Vector(1, 0, 0), 3, UV(0, 0), UV(0.5f, 0.25f) },
+		{ Point(1, 1, 1), Vector(1, 0, 0), 7, UV(1, 0), UV(0.75f, 0.25f) }
+	};
 	std::shared_ptr<Mesh> CreateCubeMesh(const std::vector<Color>& colors, int smooth)
 	{
 		smooth = Clamp(smooth, 1, 200);
@@ -186,42 +887,12 @@ namespace Rehenz
 			}
 		};
 
-		// front
-		vertices.push_back(Vertex(Point(-1, -1, -1), Vector(0, 0, -1), GetColor(0), UV(0, 1), UV(0.25f, 0.5f)));
-		vertices.push_back(Vertex(Point(1, -1, -1), Vector(0, 0, -1), GetColor(1), UV(1, 1), UV(0.5f, 0.5f)));
-		vertices.push_back(Vertex(Point(-1, 1, -1), Vector(0, 0, -1), GetColor(2), UV(0, 0), UV(0.25f, 0.25f)));
-		vertices.push_back(Vertex(Point(1, 1, -1), Vector(0, 0, -1), GetColor(3), UV(1, 0), UV(0.5f, 0.25f)));
-		SmoothFace();
-		// down
-		vertices.push_back(Vertex(Point(-1, -1, 1), Vector(0, -1, 0), GetColor(4), UV(0, 1), UV(0.25f, 0.75f)));
-		vertices.push_back(Vertex(Point(1, -1, 1), Vector(0, -1, 0), GetColor(5), UV(1, 1), UV(0.5f, 0.75f)));
-		vertices.push_back(Vertex(Point(-1, -1, -1), Vector(0, -1, 0), GetColor(0), UV(0, 0), UV(0.25f, 0.5f)));
-		vertices.push_back(Vertex(Point(1, -1, -1), Vector(0, -1, 0), GetColor(1), UV(1, 0), UV(0.5f, 0.5f)));
-		SmoothFace();
-		// up
-		vertices.push_back(Vertex(Point(-1, 1, -1), Vector(0, 1, 0), GetColor(2), UV(0, 1), UV(0.25f, 0.25f)));
-		vertices.push_back(Vertex(Point(1, 1, -1), Vector(0, 1, 0), GetColor(3), UV(1, 1), UV(0.5f, 0.25f)));
-		vertices.push_back(Vertex(Point(-1, 1, 1), Vector(0, 1, 0), GetColor(6), UV(0, 0), UV(0.25f, 0)));
-		vertices.push_back(Vertex(Point(1, 1, 1), Vector(0, 1, 0), GetColor(7), UV(1, 0), UV(0.5f, 0)));
-		SmoothFace();
-		// back
-		vertices.push_back(Vertex(Point(-1, 1, 1), Vector(0, 0, 1), GetColor(6), UV(0, 1), UV(0.25f, 1)));
-		vertices.push_back(Vertex(Point(1, 1, 1), Vector(0, 0, 1), GetColor(7), UV(1, 1), UV(0.5f, 1)));
-		vertices.push_back(Vertex(Point(-1, -1, 1), Vector(0, 0, 1), GetColor(4), UV(0, 0), UV(0.25f, 0.75f)));
-		vertices.push_back(Vertex(Point(1, -1, 1), Vector(0, 0, 1), GetColor(5), UV(1, 0), UV(0.5f, 0.75f)));
-		SmoothFace();
-		// left
-		vertices.push_back(Vertex(Point(-1, -1, 1), Vector(-1, 0, 0), GetColor(4), UV(0, 1), UV(0, 0.5f)));
-		vertices.push_back(Vertex(Point(-1, -1, -1), Vector(-1, 0, 0), GetColor(0), UV(1, 1), UV(0.25f, 0.5f)));
-		vertices.push_back(Vertex(Point(-1, 1, 1), Vector(-1, 0, 0), GetColor(6), UV(0, 0), UV(0, 0.25f)));
-		vertices.push_back(Vertex(Point(-1, 1, -1), Vector(-1, 0, 0), GetColor(2), UV(1, 0), UV(0.25f, 0.25f)));
-		SmoothFace();
-		// right
-		vertices.push_back(Vertex(Point(1, -1, -1), Vector(1, 0, 0), GetColor(1), UV(0, 1), UV(0.5f, 0.5f)));
-		vertices.push_back(Vertex(Point(1, -1, 1), Vector(1, 0, 0), GetColor(5), UV(1, 1), UV(0.75f, 0.5f)));
-		vertices.push_back(Vertex(Point(1, 1, -1), Vector(1, 0, 0), GetColor(3), UV(0, 0), UV(0.5f, 0.25f)));
-		vertices.push_back(Vertex(Point(1, 1, 1), Vector(1, 0, 0), GetColor(7), UV(1, 0), UV(0.75f, 0.25f)));
-		SmoothFace();
+		for (int face = 0; face < 6; face++)
+		{
+			for (const CubeCorner* c = cube_corners + face * 4; c < cube_corners + face * 4 + 4; c++)
+				vertices.push_back(Vertex(c->p, c->n, GetColor(c->color), c->uv, c->uv2));
+			SmoothFace();
+		}
 
 		return std::make_shared<Mesh>(std::move(vertices), std::move(triangles));
 	}
@@ -234,15 +905,20 @@ namespace Rehenz
 		std::vector<Vertex> vertices;
 		std::vector<int> triangles;
 
+		// sin and cos of longitudes, same for each latitude
+		std::vector<float> sinphi(xn), cosphi(xn);
+		for (int x = 0; x < xn; x++)
+			FastSinCos(pi_mul2 * x / xn, sinphi[x], cosphi[x]);
+
 		// add vertices by latitude from top(0,1,0) to bottom(0,-1,0)
 		vertices.emplace_back(Point(0, 1, 0), Vector(0, 1, 0));
 		for (int y = 1; y < yn; y++)
 		{
-			float theta = pi * y / yn;
+			float sintheta = 0, costheta = 0;
+			FastSinCos(pi * y / yn, sintheta, costheta);
 			for (int x = 0; x < xn; x++)
 			{
-				float phi = pi_mul2 * x / xn;
-				vertices.push_back(Point(sinf(theta) * cosf(phi), cosf(theta), -sinf(theta) * sinf(phi)));
+				vertices.push_back(Point(sintheta * cosphi[x], costheta, -sintheta * sinphi[x]));
 				vertices.back().n = vertices.back().p;
 				vertices.back().n.w = 0;
 			}
@@ -391,18 +1067,48 @@ namespace Rehenz
 	{
 		triangles.insert(triangles.end(), _triangles.begin(), _triangles.end());
 	}
+	// first part vertices of CreateSphereMeshB, octahedron
+	constexpr Point sphere_b_base[6] = {
+		Point(0, 1, 0), Point(1, 0, 0), Point(0, 0, -1), Point(-1, 0, 0), Point(0, 0, 1), Point(0, -1, 0)
+	};
+	// first part vertices of CreateSphereMeshC, tetrahedron
+	constexpr float sphere_sqr2 = ConstSqrt(2), sphere_sqr6 = ConstSqrt(6);
+	constexpr Point sphere_c_base[4] = {
+		Point(0, 1, 0),
+		Point(2 * sphere_sqr2 / 3, -1.0f / 3, 0),
+		Point(-sphere_sqr2 / 3, -1.0f / 3, -sphere_sqr6 / 3),
+		Point(-sphere_sqr2 / 3, -1.0f / 3, +sphere_sqr6 / 3)
+	};
+	// divide by length of (x,y,z,1) and keep w = 1
+	constexpr Point SphereBasePoint(Point p)
+	{
+		float length = VectorLength(p);
+		if (length != 0)
+			p /= length;
+		p(3) = 1;
+		return p;
+	}
+	// first part vertices of CreateSphereMeshD, icosahedron
+	constexpr float sphere_sqr3 = ConstSqrt(3), sphere_sqr5 = ConstSqrt(5);
+	constexpr Point sphere_d_base[12] = {
+		SphereBasePoint(Point(1, sphere_sqr3, (3 + sphere_sqr5) / 2)),
+		SphereBasePoint(Point(-2, 0, (3 + sphere_sqr5) / 2)),
+		SphereBasePoint(Point(1, -sphere_sqr3, (3 + sphere_sqr5) / 2)),
+		SphereBasePoint(Point(-(1 + sphere_sqr5) / 2, -(1 + sphere_sqr5) * sphere_sqr3 / 2, (sphere_sqr5 - 1) / 2)),
+		SphereBasePoint(Point(1 + sphere_sqr5, 0, (sphere_sqr5 - 1) / 2)),
+		SphereBasePoint(Point(-(1 + sphere_sqr5) / 2, (1 + sphere_sqr5) * sphere_sqr3 / 2, (sphere_sqr5 - 1) / 2)),
+		SphereBasePoint(Point((1 + sphere_sqr5) / 2, (1 + sphere_sqr5) * sphere_sqr3 / 2, -(sphere_sqr5 - 1) / 2)),
+		SphereBasePoint(Point(-(1 + sphere_sqr5), 0, -(sphere_sqr5 - 1) / 2)),
+		SphereBasePoint(Point((1 + sphere_sqr5) / 2, -(1 + sphere_sqr5) * sphere_sqr3 / 2, -(sphere_sqr5 - 1) / 2)),
+		SphereBasePoint(Point(-1, -sphere_sqr3, -(3 + sphere_sqr5) / 2)),
+		SphereBasePoint(Point(2, 0, -(3 + sphere_sqr5) / 2)),
+		SphereBasePoint(Point(-1, sphere_sqr3, -(3 + sphere_sqr5) / 2))
+	};
 	std::shared_ptr<Mesh> CreateSphereMeshB(int smooth)
 	{
-		std::vector<Vertex> vertices;
+		std::vector<Vertex> vertices(sphere_b_base, sphere_b_base + 6);
 		std::vector<int> triangles;
 
-		// add first part vertices
-		vertices.push_back(Point(0, 1, 0));
-		vertices.push_back(Point(1, 0, 0));
-		vertices.push_back(Point(0, 0, -1));
-		vertices.push_back(Point(-1, 0, 0));
-		vertices.push_back(Point(0, 0, 1));
-		vertices.push_back(Point(0, -1, 0));
 		// add second part vertices
 		SphereSkeleton(vertices, smooth, 0, 1); SphereSkeleton(vertices, smooth, 0, 2);
 		SphereSkeleton(vertices, smooth, 0, 3); SphereSkeleton(vertices, smooth, 0, 4);
@@ -430,15 +1136,9 @@ namespace Rehenz
 	}
 	std::shared_ptr<Mesh> CreateSphereMeshC(int smooth)
 	{
-		std::vector<Vertex> vertices;
+		std::vector<Vertex> vertices(sphere_c_base, sphere_c_base + 4);
 		std::vector<int> triangles;
 
-		// add first part vertices
-		float sqr2 = sqrtf(2), sqr6 = sqrtf(6);
-		vertices.push_back(Point(0, 1, 0));
-		vertices.push_back(Point(2 * sqr2 / 3, -1.0f / 3, 0));
-		vertices.push_back(Point(-sqr2 / 3, -1.0f / 3, -sqr6 / 3));
-		vertices.push_back(Point(-sqr2 / 3, -1.0f / 3, +sqr6 / 3));
 		// add second part vertices
 		SphereSkeleton(vertices, smooth, 0, 1); SphereSkeleton(vertices, smooth, 0, 2);
 		SphereSkeleton(vertices, smooth, 0, 3); SphereSkeleton(vertices, smooth, 1, 2);
@@ -459,30 +1159,9 @@ namespace Rehenz
 	}
 	std::shared_ptr<Mesh> CreateSphereMeshD(int smooth)
 	{
-		std::vector<Vertex> vertices;
+		std::vector<Vertex> vertices(sphere_d_base, sphere_d_base + 12);
 		std::vector<int> triangles;
 
-		// add first part vertices
-		float sqr3 = sqrtf(3), sqr5 = sqrtf(5);
-		vertices.push_back(Point(1, sqr3, (3 + sqr5) / 2));
-		vertices.push_back(Point(-2, 0, (3 + sqr5) / 2));
-		vertices.push_back(Point(1, -sqr3, (3 + sqr5) / 2));
-		vertices.push_back(Point(-(1 + sqr5) / 2, -(1 + sqr5) * sqr3 / 2, (sqr5 - 1) / 2));
-		vertices.push_back(Point(1 + sqr5, 0, (sqr5 - 1) / 2));
-		vertices.push_back(Point(-(1 + sqr5) / 2, (1 + sqr5) * sqr3 / 2, (sqr5 - 1) / 2));
-		vertices.push_back(Point((1 + sqr5) / 2, (1 + sqr5) * sqr3 / 2, -(sqr5 - 1) / 2));
-		vertices.push_back(Point(-(1 + sqr5), 0, -(sqr5 - 1) / 2));
-		vertices.push_back(Point((1 + sqr5) / 2, -(1 + sqr5) * sqr3 / 2, -(sqr5 - 1) / 2));
-		vertices.push_back(Point(-1, -sqr3, -(3 + sqr5) / 2));
-		vertices.push_back(Point(2, 0, -(3 + sqr5) / 2));
-		vertices.push_back(Point(-1, sqr3, -(3 + sqr5) / 2));
-		for (auto& v : vertices)
-		{
-			float length = VectorLength(v.p);
-			if (length != 0)
-				v.p /= length;
-			v.p.w = 1;
-		}
 		// add second part vertices
 		SphereSkeleton(vertices, smooth, 0, 1); SphereSkeleton(vertices, smooth, 0, 2);
 		SphereSkeleton(vertices, smooth, 0, 4); SphereSkeleton(vertices, smooth, 0, 6);
@@ -533,87 +1212,69 @@ namespace Rehenz
 
 		return std::make_shared<Mesh>(std::move(vertices), std::move(triangles));
 	}
-	std::shared_ptr<Mesh> CreateMeshFromObjFile(const std::string& filename)
+	namespace
 	{
-		std::vector<Vertex> vertices;
-		std::vector<int> triangles;
+		// seed of hash of .rmesh caches, change it when obj data is converted to mesh differently, so old caches are not read
+		const ullong obj_loader_version = 1;
+	}
+	std::shared_ptr<Mesh> CreateMeshFromObjFile(const std::string& filename, bool use_cache)
+	{
+		MappedFile file(filename);
+		std::string cache_name = filename + ".rmesh";
+		ullong hash = 0;
+		if (use_cache && file.Data() != nullptr)
+		{
+			// 0 means no hash in mesh file
+			hash = Max(HashBytes(file.Data(), file.Size(), obj_loader_version), 1ull);
+			auto cached = CreateMeshFromMeshFile(cache_name, hash);
+			if (cached)
+				return cached;
+		}
 
-		std::ifstream fs(filename.c_str());
-		std::vector<Point> vs;
-		std::vector<UV> vts;
-		std::vector<Color> vns;
+		ObjData obj;
+		if (file.Data() != nullptr)
+			ParseObj(file.Data(), file.Size(), obj);
 
-		while (fs.good())
+		// a vertex per distinct v/vt/vn triple, normal is also saved in color
+		// vertices are hashed by position index, vertices of the same position are chained
+		size_t n = obj.corners.size() / 3;
+		std::vector<int> first_vertex(obj.positions.size() / 3, -1);
+		std::vector<int> next_vertex, vertex_uv, vertex_normal;
+		std::vector<Vertex> vertices;
+		std::vector<int> triangles(n);
+		for (size_t i = 0; i < n; i++)
 		{
-			std::string line;
-			std::getline(fs, line);
-			std::istringstream ss(line);
-
-			std::string str;
-			ss >> str;
-			if (str.length() == 0) // empty line
-				continue;
-			else if (str[0] == '#') // comment line
-				continue;
-			else if (str == "mtlib") // material // ignore
-				continue;
-			else if (str == "usemtl") // material // ignore
-				continue;
-			else if (str == "g") // group // ignore
-				continue;
-			else if (str == "v") // pos
-			{
-				Point p;
-				ss >> p.x >> p.y >> p.z;
-				vs.push_back(p);
-			}
-			else if (str == "vt") // uv
-			{
-				UV uv;
-				ss >> uv.x >> uv.y;
-				vts.push_back(uv);
-			}
-			else if (str == "vn") // normal
-			{
-				Color c;
-				ss >> c.x >> c.y >> c.z;
-				vns.push_back(c);
-			}
-			else if (str == "f") // face
+			const int* corner = &obj.corners[i * 3];
+			int index = first_vertex[corner[0]];
+			while (index >= 0 && (vertex_uv[index] != corner[1] || vertex_normal[index] != corner[2]))
+				index = next_vertex[index];
+			if (index < 0)
 			{
-				for (int i = 0; i < 3; i++)
-				{
-					int values[3]{ 0,0,0 };
+				index = static_cast<int>(vertices.size());
+				next_vertex.push_back(first_vertex[corner[0]]);
+				vertex_uv.push_back(corner[1]);
+				vertex_normal.push_back(corner[2]);
+				first_vertex[corner[0]] = index;
 
-					std::string part;
-					ss >> part;
-					std::istringstream part_ss(part);
-					for (int j = 0; j < 3; j++)
-					{
-						std::string value_str;
-						getline(part_ss, value_str, '/');
-						if (value_str.length() != 0)
-							values[j] = std::stoi(value_str);
-					}
-					for (int j = 0; j < 3; j++)
-						values[j] -= 1;
-
-					triangles.push_back(static_cast<int>(vertices.size()));
-					if (values[0] < 0 || values[0] >= vs.size()) // no pos, ignore the face
-						break;
-					Vertex v(vs[values[0]]);
-					if (values[2] >= 0 && values[2] < vns.size())
-						v.c = vns[values[2]];
-					if (values[1] >= 0 && values[1] < vts.size())
-						v.uv = vts[values[1]];
-					vertices.push_back(v);
+				const float* p = &obj.positions[corner[0] * 3];
+				Vertex v(Point(p[0], p[1], p[2]));
+				if (corner[1] >= 0)
+					v.uv = UV(obj.uvs[corner[1] * 2], obj.uvs[corner[1] * 2 + 1]);
+				if (corner[2] >= 0)
+				{
+					const float* vn = &obj.normals[corner[2] * 3];
+					v.n = Vector(vn[0], vn[1], vn[2]);
+					v.c = Color(vn[0], vn[1], vn[2]);
 				}
+				vertices.push_back(v);
 			}
-			else // other // ignore
-				continue;
+			triangles[i] = index;
 		}
 
-		return std::make_shared<Mesh>(std::move(vertices), std::move(triangles));
+		auto mesh = std::make_shared<Mesh>(std::move(vertices), std::move(triangles));
+		if (hash != 0)
+			SaveMeshFile(cache_name, *mesh, hash);
+		return mesh;
 	}
 
 	std::shared_ptr<Mesh> CreateFrustumMesh(float top_radius, int smooth)
@@ -635,8 +1296,8 @@ namespace Rehenz
 			for (int x = 0; x < xn; x++)
 			{
 				float theta = pi_mul2 * x / xn;
-				float costheta = cosf(theta);
-				float sintheta = sinf(theta);
+				float sintheta = 0, costheta = 0;
+				FastSinCos(theta, sintheta, costheta);
 				for (int r = 1; r <= trn; r++)
 				{
 					float radius = top_radius * r / trn;
@@ -680,8 +1341,8 @@ namespace Rehenz
 		for (int x = 0; x < xn; x++)
 		{
 			float theta = pi_mul2 * x / xn;
-			float costheta = cosf(theta);
-			float sintheta = sinf(theta);
+			float sintheta = 0, costheta = 0;
+			FastSinCos(theta, sintheta, costheta);
 			for (int r = 1; r <= brn; r++)
 			{
 				float radius = 1.0f * r / brn;
@@ -725,8 +1386,8 @@ namespace Rehenz
 		for (int x = 0; x < xn; x++)
 		{
 			float theta = pi_mul2 * x / xn;
-			float costheta = cosf(theta);
-			float sintheta = sinf(theta);
+			float sintheta = 0, costheta = 0;
+			FastSinCos(theta, sintheta, costheta);
 			Vector normal2(normal.x * costheta, normal.y, normal.x * sintheta);
 			for (int y = 0; y <= yn; y++)
 			{
@@ -763,12 +1424,48 @@ namespace Rehenz
 		return std::make_shared<Mesh>(std::move(vertices), std::move(triangles));
 	}
 
-	Texture::Texture(int _width, int _height) : width(_width), height(_height), buffer(new Color[static_cast<size_t>(_width) * _height])
+	Sampler::Sampler() : address_u(TextureAddress::Clamp), address_v(TextureAddress::Clamp)
+	{
+	}
+	Sampler::Sampler(TextureAddress address) : address_u(address), address_v(address)
 	{
 	}
-	Texture::Texture(const Texture& t) : width(t.width), height(t.height), buffer(new Color[static_cast<size_t>(t.width) * t.height])
+	Sampler::Sampler(TextureAddress _address_u, TextureAddress _address_v) : address_u(_address_u), address_v(_address_v)
 	{
-		std::copy(t.buffer, t.buffer + static_cast<size_t>(width) * height, buffer);
+	}
+
+	size_t Texture::BufferSize(int _width, int _height, Layout _layout)
+	{
+		if (_layout == Layout::Linear)
+			return static_cast<size_t>(_width) * _height;
+		// pad to whole tiles
+		return static_cast<size_t>((_width + 7) >> 3) * ((_height + 7) >> 3) * 64;
+	}
+	Texture::Texture(int _width, int _height, Layout _layout)
+		: width(_width), height(_height), layout(_layout), buffer(new Color[BufferSize(_width, _height, _layout)])
+	{
+		mask_x = (width & (width - 1)) == 0 ? width - 1 : 0;
+		mask_y = (height & (height - 1)) == 0 ? height - 1 : 0;
+	}
+	Texture::Texture(const Texture& t)
+		: width(t.width), height(t.height), layout(t.layout), buffer(new Color[BufferSize(t.width, t.height, t.layout)]),
+		sampler(t.sampler)
+	{
+		mask_x = t.mask_x;
+		mask_y = t.mask_y;
+		std::copy(t.buffer, t.buffer + BufferSize(width, height, layout), buffer);
+	}
+	Texture::Texture(const Texture& t, Layout _layout)
+		: width(t.width), height(t.height), layout(_layout), buffer(new Color[BufferSize(t.width, t.height, _layout)]),
+		sampler(t.sampler)
+	{
+		mask_x = t.mask_x;
+		mask_y = t.mask_y;
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+				Texel(x, y) = t.Texel(x, y);
+		}
 	}
 	Texture::~Texture()
 	{
@@ -776,15 +1473,30 @@ namespace Rehenz
 	}
 	Color Texture::GetColor(float u, float v)
 	{
-		int x = static_cast<int>(u * width);
-		int y = static_cast<int>(v * height);
-		x = Clamp(x, 0, width - 1);
-		y = Clamp(y, 0, height - 1);
-		return buffer[y * width + x];
+		return GetColor(u, v, sampler);
 	}
 	Color Texture::GetColor(UV uv)
 	{
-		return GetColor(uv.x, uv.y);
+		return GetColor(uv.x, uv.y, sampler);
+	}
+	Color Texture::GetColor(float u, float v, const Sampler& _sampler)
+	{
+		float fx = u * width;
+		float fy = v * height;
+		// floor, keep wrap continuous when uv < 0
+		int x = static_cast<int>(fx);
+		int y = static_cast<int>(fy);
+		if (fx < x)
+			x--;
+		if (fy < y)
+			y--;
+		x = Address(x, width, mask_x, _sampler.address_u);
+		y = Address(y, height, mask_y, _sampler.address_v);
+		return buffer[TexelIndex(x, y)];
+	}
+	Color Texture::GetColor(UV uv, const Sampler& _sampler)
+	{
+		return GetColor(uv.x, uv.y, _sampler);
 	}
 	std::shared_ptr<Texture> CreateTexture1()
 	{
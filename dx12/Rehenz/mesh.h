@@ -12,15 +12,24 @@ namespace Rehenz
 	struct Vertex;
 	class Mesh;
 
+	enum class TextureAddress;
+	struct Sampler;
 	class Texture;
+	class ShadowMap;
 
 	struct VertexShaderData;
 	struct PixelShaderData;
+	struct PixelPacket;
+	struct ColorPacket;
 	typedef std::function<Vertex(const VertexShaderData&, const Vertex&)> VertexShader;
 	typedef std::function<Color(const PixelShaderData&, const Vertex&)> PixelShader;
+	// shade a 2x2 pixels packet once, write colors to the last parameter
+	typedef std::function<void(const PixelShaderData&, const PixelPacket&, ColorPacket&)> PixelShaderPacket;
 	extern VertexShader DefaultVertexShader;
 	extern PixelShader DefaultPixelShader;
 	extern PixelShader TexturePixelShader;
+	extern PixelShaderPacket DefaultPixelShaderPacket;
+	extern PixelShaderPacket TexturePixelShaderPacket;
 
 
 
@@ -65,30 +74,165 @@ namespace Rehenz
 	// divide by coef to recover vertex attributes except position
 	Vertex VertexRecover(const Vertex& v);
 
+	// 2x2 pixels in struct of arrays layout, attributes are recovered
+	//   lane 0 = (x,y), 1 = (x+1,y), 2 = (x,y+1), 3 = (x+1,y+1)
+	// lanes out of mask are only helpers, so ddx = a[1] - a[0], ddy = a[2] - a[0] are always valid
+	struct PixelPacket
+	{
+	public:
+		static const int size = 4;
+		// coverage, bit i for lane i
+		int mask;
+		alignas(16) float px[size], py[size], pz[size];
+		alignas(16) float nx[size], ny[size], nz[size];
+		alignas(16) float r[size], g[size], b[size], a[size];
+		alignas(16) float u[size], v[size];
+		alignas(16) float u2[size], v2[size];
+
+		inline Vertex GetVertex(int i) const
+		{
+			return Vertex(Point(px[i], py[i], pz[i]), Vector(nx[i], ny[i], nz[i]), Color(r[i], g[i], b[i], a[i]), UV(u[i], v[i]), UV(u2[i], v2[i]));
+		}
+	};
+
+	// colors of a pixels packet in struct of arrays layout
+	struct ColorPacket
+	{
+	public:
+		alignas(16) float r[PixelPacket::size], g[PixelPacket::size], b[PixelPacket::size], a[PixelPacket::size];
+
+		inline Color GetColor(int i) const
+		{
+			return Color(r[i], g[i], b[i], a[i]);
+		}
+		inline void SetColor(int i, Color c)
+		{
+			r[i] = c.x, g[i] = c.y, b[i] = c.z, a[i] = c.w;
+		}
+	};
+
 	Vertex VertexLerp(const Vertex& v1, const Vertex& v2, float t);
 
+	// vertex storage of mesh
+	//   AoS: array of Vertex, what vertex shaders take
+	//   SoA: a stream per attribute, only streams the mesh uses are stored,
+	//        position w is 1 and coef is 1, missing streams read as Vertex defaults
+	enum class MeshLayout { AoS, SoA };
+
+	// bits of vertex attribute streams
+	struct MeshStreams
+	{
+	public:
+		static const uint position = 1;
+		static const uint normal = 2;
+		static const uint color = 4;
+		static const uint uv = 8;
+		static const uint uv2 = 16;
+		static const uint all = 31;
+	};
+
+	// strided read-only view of one vertex stream, no copy
+	// valid until mesh is changed, data is nullptr if mesh has no such stream
+	struct MeshStreamView
+	{
+	public:
+		const float* data;
+		// distance between two vertices in floats
+		size_t stride;
+
+		inline const float* operator[](size_t i) const { return data + i * stride; }
+	};
+
+	// post-transform vertex cache statistics of a triangle order
+	//   acmr: transformed vertices per triangle, 3 is worst, about 0.5 for large regular meshes
+	//   atvr: transformed vertices per used vertex, 1 is best
+	struct MeshCacheStats
+	{
+	public:
+		float acmr;
+		float atvr;
+	};
+
 	class Mesh
 	{
 	private:
+		MeshLayout layout;
+		// AoS storage
 		std::vector<Vertex> vertices;
+		// SoA storage, streams not in stream_bits are empty
+		uint stream_bits;
+		std::vector<Vector3> positions;
+		std::vector<Vector3> normals;
+		std::vector<Color> colors;
+		std::vector<UV> uvs;
+		std::vector<UV> uv2s;
 		std::vector<int> triangles;
+		// cache of GetBounds
+		bool bounds_valid;
+		Point bounds_min, bounds_max;
 
 	public:
 		Mesh();
 		explicit Mesh(const std::vector<Vertex>& _vertices, const std::vector<int>& _triangles);
-		explicit Mesh(const std::vector<Vertex>&& _vertices, const std::vector<int>&& _triangles);
+		explicit Mesh(std::vector<Vertex>&& _vertices, std::vector<int>&& _triangles);
 		~Mesh();
 
-		inline size_t VertexCount() { return vertices.size(); }
+		inline MeshLayout GetLayout() { return layout; }
+		// streams mesh stores, all for AoS
+		inline uint GetStreams() { return layout == MeshLayout::AoS ? MeshStreams::all : stream_bits; }
+		inline size_t VertexCount() { return layout == MeshLayout::AoS ? vertices.size() : positions.size(); }
 		inline size_t TriangleCount() { return triangles.size() / 3; }
 		inline size_t IndexCount() { return triangles.size(); }
+		// vertices of AoS mesh, empty for SoA mesh, use GetVertex or GetStreamView instead
 		inline const std::vector<Vertex>& GetVertices() { return vertices; }
 		inline const std::vector<int>& GetTriangles() { return triangles; }
+		// vertex i in any layout
+		Vertex GetVertex(size_t i);
+		// view of one stream (a bit of MeshStreams) in any layout
+		MeshStreamView GetStreamView(uint stream);
+		// streams whose values are not all Vertex defaults, same as GetStreams for SoA
+		uint GetUsedStreams();
+		// axis-aligned bounding box of positions, cached until vertices change
+		void GetBounds(Point& pmin, Point& pmax);
+		// set cached bounds, such as bounds saved with the mesh, they must be bounds of positions
+		void SetBounds(Point pmin, Point pmax);
 
 		void AddVertex(Vertex vertex);
 		void AddVertex(const std::vector<Vertex>& _vertices);
 		void AddTriangle(int a, int b, int c);
 		void AddTriangle(const std::vector<int>& _triangles);
+		// replace vertices by streams in SoA layout, nullptr for missing streams
+		// floats per vertex : position 3, normal 3, color 4, uv 2, uv2 2
+		void SetStreams(size_t count, const float* position, const float* normal, const float* color, const float* uv, const float* uv2);
+		// same as above but streams are moved in without copy, empty vectors for missing streams
+		void SetStreams(std::vector<Vector3>&& position, std::vector<Vector3>&& normal, std::vector<Color>&& color, std::vector<UV>&& uv, std::vector<UV>&& uv2);
+		// replace triangles
+		void SetTriangles(const int* indices, size_t count);
+		void SetTriangles(std::vector<int>&& indices);
+
+		// convert storage to layout, SoA keeps streams whose values differ from Vertex defaults
+		void ConvertLayout(MeshLayout _layout);
+		// convert to SoA and keep only given streams, position is always kept
+		void ConvertToSoA(uint streams);
+
+		// merge vertices whose attributes all differ by at most epsilon, 0 merges identical vertices only
+		// triangles are remapped, triangles that become degenerate are removed
+		// return number of removed vertices
+		size_t Weld(float epsilon = 0);
+
+		// reorder triangles for post-transform vertex cache, Forsyth's linear-speed algorithm with a LRU cache
+		// old order is kept if it has lower ACMR in GetCacheStats
+		void OptimizeVertexCache(int cache_size = 32);
+		// reorder clusters of triangles so surfaces facing away from mesh center are drawn first and hide the others
+		// run after OptimizeVertexCache, clusters are split where cache order allows
+		// threshold is the allowed growth of ACMR, old order is kept if new order exceeds it
+		void OptimizeOverdraw(float threshold = 1.05f);
+		// reorder vertices by first use in triangles and remove unused vertices
+		void OptimizeVertexFetch();
+		// the three passes above in order
+		void Optimize();
+		// cache statistics of triangle order with a FIFO cache like GPUs
+		MeshCacheStats GetCacheStats(int cache_size = 16);
 	};
 
 	// create cube mesh which includes pos, normal, color, uv, uv2 info
@@ -118,30 +262,118 @@ namespace Rehenz
 	// sphere mesh D layout
 	std::shared_ptr<Mesh> CreateSphereMeshD(int smooth = 4);
 
-	// create mesh from .obj file
-	// include pos, normal, uv info
-	std::shared_ptr<Mesh> CreateMeshFromObjFile(const std::string& filename);
+	// create mesh from .obj file, see ReadObjFile
+	// include pos, normal, uv info, normal is also saved in color
+	// use_cache: read "<filename>.rmesh" if it was saved from same file content by same loader version, else parse and save it
+	std::shared_ptr<Mesh> CreateMeshFromObjFile(const std::string& filename, bool use_cache = false);
 
 	// create frustum mesh which includes pos, normal info
 	// pos   : height = 2, bottom radius = 1, (0,0,0) is center point
 	// normal: 
 	std::shared_ptr<Mesh> CreateFrustumMesh(float top_radius = 0.5f, int smooth = 10);
 
+	// how to map uv out of [0,1] to texels
+	//   Clamp : use the edge texel
+	//   Wrap  : repeat texture
+	//   Mirror: repeat texture, and flip every other repetition
+	enum class TextureAddress { Clamp, Wrap, Mirror };
+
+	// sampler state, can be set per texture or per draw
+	struct Sampler
+	{
+	public:
+		TextureAddress address_u;
+		TextureAddress address_v;
+
+		// default clamp
+		Sampler();
+		explicit Sampler(TextureAddress address);
+		explicit Sampler(TextureAddress _address_u, TextureAddress _address_v);
+	};
+
 	class Texture
 	{
+	public:
+		// texel storage order
+		//   Linear: row-major
+		//   Tiled : 8x8 tiles in row-major, texels in a tile in morton order (z-order),
+		//           near texels stay in the same cache line when sampling along any direction
+		enum class Layout { Linear, Tiled };
+
 	private:
+		static size_t BufferSize(int _width, int _height, Layout _layout);
+
+		// interleave bits of x,y in [0,7]
+		inline static int Morton8x8(int x, int y)
+		{
+			x = (x | (x << 2)) & 0x33;
+			x = (x | (x << 1)) & 0x55;
+			y = (y | (y << 2)) & 0x33;
+			y = (y | (y << 1)) & 0x55;
+			return x | (y << 1);
+		}
+
+		// size - 1 if size is power of two, otherwise 0
+		int mask_x, mask_y;
+
+		// map texel coordinate to [0,size-1] by address mode
+		// mask != 0 means size is power of two, and use bit operations
+		inline static int Address(int x, int size, int mask, TextureAddress address)
+		{
+			if (address == TextureAddress::Wrap)
+			{
+				if (mask)
+					return x & mask;
+				x %= size;
+				return x < 0 ? x + size : x;
+			}
+			else if (address == TextureAddress::Mirror)
+			{
+				int period = size << 1;
+				if (mask)
+					x &= (mask << 1) | 1;
+				else
+				{
+					x %= period;
+					if (x < 0)
+						x += period;
+				}
+				return x < size ? x : period - 1 - x;
+			}
+			else
+				return Clamp(x, 0, size - 1);
+		}
+
 	public:
 		const int width;
 		const int height;
+		const Layout layout;
 		Color* const buffer;
+		// used when no sampler is given by draw
+		Sampler sampler;
 
-		Texture(int _width, int _height);
+		Texture(int _width, int _height, Layout _layout = Layout::Linear);
 		Texture(const Texture& t);
+		// copy texture and convert texels to another layout
+		Texture(const Texture& t, Layout _layout);
 		Texture& operator=(const Texture&) = delete;
 		~Texture();
 
+		// get index of texel (x,y) in buffer
+		inline int TexelIndex(int x, int y) const
+		{
+			if (layout == Layout::Linear)
+				return y * width + x;
+			int tile_cols = (width + 7) >> 3;
+			return (((y >> 3) * tile_cols + (x >> 3)) << 6) | Morton8x8(x & 7, y & 7);
+		}
+		inline Color& Texel(int x, int y) { return buffer[TexelIndex(x, y)]; }
+		inline Color Texel(int x, int y) const { return buffer[TexelIndex(x, y)]; }
+
 		Color GetColor(float u, float v);
 		Color GetColor(UV uv);
+		Color GetColor(float u, float v, const Sampler& _sampler);
+		Color GetColor(UV uv, const Sampler& _sampler);
 	};
 
 	// create digit 1 texture
@@ -157,10 +389,14 @@ namespace Rehenz
 	{
 	public:
 		Matrix mat_world;
+		// inverse transpose of mat_world, transform normals to world space
+		Matrix mat_normal;
 		Matrix mat_view;
 		Matrix mat_project;
 		// = mat_world * mat_view * mat_project
 		Matrix transform;
+		// transform uv, apply once per vertex
+		Matrix mat_uv;
 	};
 
 	struct PixelShaderData
@@ -168,5 +404,11 @@ namespace Rehenz
 	public:
 		std::shared_ptr<Texture> texture;
 		std::shared_ptr<Texture> texture2;
+		// override sampler of textures if not nullptr
+		std::shared_ptr<Sampler> sampler;
+		// shadow map of light, can be nullptr
+		std::shared_ptr<ShadowMap> shadow_map;
+		// screen space -> shadow map clip space, for Vertex::p in pixel shader
+		Matrix mat_shadow;
 	};
 }
\ No newline at end of file
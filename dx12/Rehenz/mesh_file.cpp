@@ -0,0 +1,166 @@
+#include "mesh_file.h"
+#include "mapped_file.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace Rehenz
+{
+	namespace
+	{
+		static_assert(sizeof(MeshFileHeader) == 64, "mesh file header size");
+		static_assert(sizeof(MeshFileSection) == 24, "mesh file section size");
+
+		const uint stream_types[5]{ MeshStreams::position, MeshStreams::normal, MeshStreams::color, MeshStreams::uv, MeshStreams::uv2 };
+		const int stream_floats[5]{ 3, 3, 4, 2, 2 };
+
+		inline ullong Align16(ullong x)
+		{
+			return (x + 15) & ~15ull;
+		}
+	}
+
+	bool SaveMeshFile(const std::string& filename, Mesh& mesh, ullong source_hash)
+	{
+		size_t vertex_count = mesh.VertexCount();
+		const std::vector<int>& triangles = mesh.GetTriangles();
+		uint streams = mesh.GetUsedStreams();
+
+		// gather streams to contiguous arrays, SoA streams are used directly
+		std::vector<const void*> datas;
+		std::vector<MeshFileSection> sections;
+		std::vector<std::vector<float>> buffers;
+		for (int i = 0; i < 5; i++)
+		{
+			if (!(streams & stream_types[i]))
+				continue;
+			MeshStreamView view = mesh.GetStreamView(stream_types[i]);
+			int k = stream_floats[i];
+			MeshFileSection section{ stream_types[i], 0, 0, vertex_count * k * sizeof(float) };
+			if (vertex_count == 0)
+				datas.push_back(nullptr);
+			else if (view.stride == static_cast<size_t>(k))
+				datas.push_back(view.data);
+			else
+			{
+				buffers.emplace_back(vertex_count * k);
+				float* dst = &buffers.back()[0];
+				for (size_t v = 0; v < vertex_count; v++)
+					memcpy(dst + v * k, view[v], k * sizeof(float));
+				datas.push_back(dst);
+			}
+			sections.push_back(section);
+		}
+		sections.push_back(MeshFileSection{ MeshFileSectionType::index, 0, 0, triangles.size() * sizeof(int) });
+		datas.push_back(triangles.empty() ? nullptr : &triangles[0]);
+
+		ullong offset = Align16(sizeof(MeshFileHeader) + sections.size() * sizeof(MeshFileSection));
+		for (auto& section : sections)
+		{
+			section.offset = offset;
+			offset = Align16(offset + section.size);
+		}
+
+		MeshFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "RMSH", 4);
+		header.version = mesh_file_version;
+		header.source_hash = source_hash;
+		header.vertex_count = vertex_count;
+		header.index_count = triangles.size();
+		header.layout = static_cast<uint>(mesh.GetLayout());
+		header.section_count = static_cast<uint>(sections.size());
+		Point pmin, pmax;
+		mesh.GetBounds(pmin, pmax);
+		header.bounds_min[0] = pmin.x, header.bounds_min[1] = pmin.y, header.bounds_min[2] = pmin.z;
+		header.bounds_max[0] = pmax.x, header.bounds_max[1] = pmax.y, header.bounds_max[2] = pmax.z;
+
+		// write to a temporary file, so a broken write never leaves a valid-looking file
+		std::string temp_name = filename + ".tmp";
+		{
+			std::ofstream fs(temp_name.c_str(), std::ios::binary | std::ios::trunc);
+			if (!fs)
+				return false;
+			const char zeros[16]{};
+			fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			fs.write(reinterpret_cast<const char*>(&sections[0]), sections.size() * sizeof(MeshFileSection));
+			ullong written = sizeof(header) + sections.size() * sizeof(MeshFileSection);
+			for (size_t i = 0; i < sections.size(); i++)
+			{
+				fs.write(zeros, sections[i].offset - written);
+				if (sections[i].size > 0)
+					fs.write(static_cast<const char*>(datas[i]), sections[i].size);
+				written = sections[i].offset + sections[i].size;
+			}
+			if (!fs)
+				return false;
+		}
+		std::remove(filename.c_str());
+		return std::rename(temp_name.c_str(), filename.c_str()) == 0;
+	}
+
+	std::shared_ptr<Mesh> CreateMeshFromMeshFile(const std::string& filename, ullong source_hash)
+	{
+		MappedFile file(filename);
+		if (file.Data() == nullptr || file.Size() < sizeof(MeshFileHeader))
+			return nullptr;
+		MeshFileHeader header;
+		memcpy(&header, file.Data(), sizeof(header));
+		if (memcmp(header.magic, "RMSH", 4) != 0 || header.version != mesh_file_version)
+			return nullptr;
+		if (source_hash != 0 && header.source_hash != source_hash)
+			return nullptr;
+		if (header.section_count > 1024 || sizeof(header) + header.section_count * sizeof(MeshFileSection) > file.Size())
+			return nullptr;
+		// counts are bounded by file size first, so sizes below do not overflow
+		if (header.vertex_count > 0x7fffffff || header.index_count > file.Size() / sizeof(int) || header.index_count % 3 != 0)
+			return nullptr;
+
+		// find sections, check sizes against counts
+		const MeshFileSection* sections = reinterpret_cast<const MeshFileSection*>(file.Data() + sizeof(header));
+		const float* streams[5]{};
+		const int* indices = nullptr;
+		for (uint i = 0; i < header.section_count; i++)
+		{
+			const MeshFileSection& section = sections[i];
+			if (section.offset % 16 != 0 || section.offset > file.Size() || section.size > file.Size() - section.offset)
+				return nullptr;
+			const char* data = file.Data() + section.offset;
+			if (section.type == MeshFileSectionType::index)
+			{
+				if (section.size % sizeof(int) != 0 || section.size / sizeof(int) != header.index_count)
+					return nullptr;
+				indices = reinterpret_cast<const int*>(data);
+			}
+			for (int s = 0; s < 5; s++)
+			{
+				if (section.type != stream_types[s])
+					continue;
+				size_t element_size = stream_floats[s] * sizeof(float);
+				if (section.size % element_size != 0 || section.size / element_size != header.vertex_count)
+					return nullptr;
+				streams[s] = reinterpret_cast<const float*>(data);
+			}
+		}
+		if ((header.vertex_count > 0 && streams[0] == nullptr) || (header.index_count > 0 && indices == nullptr))
+			return nullptr;
+		for (ullong i = 0; i < header.index_count; i++)
+		{
+			if (indices[i] < 0 || static_cast<ullong>(indices[i]) >= header.vertex_count)
+				return nullptr;
+		}
+
+		auto mesh = std::make_shared<Mesh>();
+		if (header.vertex_count > 0)
+			mesh->SetStreams(static_cast<size_t>(header.vertex_count), streams[0], streams[1], streams[2], streams[3], streams[4]);
+		if (header.index_count > 0)
+			mesh->SetTriangles(indices, static_cast<size_t>(header.index_count));
+		if (header.layout == static_cast<uint>(MeshLayout::AoS))
+			mesh->ConvertLayout(MeshLayout::AoS);
+		// saved bounds save a scan of positions, false for NaN
+		const float* bmin = header.bounds_min, * bmax = header.bounds_max;
+		if (header.vertex_count > 0 && bmin[0] <= bmax[0] && bmin[1] <= bmax[1] && bmin[2] <= bmax[2])
+			mesh->SetBounds(Point(bmin[0], bmin[1], bmin[2]), Point(bmax[0], bmax[1], bmax[2]));
+		return mesh;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "mesh.h"
+
+// binary mesh file (.rmesh), little-endian
+//   header : 64 bytes, see MeshFileHeader
+//   table  : section_count MeshFileSection
+//   data   : sections, each starts at a multiple of 16 bytes
+// vertex streams are stored in SoA layout like Mesh, so a mapped file can be used without parsing,
+// readers skip unknown section types, version changes only when layout of known data changes
+namespace Rehenz
+{
+	const uint mesh_file_version = 1;
+
+	struct MeshFileHeader
+	{
+	public:
+		// "RMSH"
+		char magic[4];
+		uint version;
+		// hash of the source the mesh was created from, 0 if none
+		ullong source_hash;
+		ullong vertex_count;
+		ullong index_count;
+		// MeshLayout of saved mesh, mesh is read back in the same layout
+		uint layout;
+		uint section_count;
+		float bounds_min[3];
+		float bounds_max[3];
+	};
+
+	// types of sections, streams use bits of MeshStreams
+	//   position, normal : 3 floats per vertex
+	//   color            : 4 floats per vertex
+	//   uv, uv2          : 2 floats per vertex
+	//   index            : int per index
+	struct MeshFileSectionType
+	{
+	public:
+		static const uint index = 0x100;
+	};
+
+	struct MeshFileSection
+	{
+	public:
+		uint type;
+		uint reserved;
+		// in bytes from file start
+		ullong offset;
+		ullong size;
+	};
+
+	// write mesh to file, only streams in Mesh::GetUsedStreams are saved
+	bool SaveMeshFile(const std::string& filename, Mesh& mesh, ullong source_hash = 0);
+
+	// read mesh from file, nullptr if file is missing, broken,
+	// of another version, or source_hash is not 0 and differs from saved hash
+	std::shared_ptr<Mesh> CreateMeshFromMeshFile(const std::string& filename, ullong source_hash = 0);
+}
@@ -0,0 +1,469 @@
+#include "mesh_simplify.h"
+#include "util.h"
+#include <algorithm>
+
+namespace Rehenz
+{
+	namespace
+	{
+		// sum of weighted squared distances to planes as symmetric 4x4 matrix, w is sum of weights
+		struct Quadric
+		{
+		public:
+			double a00, a01, a02, a11, a12, a22, b0, b1, b2, c, w;
+
+			Quadric() : a00(0), a01(0), a02(0), a11(0), a12(0), a22(0), b0(0), b1(0), b2(0), c(0), w(0) {}
+
+			// plane n.p + d = 0, n is unit
+			void AddPlane(double nx, double ny, double nz, double d, double weight)
+			{
+				a00 += weight * nx * nx, a01 += weight * nx * ny, a02 += weight * nx * nz;
+				a11 += weight * ny * ny, a12 += weight * ny * nz, a22 += weight * nz * nz;
+				b0 += weight * nx * d, b1 += weight * ny * d, b2 += weight * nz * d;
+				c += weight * d * d;
+				w += weight;
+			}
+			Quadric& operator+=(const Quadric& q)
+			{
+				a00 += q.a00, a01 += q.a01, a02 += q.a02, a11 += q.a11, a12 += q.a12, a22 += q.a22;
+				b0 += q.b0, b1 += q.b1, b2 += q.b2, c += q.c, w += q.w;
+				return *this;
+			}
+			double Eval(Vector3 p) const
+			{
+				double x = p.x, y = p.y, z = p.z;
+				return a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+					+ 2 * (b0 * x + b1 * y + b2 * z) + c;
+			}
+		};
+
+		// collapse of vertex from to vertex to
+		struct EdgeCollapse
+		{
+		public:
+			// squared distance, quadric error divided by weight
+			float error;
+			int from, to;
+		};
+
+		inline bool CollapseLess(const EdgeCollapse& a, const EdgeCollapse& b)
+		{
+			return a.error < b.error;
+		}
+
+		// collapses that would leave a vertex with more neighbors are rejected, so flat regions do not fan out
+		const size_t simplify_max_valence = 16;
+
+		// neighbor vertex and count of live triangles on the edge to it, 1 for border edges
+		typedef std::vector<std::pair<int, int>> VertexRing;
+
+		// element of a stream from its floats
+		inline void ReadElement(const float* f, Vector3& e) { e = Vector3(f[0], f[1], f[2]); }
+		inline void ReadElement(const float* f, Color& e) { e = Color(f[0], f[1], f[2], f[3]); }
+		inline void ReadElement(const float* f, UV& e) { e = UV(f[0], f[1]); }
+
+		// vertices of order from a stream of mesh, empty if mesh has no such stream
+		template <typename T>
+		std::vector<T> GatherStream(Mesh& mesh, uint stream, const std::vector<int>& order)
+		{
+			std::vector<T> result;
+			MeshStreamView view = mesh.GetStreamView(stream);
+			if (view.data == nullptr)
+				return result;
+			result.resize(order.size());
+			for (size_t i = 0; i < order.size(); i++)
+				ReadElement(view[order[i]], result[i]);
+			return result;
+		}
+
+		class MeshSimplifier
+		{
+		private:
+			std::vector<Vector3> positions;
+			// vertices of corners, 3 corners per triangle
+			std::vector<int> corners;
+			// corners of each vertex as linked lists, -1 ends a list
+			std::vector<int> first_corner;
+			std::vector<int> next_corner;
+			std::vector<uchar> triangle_removed;
+			std::vector<uchar> vertex_removed;
+			std::vector<uchar> locked;
+			// vertices changed by a collapse of the current pass
+			std::vector<uchar> touched;
+			std::vector<Quadric> quadrics;
+			int threads;
+
+			static void AddToRing(VertexRing& ring, int v)
+			{
+				for (auto& n : ring)
+				{
+					if (n.first == v)
+					{
+						n.second++;
+						return;
+					}
+				}
+				ring.emplace_back(v, 1);
+			}
+
+			void GetRing(int v, VertexRing& ring) const
+			{
+				ring.clear();
+				for (int c = first_corner[v]; c >= 0; c = next_corner[c])
+				{
+					if (triangle_removed[c / 3])
+						continue;
+					int t = c / 3 * 3, k = c % 3;
+					AddToRing(ring, corners[t + (k + 1) % 3]);
+					AddToRing(ring, corners[t + (k + 2) % 3]);
+				}
+			}
+
+			// unlink corners of removed triangles from list of v
+			void PruneCorners(int v)
+			{
+				int* link = &first_corner[v];
+				while (*link >= 0)
+				{
+					if (triangle_removed[*link / 3])
+						*link = next_corner[*link];
+					else
+						link = &next_corner[*link];
+				}
+			}
+
+			float CollapseError(int from, int to) const
+			{
+				Quadric q = quadrics[from];
+				q += quadrics[to];
+				return static_cast<float>(Max(q.Eval(positions[to]), 0.0) / Max(q.w, 1e-30));
+			}
+
+			// border vertex only moves along border, the collapse must not pinch the surface or flip a triangle
+			bool CanCollapse(int u, int v, VertexRing& ring_from, VertexRing& ring_to) const
+			{
+				GetRing(u, ring_from);
+				bool border = false;
+				int edge_triangles = 0;
+				for (auto& neighbor : ring_from)
+				{
+					if (neighbor.second > 2)
+						return false;
+					border = border || neighbor.second == 1;
+					if (neighbor.first == v)
+						edge_triangles = neighbor.second;
+				}
+				if (edge_triangles == 0 || (border && edge_triangles != 1))
+					return false;
+				GetRing(v, ring_to);
+				int shared = 0;
+				for (auto& a : ring_from)
+				{
+					for (auto& b : ring_to)
+						shared += (a.first == b.first) ? 1 : 0;
+				}
+				if (shared != edge_triangles || ring_from.size() + ring_to.size() - shared - 2 > simplify_max_valence)
+					return false;
+
+				for (int c = first_corner[u]; c >= 0; c = next_corner[c])
+				{
+					int t = c / 3 * 3;
+					if (triangle_removed[t / 3] || corners[t] == v || corners[t + 1] == v || corners[t + 2] == v)
+						continue;
+					Vector3 p[3]{ positions[corners[t]], positions[corners[t + 1]], positions[corners[t + 2]] };
+					Vector3 before = VectorCross(p[1] - p[0], p[2] - p[0]);
+					p[c % 3] = positions[v];
+					Vector3 after = VectorCross(p[1] - p[0], p[2] - p[0]);
+					if (VectorDot(before, after) <= 0)
+						return false;
+				}
+				return true;
+			}
+
+			// triangles on the edge are removed, others move to v, corner list of u joins list of v
+			void Collapse(int u, int v)
+			{
+				int last = -1;
+				for (int c = first_corner[u]; c >= 0; c = next_corner[c])
+				{
+					int t = c / 3 * 3;
+					if (!triangle_removed[t / 3])
+					{
+						if (corners[t] == v || corners[t + 1] == v || corners[t + 2] == v)
+						{
+							triangle_removed[t / 3] = 1;
+							live_triangles--;
+						}
+						else
+							corners[c] = v;
+					}
+					last = c;
+				}
+				if (last >= 0)
+				{
+					next_corner[last] = first_corner[v];
+					first_corner[v] = first_corner[u];
+				}
+				first_corner[u] = -1;
+				vertex_removed[u] = 1;
+				quadrics[v] += quadrics[u];
+			}
+
+		public:
+			size_t live_triangles;
+
+			MeshSimplifier(Mesh& mesh, int _threads) : threads(_threads)
+			{
+				size_t n = mesh.VertexCount();
+				MeshStreamView pos = mesh.GetStreamView(MeshStreams::position);
+				positions.resize(n);
+				for (size_t i = 0; i < n; i++)
+					positions[i] = Vector3(pos[i][0], pos[i][1], pos[i][2]);
+				corners = mesh.GetTriangles();
+				size_t tri_count = corners.size() / 3;
+				corners.resize(tri_count * 3);
+
+				// degenerate triangles are removed first
+				triangle_removed.assign(tri_count, 0);
+				live_triangles = 0;
+				for (size_t t = 0; t < tri_count; t++)
+				{
+					int a = corners[t * 3], b = corners[t * 3 + 1], c = corners[t * 3 + 2];
+					triangle_removed[t] = (a == b || b == c || c == a) ? 1 : 0;
+					live_triangles += triangle_removed[t] ? 0 : 1;
+				}
+				first_corner.assign(n, -1);
+				next_corner.assign(tri_count * 3, -1);
+				for (size_t c = tri_count * 3; c-- > 0;)
+				{
+					if (triangle_removed[c / 3])
+						continue;
+					next_corner[c] = first_corner[corners[c]];
+					first_corner[corners[c]] = static_cast<int>(c);
+				}
+				vertex_removed.assign(n, 0);
+				touched.assign(n, 0);
+
+				// vertices sharing a position are on seams, they are locked
+				locked.assign(n, 0);
+				{
+					std::vector<int> order(n);
+					for (size_t i = 0; i < n; i++)
+						order[i] = static_cast<int>(i);
+					auto less = [&](int a, int b) {
+						const Vector3& p = positions[a], & q = positions[b];
+						return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+					};
+					std::sort(order.begin(), order.end(), less);
+					for (size_t i = 1; i < n; i++)
+					{
+						if (!less(order[i - 1], order[i]))
+							locked[order[i - 1]] = locked[order[i]] = 1;
+					}
+				}
+
+				// quadrics of planes of triangles around each vertex, weighted by area,
+				// and of planes through border edges perpendicular to their triangle, so borders keep their shape
+				// non-manifold vertices and vertices on more than two border edges are locked
+				quadrics.resize(n);
+				ParallelFor(n, 4096, [&](size_t begin, size_t end)
+					{
+						VertexRing ring;
+						for (size_t v = begin; v < end; v++)
+						{
+							Quadric& q = quadrics[v];
+							for (int c = first_corner[v]; c >= 0; c = next_corner[c])
+							{
+								int t = c / 3 * 3;
+								Vector3 p0 = positions[corners[t]], p1 = positions[corners[t + 1]], p2 = positions[corners[t + 2]];
+								Vector3 normal = VectorCross(p1 - p0, p2 - p0);
+								float length = VectorLength(normal);
+								if (length == 0)
+									continue;
+								normal = normal / length;
+								q.AddPlane(normal.x, normal.y, normal.z, -VectorDot(normal, p0), length * 0.5);
+							}
+							GetRing(static_cast<int>(v), ring);
+							int border_edges = 0;
+							for (auto& neighbor : ring)
+							{
+								if (neighbor.second > 2)
+									locked[v] = 1;
+								if (neighbor.second != 1)
+									continue;
+								border_edges++;
+								for (int c = first_corner[v]; c >= 0; c = next_corner[c])
+								{
+									int t = c / 3 * 3;
+									if (corners[t] != neighbor.first && corners[t + 1] != neighbor.first && corners[t + 2] != neighbor.first)
+										continue;
+									Vector3 p0 = positions[corners[t]], p1 = positions[corners[t + 1]], p2 = positions[corners[t + 2]];
+									Vector3 edge = positions[neighbor.first] - positions[v];
+									Vector3 normal = VectorNormalize(VectorCross(edge, VectorCross(p1 - p0, p2 - p0)));
+									q.AddPlane(normal.x, normal.y, normal.z, -VectorDot(normal, positions[v]), 2 * VectorDot(edge, edge));
+									break;
+								}
+							}
+							if (border_edges > 2)
+								locked[v] = 1;
+						}
+					}, threads);
+			}
+
+			// collapse until target or max error, return largest squared error of a collapse
+			// each pass finds the cheapest valid collapse of every vertex and does them in order of error, skipping
+			// those of vertices already changed in the pass, up to 1.5 times the error of the collapse that would reach target
+			float Run(size_t target_triangles, float max_error)
+			{
+				float done_error = 0;
+				float max_error2 = (max_error < FLT_MAX) ? max_error * max_error : FLT_MAX;
+				size_t n = positions.size();
+				std::vector<EdgeCollapse> candidates(n);
+				std::vector<EdgeCollapse> order;
+				// vertices whose candidate must be found again, they are near a collapse of the last pass
+				std::vector<uchar> dirty(n, 1);
+				while (live_triangles > target_triangles)
+				{
+					ParallelFor(n, 4096, [&](size_t begin, size_t end)
+						{
+							for (size_t v = begin; v < end; v++)
+							{
+								if (dirty[v])
+									PruneCorners(static_cast<int>(v));
+							}
+						}, threads);
+					ParallelFor(n, 4096, [&](size_t begin, size_t end)
+						{
+							VertexRing ring, ring_from, ring_to;
+							std::vector<EdgeCollapse> edges;
+							for (size_t v = begin; v < end; v++)
+							{
+								if (!dirty[v])
+									continue;
+								dirty[v] = 0;
+								candidates[v] = EdgeCollapse{ FLT_MAX, -1, -1 };
+								if (locked[v] || vertex_removed[v])
+									continue;
+								GetRing(static_cast<int>(v), ring);
+								edges.clear();
+								for (auto& neighbor : ring)
+									edges.push_back(EdgeCollapse{ CollapseError(static_cast<int>(v), neighbor.first), static_cast<int>(v), neighbor.first });
+								std::sort(edges.begin(), edges.end(), CollapseLess);
+								for (auto& e : edges)
+								{
+									if (CanCollapse(e.from, e.to, ring_from, ring_to))
+									{
+										candidates[v] = e;
+										break;
+									}
+								}
+							}
+						}, threads);
+
+					order.clear();
+					for (auto& e : candidates)
+					{
+						if (e.from >= 0 && e.error <= max_error2)
+							order.push_back(e);
+					}
+					if (order.empty())
+						break;
+					std::sort(order.begin(), order.end(), CollapseLess);
+					// a collapse removes two triangles, one on borders
+					size_t goal = (live_triangles - target_triangles + 1) / 2;
+					float pass_error = goal < order.size() ? order[goal].error * 1.5f : FLT_MAX;
+
+					size_t done = 0;
+					VertexRing ring_from, ring_to;
+					for (auto& e : order)
+					{
+						if (live_triangles <= target_triangles || e.error > pass_error)
+							break;
+						if (touched[e.from] || touched[e.to] || !CanCollapse(e.from, e.to, ring_from, ring_to))
+							continue;
+						Collapse(e.from, e.to);
+						touched[e.from] = touched[e.to] = 1;
+						dirty[e.from] = dirty[e.to] = 1;
+						for (auto& neighbor : ring_from)
+							dirty[neighbor.first] = 1;
+						for (auto& neighbor : ring_to)
+							dirty[neighbor.first] = 1;
+						done_error = Max(done_error, e.error);
+						done++;
+					}
+					for (auto& e : order)
+						touched[e.from] = touched[e.to] = 0;
+					if (done == 0)
+						break;
+				}
+				return done_error;
+			}
+
+			// live triangles with vertices renumbered by first use, old indices of vertices in order
+			void GetResult(std::vector<int>& triangles, std::vector<int>& order) const
+			{
+				std::vector<int> remap(positions.size(), -1);
+				triangles.clear();
+				triangles.reserve(live_triangles * 3);
+				order.clear();
+				for (size_t c = 0; c < corners.size(); c++)
+				{
+					if (triangle_removed[c / 3])
+						continue;
+					int v = corners[c];
+					if (remap[v] < 0)
+					{
+						remap[v] = static_cast<int>(order.size());
+						order.push_back(v);
+					}
+					triangles.push_back(remap[v]);
+				}
+			}
+		};
+	}
+
+	std::shared_ptr<Mesh> CreateSimplifiedMesh(Mesh& mesh, size_t target_triangles, float max_error, float* error, int threads)
+	{
+		if (threads <= 0)
+			threads = static_cast<int>(std::thread::hardware_concurrency());
+		MeshSimplifier simplifier(mesh, threads);
+		float done_error = simplifier.Run(target_triangles, max_error);
+		if (error)
+			*error = sqrtf(done_error);
+
+		std::vector<int> triangles, order;
+		simplifier.GetResult(triangles, order);
+		if (mesh.GetLayout() == MeshLayout::AoS)
+		{
+			std::vector<Vertex> vertices(order.size());
+			for (size_t i = 0; i < order.size(); i++)
+				vertices[i] = mesh.GetVertex(order[i]);
+			return std::make_shared<Mesh>(std::move(vertices), std::move(triangles));
+		}
+		auto result = std::make_shared<Mesh>();
+		result->SetStreams(GatherStream<Vector3>(mesh, MeshStreams::position, order), GatherStream<Vector3>(mesh, MeshStreams::normal, order),
+			GatherStream<Color>(mesh, MeshStreams::color, order), GatherStream<UV>(mesh, MeshStreams::uv, order), GatherStream<UV>(mesh, MeshStreams::uv2, order));
+		result->SetTriangles(std::move(triangles));
+		return result;
+	}
+
+	std::vector<MeshLod> CreateLodChain(std::shared_ptr<Mesh> mesh, const std::vector<float>& ratios)
+	{
+		std::vector<MeshLod> lods;
+		lods.push_back(MeshLod{ mesh, 0 });
+		size_t full = mesh->TriangleCount();
+		for (float ratio : ratios)
+		{
+			MeshLod& last = lods.back();
+			size_t target = static_cast<size_t>(full * Clamp(ratio, 0.0f, 1.0f));
+			if (target >= last.mesh->TriangleCount())
+				continue;
+			float error = 0;
+			auto lod = CreateSimplifiedMesh(*last.mesh, target, FLT_MAX, &error);
+			if (lod->TriangleCount() >= last.mesh->TriangleCount())
+				break;
+			lods.push_back(MeshLod{ lod, last.error + error });
+		}
+		return lods;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "mesh.h"
+#include <cfloat>
+
+// quadric error mesh simplification and LOD chains
+namespace Rehenz
+{
+	// one level of detail of a mesh
+	// error is how far the surface may have moved from the full mesh, in mesh units
+	struct MeshLod
+	{
+	public:
+		std::shared_ptr<Mesh> mesh;
+		float error;
+	};
+
+	// simplify by collapsing edges of least quadric error to one of their vertices, until there are at most
+	// target_triangles or the next collapse moves the surface more than max_error
+	// vertices keep their attributes, vertices sharing a position with others (uv, normal or color seams) are locked,
+	// so the mesh should be welded first, open borders only collapse along themselves
+	// collapses are done in passes of independent edges, quadrics and candidates of a pass are found by threads, 0 is hardware concurrency
+	// return simplified copy in layout of mesh, error is set to largest error of a collapse if it is not nullptr
+	std::shared_ptr<Mesh> CreateSimplifiedMesh(Mesh& mesh, size_t target_triangles, float max_error = FLT_MAX, float* error = nullptr, int threads = 0);
+
+	// LODs at ratios of triangle count of mesh, first LOD is mesh itself with error 0
+	// each LOD is simplified from the one before, its error is the sum of errors along the chain
+	// chain stops early if a LOD can not be simplified further
+	std::vector<MeshLod> CreateLodChain(std::shared_ptr<Mesh> mesh, const std::vector<float>& ratios = { 0.5f, 0.25f, 0.125f, 0.0625f });
+}
@@ -0,0 +1,294 @@
+#include "obj_file.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace Rehenz
+{
+	namespace
+	{
+		inline bool IsDigit(char c)
+		{
+			return c >= '0' && c <= '9';
+		}
+
+		inline bool IsSpace(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		inline const char* SkipSpace(const char* p, const char* end)
+		{
+			while (p < end && IsSpace(*p))
+				p++;
+			return p;
+		}
+
+		// parse integer with sign, return p if there is no digit
+		inline const char* ParseInt(const char* p, const char* end, int& value)
+		{
+			const char* start = p;
+			bool negative = false;
+			if (p < end && (*p == '-' || *p == '+'))
+				negative = (*p++ == '-');
+			if (p == end || !IsDigit(*p))
+				return start;
+			int x = 0;
+			while (p < end && IsDigit(*p))
+				x = x * 10 + (*p++ - '0');
+			value = negative ? -x : x;
+			return p;
+		}
+
+		// index in a chunk, resolved when counts of previous chunks are known
+		//   >= 0 : absolute 0-based index
+		//   -1   : missing or invalid
+		//   < -1 : relative index, index from chunk start - relative_bias, negative if it is in previous chunks
+		const int relative_bias = 1 << 30;
+
+		inline int ChunkIndex(int raw, size_t count)
+		{
+			if (raw > 0)
+				return raw - 1;
+			if (raw < 0)
+				return static_cast<int>(count) + raw - relative_bias;
+			return -1;
+		}
+
+		inline int ResolveIndex(int index, int base, size_t count)
+		{
+			if (index < -1)
+				index += base + relative_bias;
+			return (index >= 0 && static_cast<size_t>(index) < count) ? index : -1;
+		}
+
+		const char* ParseFloats(const char* p, const char* end, float* values, int n)
+		{
+			for (int i = 0; i < n; i++)
+				p = ParseFloat(SkipSpace(p, end), end, values[i]);
+			return p;
+		}
+
+		void ParseObjChunk(const char* p, const char* end, ObjData& data)
+		{
+			while (p < end)
+			{
+				const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+				if (eol == nullptr)
+					eol = end;
+				p = SkipSpace(p, eol);
+				if (eol - p >= 2 && p[0] == 'v' && IsSpace(p[1])) // pos
+				{
+					float v[3]{ 0,0,0 };
+					ParseFloats(p + 2, eol, v, 3);
+					data.positions.insert(data.positions.end(), v, v + 3);
+				}
+				else if (eol - p >= 3 && p[0] == 'v' && p[1] == 't' && IsSpace(p[2])) // uv
+				{
+					float v[2]{ 0,0 };
+					ParseFloats(p + 3, eol, v, 2);
+					data.uvs.insert(data.uvs.end(), v, v + 2);
+				}
+				else if (eol - p >= 3 && p[0] == 'v' && p[1] == 'n' && IsSpace(p[2])) // normal
+				{
+					float v[3]{ 0,0,0 };
+					ParseFloats(p + 3, eol, v, 3);
+					data.normals.insert(data.normals.end(), v, v + 3);
+				}
+				else if (eol - p >= 2 && p[0] == 'f' && IsSpace(p[1])) // face
+				{
+					size_t v_count = data.positions.size() / 3, vt_count = data.uvs.size() / 2, vn_count = data.normals.size() / 3;
+					int first[3], prev[3], cur[3];
+					int n = 0;
+					const char* q = p + 2;
+					while (true)
+					{
+						q = SkipSpace(q, eol);
+						int raw = 0;
+						const char* next = ParseInt(q, eol, raw);
+						if (next == q)
+							break;
+						q = next;
+						cur[0] = ChunkIndex(raw, v_count);
+						cur[1] = cur[2] = -1;
+						for (int j = 1; j < 3 && q < eol && *q == '/'; j++)
+						{
+							raw = 0;
+							q = ParseInt(q + 1, eol, raw);
+							cur[j] = ChunkIndex(raw, j == 1 ? vt_count : vn_count);
+						}
+						if (n == 0)
+							memcpy(first, cur, sizeof(cur));
+						else if (n >= 2)
+						{
+							data.corners.insert(data.corners.end(), first, first + 3);
+							data.corners.insert(data.corners.end(), prev, prev + 3);
+							data.corners.insert(data.corners.end(), cur, cur + 3);
+						}
+						memcpy(prev, cur, sizeof(cur));
+						n++;
+					}
+				}
+				// comments, materials, groups and others are ignored
+				p = eol + 1;
+			}
+		}
+
+		// copy corners of a chunk to dst with resolved indices, drop triangles without position
+		// return number of ints written
+		size_t ResolveCorners(const std::vector<int>& src, int* dst, const int base[3], const size_t count[3])
+		{
+			int* out = dst;
+			for (size_t i = 0; i < src.size(); i += 9)
+			{
+				for (int j = 0; j < 9; j++)
+					out[j] = ResolveIndex(src[i + j], base[j % 3], count[j % 3]);
+				if (out[0] >= 0 && out[3] >= 0 && out[6] >= 0)
+					out += 9;
+			}
+			return out - dst;
+		}
+	}
+
+	const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		// exact powers of 10 in double
+		static const double pow10[23]{ 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = (*p++ == '-');
+
+		// keep 19 significant digits in mantissa, drop the rest
+		ullong mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false;
+		for (; p < end && IsDigit(*p); p++, any = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += (mantissa != 0);
+			}
+			else
+				exponent++;
+		}
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && IsDigit(*p); p++, any = true)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					digits += (mantissa != 0);
+					exponent--;
+				}
+			}
+		}
+		if (!any)
+			return start;
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			int e = 0;
+			const char* next = ParseInt(p + 1, end, e);
+			if (next != p + 1)
+			{
+				exponent += std::min(std::max(e, -400), 400);
+				p = next;
+			}
+		}
+
+		double x = static_cast<double>(mantissa);
+		if (exponent < 0)
+			x = (exponent >= -22) ? x / pow10[-exponent] : x / std::pow(10.0, -exponent);
+		else if (exponent > 0)
+			x = (exponent <= 22) ? x * pow10[exponent] : x * std::pow(10.0, exponent);
+		value = static_cast<float>(negative ? -x : x);
+		return p;
+	}
+
+	void ParseObj(const char* text, size_t size, ObjData& data, int threads)
+	{
+		// at least 1MB per chunk, threads cost more than they save for small files
+		const size_t min_chunk = 1 << 20;
+		if (threads <= 0)
+			threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		int chunk_count = static_cast<int>(std::min(std::max<size_t>(size / min_chunk, 1), static_cast<size_t>(threads)));
+
+		// split on line boundaries
+		std::vector<const char*> bounds(chunk_count + 1);
+		bounds[0] = text;
+		bounds[chunk_count] = text + size;
+		for (int i = 1; i < chunk_count; i++)
+		{
+			const char* p = text + size / chunk_count * i;
+			const char* eol = static_cast<const char*>(memchr(p, '\n', text + size - p));
+			bounds[i] = std::max(bounds[i - 1], eol ? eol + 1 : text + size);
+		}
+
+		std::vector<ObjData> chunks(chunk_count);
+		std::vector<std::thread> workers;
+		for (int i = 1; i < chunk_count; i++)
+			workers.emplace_back(ParseObjChunk, bounds[i], bounds[i + 1], std::ref(chunks[i]));
+		ParseObjChunk(bounds[0], bounds[1], chunks[0]);
+		for (auto& t : workers)
+			t.join();
+		workers.clear();
+
+		// merge chunks, relative indices are fixed with counts of previous chunks
+		std::vector<size_t> pos_offset(chunk_count + 1), uv_offset(chunk_count + 1), normal_offset(chunk_count + 1), corner_offset(chunk_count + 1);
+		for (int i = 0; i < chunk_count; i++)
+		{
+			pos_offset[i + 1] = pos_offset[i] + chunks[i].positions.size();
+			uv_offset[i + 1] = uv_offset[i] + chunks[i].uvs.size();
+			normal_offset[i + 1] = normal_offset[i] + chunks[i].normals.size();
+			corner_offset[i + 1] = corner_offset[i] + chunks[i].corners.size();
+		}
+		const size_t count[3]{ pos_offset[chunk_count] / 3, uv_offset[chunk_count] / 2, normal_offset[chunk_count] / 3 };
+		data.positions.resize(pos_offset[chunk_count]);
+		data.uvs.resize(uv_offset[chunk_count]);
+		data.normals.resize(normal_offset[chunk_count]);
+		data.corners.resize(corner_offset[chunk_count]);
+		std::vector<size_t> written(chunk_count);
+		auto merge = [&](int i)
+		{
+			ObjData& chunk = chunks[i];
+			if (!chunk.positions.empty())
+				memcpy(&data.positions[pos_offset[i]], &chunk.positions[0], chunk.positions.size() * sizeof(float));
+			if (!chunk.uvs.empty())
+				memcpy(&data.uvs[uv_offset[i]], &chunk.uvs[0], chunk.uvs.size() * sizeof(float));
+			if (!chunk.normals.empty())
+				memcpy(&data.normals[normal_offset[i]], &chunk.normals[0], chunk.normals.size() * sizeof(float));
+			const int base[3]{ static_cast<int>(pos_offset[i] / 3), static_cast<int>(uv_offset[i] / 2), static_cast<int>(normal_offset[i] / 3) };
+			written[i] = chunk.corners.empty() ? 0 : ResolveCorners(chunk.corners, &data.corners[corner_offset[i]], base, count);
+		};
+		for (int i = 1; i < chunk_count; i++)
+			workers.emplace_back(merge, i);
+		merge(0);
+		for (auto& t : workers)
+			t.join();
+
+		// close gaps of dropped triangles
+		size_t corner_end = written[0];
+		for (int i = 1; i < chunk_count; i++)
+		{
+			if (corner_end != corner_offset[i] && written[i] != 0)
+				memmove(&data.corners[corner_end], &data.corners[corner_offset[i]], written[i] * sizeof(int));
+			corner_end += written[i];
+		}
+		data.corners.resize(corner_end);
+	}
+
+	bool ReadObjFile(const std::string& filename, ObjData& data, int threads)
+	{
+		MappedFile file(filename);
+		if (file.Data() == nullptr)
+			return false;
+		ParseObj(file.Data(), file.Size(), data, threads);
+		return true;
+	}
+}
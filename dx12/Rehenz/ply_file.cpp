@@ -0,0 +1,437 @@
+#include "ply_file.h"
+#include "mapped_file.h"
+#include "util.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace Rehenz
+{
+	namespace
+	{
+		enum class PlyType { None, Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64 };
+
+		struct PlyProperty
+		{
+		public:
+			std::string name;
+			PlyType type;
+			// type of list length, None if property is not a list
+			PlyType count_type;
+			// offset in record, only for elements without lists
+			size_t offset;
+		};
+
+		struct PlyElement
+		{
+		public:
+			std::string name;
+			size_t count;
+			std::vector<PlyProperty> properties;
+			bool has_list;
+			// record size in bytes, only for elements without lists
+			size_t size;
+
+			int FindProperty(const char* _name) const
+			{
+				for (size_t i = 0; i < properties.size(); i++)
+				{
+					if (properties[i].name == _name)
+						return static_cast<int>(i);
+				}
+				return -1;
+			}
+		};
+
+		// records of face element between two offsets, decoded by one thread
+		struct PlyFaceChunk
+		{
+		public:
+			const uchar* data;
+			size_t count;
+			// first triangle of chunk in mesh
+			size_t triangle_offset;
+		};
+
+		PlyType ParsePlyType(const std::string& s)
+		{
+			if (s == "char" || s == "int8")
+				return PlyType::Int8;
+			if (s == "uchar" || s == "uint8")
+				return PlyType::Uint8;
+			if (s == "short" || s == "int16")
+				return PlyType::Int16;
+			if (s == "ushort" || s == "uint16")
+				return PlyType::Uint16;
+			if (s == "int" || s == "int32")
+				return PlyType::Int32;
+			if (s == "uint" || s == "uint32")
+				return PlyType::Uint32;
+			if (s == "float" || s == "float32")
+				return PlyType::Float32;
+			if (s == "double" || s == "float64")
+				return PlyType::Float64;
+			return PlyType::None;
+		}
+
+		inline size_t PlyTypeSize(PlyType type)
+		{
+			switch (type)
+			{
+			case PlyType::Int8: case PlyType::Uint8: return 1;
+			case PlyType::Int16: case PlyType::Uint16: return 2;
+			case PlyType::Int32: case PlyType::Uint32: case PlyType::Float32: return 4;
+			case PlyType::Float64: return 8;
+			default: return 0;
+			}
+		}
+
+		// value at p, bytes are reversed if file endian differs from machine
+		inline double ReadPlyValue(const uchar* p, PlyType type, bool swap)
+		{
+			uchar b[8];
+			size_t size = PlyTypeSize(type);
+			if (swap)
+			{
+				for (size_t i = 0; i < size; i++)
+					b[i] = p[size - 1 - i];
+			}
+			else
+				memcpy(b, p, size);
+			switch (type)
+			{
+			case PlyType::Int8: return static_cast<signed char>(b[0]);
+			case PlyType::Uint8: return b[0];
+			case PlyType::Int16: { short x; memcpy(&x, b, 2); return x; }
+			case PlyType::Uint16: { unsigned short x; memcpy(&x, b, 2); return x; }
+			case PlyType::Int32: { int x; memcpy(&x, b, 4); return x; }
+			case PlyType::Uint32: { uint x; memcpy(&x, b, 4); return x; }
+			case PlyType::Float32: { float x; memcpy(&x, b, 4); return x; }
+			case PlyType::Float64: { double x; memcpy(&x, b, 8); return x; }
+			default: return 0;
+			}
+		}
+
+		// integer colors are mapped to [0,1] by max value of type
+		inline float PlyColorScale(PlyType type)
+		{
+			switch (type)
+			{
+			case PlyType::Int8: return 1 / 127.0f;
+			case PlyType::Uint8: return 1 / 255.0f;
+			case PlyType::Int16: return 1 / 32767.0f;
+			case PlyType::Uint16: return 1 / 65535.0f;
+			case PlyType::Int32: return 1 / 2147483647.0f;
+			case PlyType::Uint32: return 1 / 4294967295.0f;
+			default: return 1;
+			}
+		}
+
+		// size of record at p, 0 if record does not end before end
+		size_t PlyRecordSize(const PlyElement& element, const uchar* p, const uchar* end, bool swap)
+		{
+			if (!element.has_list)
+				return static_cast<size_t>(end - p) >= element.size ? element.size : 0;
+			const uchar* q = p;
+			for (auto& property : element.properties)
+			{
+				size_t size = PlyTypeSize(property.type);
+				if (property.count_type != PlyType::None)
+				{
+					size_t count_size = PlyTypeSize(property.count_type);
+					if (static_cast<size_t>(end - q) < count_size)
+						return 0;
+					double n = ReadPlyValue(q, property.count_type, swap);
+					if (n < 0)
+						return 0;
+					q += count_size;
+					size *= static_cast<size_t>(n);
+				}
+				if (static_cast<size_t>(end - q) < size)
+					return 0;
+				q += size;
+			}
+			return static_cast<size_t>(q - p);
+		}
+
+		// position after property at p, record must be checked by PlyRecordSize
+		inline const uchar* SkipPlyProperty(const PlyProperty& property, const uchar* p, bool swap)
+		{
+			if (property.count_type == PlyType::None)
+				return p + PlyTypeSize(property.type);
+			size_t n = static_cast<size_t>(ReadPlyValue(p, property.count_type, swap));
+			return p + PlyTypeSize(property.count_type) + n * PlyTypeSize(property.type);
+		}
+
+		// parse header up to end_header, return offset of binary data, 0 if header is invalid or ascii
+		size_t ParsePlyHeader(const char* data, size_t size, std::vector<PlyElement>& elements, bool& swap)
+		{
+			const uint one = 1;
+			bool little_machine = *reinterpret_cast<const uchar*>(&one) == 1;
+			bool format = false;
+			size_t pos = 0;
+			for (int line = 0; pos < size; line++)
+			{
+				const char* begin = data + pos;
+				const char* end = static_cast<const char*>(memchr(begin, '\n', size - pos));
+				if (end == nullptr)
+					return 0;
+				pos = end - data + 1;
+
+				std::vector<std::string> words;
+				for (const char* p = begin; p < end;)
+				{
+					while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+						p++;
+					const char* word = p;
+					while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+						p++;
+					if (p > word)
+						words.emplace_back(word, p);
+				}
+
+				if (line == 0)
+				{
+					if (words.size() != 1 || words[0] != "ply")
+						return 0;
+				}
+				else if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+					continue;
+				else if (words[0] == "format")
+				{
+					if (words.size() < 2 || (words[1] != "binary_little_endian" && words[1] != "binary_big_endian"))
+						return 0;
+					swap = (words[1] == "binary_little_endian") != little_machine;
+					format = true;
+				}
+				else if (words[0] == "element")
+				{
+					if (words.size() != 3)
+						return 0;
+					char* count_end = nullptr;
+					ullong count = strtoull(words[2].c_str(), &count_end, 10);
+					if (*count_end != 0)
+						return 0;
+					elements.push_back(PlyElement{ words[1], static_cast<size_t>(count), {}, false, 0 });
+				}
+				else if (words[0] == "property")
+				{
+					if (elements.empty())
+						return 0;
+					PlyProperty property{};
+					if (words.size() == 5 && words[1] == "list")
+					{
+						property.count_type = ParsePlyType(words[2]);
+						property.type = ParsePlyType(words[3]);
+						property.name = words[4];
+						if (property.count_type == PlyType::None || property.count_type == PlyType::Float32 || property.count_type == PlyType::Float64)
+							return 0;
+						elements.back().has_list = true;
+					}
+					else if (words.size() == 3)
+					{
+						property.type = ParsePlyType(words[1]);
+						property.count_type = PlyType::None;
+						property.name = words[2];
+					}
+					if (property.type == PlyType::None)
+						return 0;
+					property.offset = elements.back().size;
+					elements.back().size += PlyTypeSize(property.type);
+					elements.back().properties.push_back(property);
+				}
+				else if (words[0] == "end_header")
+					return format ? pos : 0;
+			}
+			return 0;
+		}
+
+		// decode fixed size vertex records to streams
+		bool ReadPlyVertices(const PlyElement& element, const uchar* data, bool swap, int threads,
+			std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<Color>& colors, std::vector<UV>& uvs)
+		{
+			const char* names[12]{ "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue", "alpha", "u", "v" };
+			int index[12];
+			for (int i = 0; i < 12; i++)
+				index[i] = element.FindProperty(names[i]);
+			const char* uv_names[3][2]{ { "s", "t" }, { "texture_u", "texture_v" }, { "texture_s", "texture_t" } };
+			for (int k = 0; k < 3 && (index[10] < 0 || index[11] < 0); k++)
+				index[10] = element.FindProperty(uv_names[k][0]), index[11] = element.FindProperty(uv_names[k][1]);
+			if (index[0] < 0 || index[1] < 0 || index[2] < 0)
+				return false;
+			bool has_normal = index[3] >= 0 && index[4] >= 0 && index[5] >= 0;
+			bool has_color = index[6] >= 0 && index[7] >= 0 && index[8] >= 0;
+			bool has_uv = index[10] >= 0 && index[11] >= 0;
+
+			size_t n = element.count;
+			positions.resize(n);
+			normals.resize(has_normal ? n : 0);
+			colors.resize(has_color ? n : 0);
+			uvs.resize(has_uv ? n : 0);
+			auto read = [&](const uchar* record, int i) {
+				const PlyProperty& property = element.properties[index[i]];
+				return static_cast<float>(ReadPlyValue(record + property.offset, property.type, swap));
+			};
+			float color_scale[4]{};
+			for (int c = 0; c < 4; c++)
+				color_scale[c] = (index[6 + c] >= 0) ? PlyColorScale(element.properties[index[6 + c]].type) : 1;
+			ParallelFor(n, 16384, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						const uchar* record = data + i * element.size;
+						positions[i] = Vector3(read(record, 0), read(record, 1), read(record, 2));
+						if (has_normal)
+							normals[i] = Vector3(read(record, 3), read(record, 4), read(record, 5));
+						if (has_color)
+							colors[i] = Color(read(record, 6) * color_scale[0], read(record, 7) * color_scale[1], read(record, 8) * color_scale[2],
+								(index[9] >= 0) ? read(record, 9) * color_scale[3] : 1.0f);
+						if (has_uv)
+							uvs[i] = UV(read(record, 10), read(record, 11));
+					}
+				}, threads);
+			return true;
+		}
+	}
+
+	std::shared_ptr<Mesh> CreateMeshFromPlyFile(const std::string& filename, int threads)
+	{
+		MappedFile file(filename);
+		if (file.Data() == nullptr)
+			return nullptr;
+		std::vector<PlyElement> elements;
+		bool swap = false;
+		size_t header_size = ParsePlyHeader(file.Data(), file.Size(), elements, swap);
+		if (header_size == 0)
+			return nullptr;
+		const uchar* p = reinterpret_cast<const uchar*>(file.Data()) + header_size;
+		const uchar* end = reinterpret_cast<const uchar*>(file.Data()) + file.Size();
+
+		// vertices are decoded in place, face records are split to chunks by a serial scan of list lengths
+		const size_t chunk_size = 65536;
+		std::vector<Vector3> positions, normals;
+		std::vector<Color> colors;
+		std::vector<UV> uvs;
+		bool has_vertex = false;
+		const PlyElement* face = nullptr;
+		int list_index = -1;
+		std::vector<PlyFaceChunk> chunks;
+		size_t triangle_count = 0;
+		for (auto& element : elements)
+		{
+			if (element.name == "vertex" && !has_vertex && !element.has_list && element.size > 0)
+			{
+				if (element.count > static_cast<size_t>(end - p) / element.size || element.count > 0x7fffffff)
+					return nullptr;
+				if (!ReadPlyVertices(element, p, swap, threads, positions, normals, colors, uvs))
+					return nullptr;
+				has_vertex = true;
+				p += element.count * element.size;
+				continue;
+			}
+			if (element.name == "face" && face == nullptr)
+			{
+				face = &element;
+				list_index = element.FindProperty("vertex_indices");
+				if (list_index < 0)
+					list_index = element.FindProperty("vertex_index");
+				if (list_index >= 0 && element.properties[list_index].count_type == PlyType::None)
+					list_index = -1;
+			}
+			if (!element.has_list && element.size > 0)
+			{
+				if (element.count > static_cast<size_t>(end - p) / element.size)
+					return nullptr;
+				p += element.count * element.size;
+				continue;
+			}
+			bool split = (&element == face && list_index >= 0);
+			const PlyProperty* list = split ? &element.properties[list_index] : nullptr;
+			for (size_t i = 0; i < element.count; i++)
+			{
+				if (split && i % chunk_size == 0)
+					chunks.push_back(PlyFaceChunk{ p, Min(chunk_size, element.count - i), triangle_count });
+				size_t size = PlyRecordSize(element, p, end, swap);
+				if (size == 0)
+					return nullptr;
+				if (split)
+				{
+					const uchar* q = p;
+					for (int k = 0; k < list_index; k++)
+						q = SkipPlyProperty(element.properties[k], q, swap);
+					double n = ReadPlyValue(q, list->count_type, swap);
+					triangle_count += (n > 2) ? static_cast<size_t>(n) - 2 : 0;
+				}
+				p += size;
+			}
+		}
+		if (!has_vertex)
+			return nullptr;
+
+		// fan triangles of each chunk, triangles with an index out of range are marked and removed after
+		std::vector<int> triangles(triangle_count * 3);
+		std::vector<uchar> chunk_broken(chunks.size(), 0);
+		size_t vertex_count = positions.size();
+		ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end_chunk)
+			{
+				for (size_t c = begin; c < end_chunk; c++)
+				{
+					const uchar* q = chunks[c].data;
+					int* dst = triangles.empty() ? nullptr : &triangles[chunks[c].triangle_offset * 3];
+					for (size_t f = 0; f < chunks[c].count; f++)
+					{
+						for (int k = 0; k < static_cast<int>(face->properties.size()); k++)
+						{
+							const PlyProperty& property = face->properties[k];
+							if (k != list_index)
+							{
+								q = SkipPlyProperty(property, q, swap);
+								continue;
+							}
+							size_t value_size = PlyTypeSize(property.type);
+							size_t n = static_cast<size_t>(ReadPlyValue(q, property.count_type, swap));
+							q += PlyTypeSize(property.count_type);
+							if (n > 2)
+							{
+								llong i0 = static_cast<llong>(ReadPlyValue(q, property.type, swap));
+								llong i1 = static_cast<llong>(ReadPlyValue(q + value_size, property.type, swap));
+								for (size_t t = 2; t < n; t++)
+								{
+									llong i2 = static_cast<llong>(ReadPlyValue(q + t * value_size, property.type, swap));
+									bool valid = i0 >= 0 && i1 >= 0 && i2 >= 0
+										&& static_cast<ullong>(i0) < vertex_count && static_cast<ullong>(i1) < vertex_count && static_cast<ullong>(i2) < vertex_count;
+									dst[0] = valid ? static_cast<int>(i0) : -1;
+									dst[1] = valid ? static_cast<int>(i1) : -1;
+									dst[2] = valid ? static_cast<int>(i2) : -1;
+									chunk_broken[c] |= valid ? 0 : 1;
+									dst += 3;
+									i1 = i2;
+								}
+							}
+							q += n * value_size;
+						}
+					}
+				}
+			}, threads);
+		bool broken = false;
+		for (auto b : chunk_broken)
+			broken = broken || b != 0;
+		if (broken)
+		{
+			size_t kept = 0;
+			for (size_t i = 0; i < triangles.size(); i += 3)
+			{
+				if (triangles[i] < 0)
+					continue;
+				triangles[kept++] = triangles[i];
+				triangles[kept++] = triangles[i + 1];
+				triangles[kept++] = triangles[i + 2];
+			}
+			triangles.resize(kept);
+		}
+
+		auto mesh = std::make_shared<Mesh>();
+		mesh->SetStreams(std::move(positions), std::move(normals), std::move(colors), std::move(uvs), std::vector<UV>());
+		mesh->SetTriangles(std::move(triangles));
+		return mesh;
+	}
+}
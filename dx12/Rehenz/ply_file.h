@@ -0,0 +1,13 @@
+#pragma once
+#include "mesh.h"
+
+// binary .ply (little or big endian) mesh loading, ascii .ply is not supported
+namespace Rehenz
+{
+	// vertex properties go to SoA streams :
+	//   x y z, nx ny nz, red green blue alpha, u v (or s t, texture_u texture_v)
+	// integer colors are mapped to [0,1], faces are triangulated as fans, other elements are skipped
+	// the file is memory-mapped, vertex and face records are decoded by threads, 0 is hardware concurrency
+	// return nullptr if file can not be opened or is not a binary .ply with vertex positions
+	std::shared_ptr<Mesh> CreateMeshFromPlyFile(const std::string& filename, int threads = 0);
+}
@@ -2,110 +2,502 @@
 #include "drawer.h"
 #include "clipper.h"
 #include <algorithm>
+#include <cstring>
+#include <cassert>
 
 namespace Rehenz
 {
-	// Core Function
-	const uint* Camera::RenderImage(RenderScene& scene)
+	PixelShader ShadowPixelShader = [](const PixelShaderData& data, const Vertex& v0)->Color
 	{
-		// prepare drawer
-		int size = height * width;
-		auto zbuffer = std::make_unique<float[]>(size);
-		std::fill(zbuffer.get(), zbuffer.get() + size, 1.0f);
-		std::fill(buffer, buffer + size, 0U);
-		DrawerV drawer(buffer, width, height, zbuffer.get());
-		DrawerF drawerf(buffer, width, height);
-		// prepare shader data
-		VertexShaderData vshader_data;
-		PixelShaderData pshader_data;
-		vshader_data.mat_view = transform.GetInverseTransformMatrix();
-		vshader_data.mat_project = projection.GetTransformMatrix();
-		// traverse objects
-		for (auto pobj = scene.GetRenderObject(); pobj; pobj = scene.GetRenderObject(pobj))
+		Color c = (data.texture != nullptr) ? data.texture->GetColor(v0.uv) : v0.c;
+		if (data.shadow_map == nullptr)
+			return c;
+		float light = data.shadow_map->GetLightPCF(v0.p * data.mat_shadow);
+		return c * Color(0.4f + 0.6f * light, 0.4f + 0.6f * light, 0.4f + 0.6f * light, 1);
+	};
+
+	// map float to uint which keeps order
+	inline uint FloatSortKey(float f)
+	{
+		uint u;
+		std::memcpy(&u, &f, sizeof(u));
+		return (u & 0x80000000U) ? ~u : (u | 0x80000000U);
+	}
+
+	// sort values by keys ascending, stable, 4 passes of 8 bits
+	template <typename T>
+	void RadixSort(std::vector<uint>& keys, std::vector<T>& values)
+	{
+		std::vector<uint> keys2(keys.size());
+		std::vector<T> values2(values.size());
+		for (int shift = 0; shift < 32; shift += 8)
 		{
-			// Copy and transform vertices (vertex shader)
-			vshader_data.mat_world = pobj->transform.GetTransformMatrix();
-			vshader_data.transform = vshader_data.mat_world * vshader_data.mat_view * vshader_data.mat_project;
-			auto& vs_mesh = pobj->pmesh->GetVertices();
-			std::vector<Vertex> vertices;
-			for (auto& v : vs_mesh)
+			size_t offset[257]{};
+			for (uint key : keys)
+				offset[((key >> shift) & 0xff) + 1]++;
+			for (int i = 0; i < 256; i++)
+				offset[i + 1] += offset[i];
+			for (size_t i = 0; i < keys.size(); i++)
 			{
-				vertices.push_back(vertex_shader(vshader_data, v));
+				size_t j = offset[(keys[i] >> shift) & 0xff]++;
+				keys2[j] = keys[i];
+				values2[j] = values[i];
 			}
+			keys.swap(keys2);
+			values.swap(values2);
+		}
+	}
 
-			// Clipping and back-face culling
-			auto& tris_mesh = pobj->pmesh->GetTriangles();
-			std::vector<int> triangles;
-			Point origin = projection.GetOrigin();
-			for (size_t i = 0; i < tris_mesh.size(); i += 3)
+	// convert image of Camera (0x00rrggbb, rows are packed) to target
+	void ConvertImage(const uint* image, int width, int height, const RenderTarget& target)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const uint* src = image + y * width;
+			byte* dst = static_cast<byte*>(target.data) + static_cast<size_t>(y) * target.stride;
+			switch (target.format)
 			{
-				int a = tris_mesh[i], b = tris_mesh[i + 1], c = tris_mesh[i + 2];
-				Vertex& va = vertices[a], & vb = vertices[b], & vc = vertices[c];
-
-				auto sight = va.p - origin;
-				auto normal = TrianglesNormal(va.p, vb.p, vc.p);
-				auto dot_sight_normal = VectorDot(sight, normal);
-
-				if (dot_sight_normal < 0) // judge back-face
+			case RenderTarget::Format::BGRA8:
+				std::memcpy(dst, src, width * sizeof(uint));
+				break;
+			case RenderTarget::Format::RGBA8:
+				for (int x = 0; x < width; x++)
 				{
-					if (ClipPointInside(va.p) && ClipPointInside(vb.p) && ClipPointInside(vc.p))
-					{
-						triangles.push_back(a); triangles.push_back(b); triangles.push_back(c);
-					}
-					else // clipping
-					{
-						ClipTriangleCohenSutherland(vertices, triangles, a, b, c);
-					}
+					uint c = src[x];
+					uint u = ((c >> 16) & 0xff) | (c & 0xff00) | ((c & 0xff) << 16);
+					std::memcpy(dst + x * 4, &u, 4);
 				}
+				break;
+			case RenderTarget::Format::RGB565:
+				for (int x = 0; x < width; x++)
+				{
+					uint c = src[x];
+					word u = static_cast<word>(((c >> 8) & 0xf800) | ((c >> 5) & 0x07e0) | ((c >> 3) & 0x001f));
+					std::memcpy(dst + x * 2, &u, 2);
+				}
+				break;
+			case RenderTarget::Format::Float:
+				for (int x = 0; x < width; x++)
+				{
+					uint c = src[x];
+					float f[4]{ ((c >> 16) & 0xff) / 255.0f, ((c >> 8) & 0xff) / 255.0f, (c & 0xff) / 255.0f, 1.0f };
+					std::memcpy(dst + x * 16, f, 16);
+				}
+				break;
 			}
+		}
+	}
+
+	// draw meshes by position only, for shadow map and depth pre-pass
+	class DepthRenderer
+	{
+	private:
+		DrawerZ drawer;
+		const int width;
+		const int height;
+		bool z_reversed;
+		std::vector<Point> points;
+		std::vector<Vertex> clip_vertices;
+		std::vector<int> clip_triangles;
+
+		// (-1,-1) -> (0,h), (1,1) -> (w,0), same with Camera
+		inline void MapToScreen(Point& p)
+		{
+			p *= 1 / p.w;
+			p.x = (p.x + 1) * width / 2;
+			p.y = (-p.y + 1) * height / 2;
+		}
+
+	public:
+		DepthRenderer(DepthBuffer zbuffer, int _width, int _height)
+			: drawer(zbuffer, _width, _height), width(_width), height(_height), z_reversed(false) {}
+
+		inline void SetTileClear(TileClear* tile_clear) { drawer.SetTileClear(tile_clear); }
+		// for reversed-z projection, also flips back-face culling
+		inline void SetZReversed(bool _z_reversed) { z_reversed = _z_reversed; drawer.SetZReversed(_z_reversed); }
 
-			// Mapping to screen
-			for (auto& v : vertices)
+		void Clear()
+		{
+			drawer.FillZ(z_reversed ? 0.0f : 1.0f);
+		}
+
+		// transform must be same with vertex shader to get same z
+		// if cull, back faces are culled like Camera with origin
+		void Draw(Mesh& mesh, const Matrix& transform, bool cull, Point origin)
+		{
+			// only positions are read, SoA mesh keeps them in a dense stream
+			MeshStreamView vs_pos = mesh.GetStreamView(MeshStreams::position);
+			points.resize(mesh.VertexCount());
+			for (size_t i = 0; i < points.size(); i++)
 			{
-				// (-1,-1) -> (0,h), (1,1) -> (w,0)
-				v *= 1 / v.p.w;
-				v.p.x = (v.p.x + 1) * width / 2;
-				v.p.y = (-v.p.y + 1) * height / 2;
+				const float* p = vs_pos[i];
+				points[i] = Point(p[0], p[1], p[2]) * transform;
 			}
 
-			// Traverse all triangles and sampling
-			// Compute color for all sampling points (pixel shader)
-			// Use z-buffer merge multiple colors
-			pshader_data.texture = pobj->texture;
-			pshader_data.texture2 = pobj->texture2;
-			for (size_t i = 0; i < triangles.size(); i += 3)
+			auto& tris_mesh = mesh.GetTriangles();
+			for (size_t i = 0; i < tris_mesh.size(); i += 3)
 			{
-				int a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
-				Vertex& va = vertices[a], & vb = vertices[b], & vc = vertices[c];
-				Point& pa = va.p, & pb = vb.p, & pc = vc.p;
-				if (render_mode == RenderMode::Wireframe)
+				Point pa = points[tris_mesh[i]], pb = points[tris_mesh[i + 1]], pc = points[tris_mesh[i + 2]];
+				if (cull && (VectorDot(pa - origin, TrianglesNormal(pa, pb, pc)) < 0) == z_reversed)
+					continue;
+				if (ClipPointInside(pa) && ClipPointInside(pb) && ClipPointInside(pc))
 				{
-					drawerf.Line(pa, pb, drawerf.white);
-					drawerf.Line(pa, pc, drawerf.white);
-					drawerf.Line(pb, pc, drawerf.white);
+					MapToScreen(pa); MapToScreen(pb); MapToScreen(pc);
+					drawer.Triangle(pa, pb, pc);
 				}
-				else if (render_mode == RenderMode::PureWhite)
+				else // clipping, only few triangles get here
 				{
-					drawerf.Triangle(pa, pb, pc, drawerf.white);
+					clip_vertices.clear();
+					clip_triangles.clear();
+					clip_vertices.emplace_back(pa); clip_vertices.emplace_back(pb); clip_vertices.emplace_back(pc);
+					ClipTriangleCohenSutherland(clip_vertices, clip_triangles, 0, 1, 2);
+					for (auto& v : clip_vertices)
+						MapToScreen(v.p);
+					for (size_t j = 0; j < clip_triangles.size(); j += 3)
+						drawer.Triangle(clip_vertices[clip_triangles[j]].p, clip_vertices[clip_triangles[j + 1]].p, clip_vertices[clip_triangles[j + 2]].p);
 				}
-				/*else if (render_mode == RenderMode::FlatColor)
+			}
+		}
+	};
+
+	int Camera::SelectLod(RenderObject* pobj, const Matrix& mat_view, int lod)
+	{
+		int count = static_cast<int>(pobj->lods.size());
+		lod = Clamp(lod, 0, count - 1);
+
+		// bounding sphere of finest LOD, radius is scaled by largest axis scale
+		Point pmin, pmax;
+		pobj->lods[0].mesh->GetBounds(pmin, pmax);
+		Point center = (pmin + pmax) * 0.5f;
+		center.w = 1;
+		Vector& s = pobj->transform.scale;
+		float scale = Max(Max(fabsf(s.x), fabsf(s.y)), fabsf(s.z));
+		float radius = VectorLength(pmax - pmin) * 0.5f * scale;
+		float z = (center * pobj->transform.GetTransformMatrix() * mat_view).z;
+		if (z <= radius)
+			return 0;
+
+		// screen pixels per unit of mesh at center, error limit in units of mesh
+		float pixels = height * 0.5f / (tanf(projection.fovy * 0.5f) * z) * scale;
+		float limit = lod_pixel_error * exp2f(lod_bias) / pixels;
+		while (lod > 0 && pobj->lods[lod].error > limit)
+			lod--;
+		while (lod + 1 < count && pobj->lods[lod + 1].error <= limit * (1 - lod_hysteresis))
+			lod++;
+		return lod;
+	}
+
+	Mesh& Camera::GetObjectMesh(RenderObject* pobj)
+	{
+		auto it = lod_levels.find(pobj);
+		return pobj->GetMesh(it == lod_levels.end() ? 0 : it->second);
+	}
+
+	void Camera::DrawObject(RenderObject* pobj, DrawerV& drawer, DrawerF& drawerf,
+		VertexShaderData& vshader_data, PixelShaderData& pshader_data)
+	{
+		// Copy and transform vertices (vertex shader)
+		vshader_data.mat_world = pobj->transform.GetTransformMatrix();
+		vshader_data.mat_normal = MatrixNormal(vshader_data.mat_world);
+		vshader_data.transform = vshader_data.mat_world * vshader_data.mat_view * vshader_data.mat_project;
+		vshader_data.mat_uv = pobj->uv_transform.GetTransformMatrix();
+		drawer.SetShadingRate(pobj->shading_rate);
+		Mesh& mesh = GetObjectMesh(pobj);
+		stats.triangle_count += mesh.TriangleCount();
+		std::vector<Vertex> vertices;
+		vertices.reserve(mesh.VertexCount());
+		if (mesh.GetLayout() == MeshLayout::AoS)
+		{
+			for (auto& v : mesh.GetVertices())
+				vertices.push_back(vertex_shader(vshader_data, v));
+		}
+		else
+		{
+			for (size_t i = 0; i < mesh.VertexCount(); i++)
+				vertices.push_back(vertex_shader(vshader_data, mesh.GetVertex(i)));
+		}
+
+		// Clipping and back-face culling
+		auto& tris_mesh = mesh.GetTriangles();
+		std::vector<int> triangles;
+		Point origin = projection.GetOrigin();
+		for (size_t i = 0; i < tris_mesh.size(); i += 3)
+		{
+			int a = tris_mesh[i], b = tris_mesh[i + 1], c = tris_mesh[i + 2];
+			Vertex& va = vertices[a], & vb = vertices[b], & vc = vertices[c];
+
+			auto sight = va.p - origin;
+			auto normal = TrianglesNormal(va.p, vb.p, vc.p);
+			auto dot_sight_normal = VectorDot(sight, normal);
+
+			if ((dot_sight_normal < 0) != projection.reversed_z) // judge back-face
+			{
+				if (ClipPointInside(va.p) && ClipPointInside(vb.p) && ClipPointInside(vc.p))
 				{
-					drawerf.Triangle(pa, pb, pc, drawerf.ColorRGB(VertexRecover(va).c));
-				}*/
-				else if (render_mode == RenderMode::Shader)
+					triangles.push_back(a); triangles.push_back(b); triangles.push_back(c);
+				}
+				else // clipping
 				{
-					drawer.Triangle(va, vb, vc, pixel_shader, pshader_data);
+					ClipTriangleCohenSutherland(vertices, triangles, a, b, c);
 				}
 			}
 		}
 
-		return buffer;
+		// Mapping to screen
+		for (auto& v : vertices)
+		{
+			// (-1,-1) -> (0,h), (1,1) -> (w,0)
+			v *= 1 / v.p.w;
+			v.p.x = (v.p.x + 1) * width / 2;
+			v.p.y = (-v.p.y + 1) * height / 2;
+		}
+
+		// Traverse all triangles and sampling
+		// Compute color for all sampling points (pixel shader)
+		// Use z-buffer merge multiple colors
+		pshader_data.texture = pobj->texture;
+		pshader_data.texture2 = pobj->texture2;
+		pshader_data.sampler = pobj->sampler;
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			int a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+			Vertex& va = vertices[a], & vb = vertices[b], & vc = vertices[c];
+			Point& pa = va.p, & pb = vb.p, & pc = vc.p;
+			if (render_mode == RenderMode::Wireframe)
+			{
+				drawerf.Line(pa, pb, drawerf.white);
+				drawerf.Line(pa, pc, drawerf.white);
+				drawerf.Line(pb, pc, drawerf.white);
+			}
+			else if (render_mode == RenderMode::PureWhite)
+			{
+				drawerf.Triangle(pa, pb, pc, drawerf.white);
+			}
+			/*else if (render_mode == RenderMode::FlatColor)
+			{
+				drawerf.Triangle(pa, pb, pc, drawerf.ColorRGB(VertexRecover(va).c));
+			}*/
+			else if (render_mode == RenderMode::Shader)
+			{
+				if (pixel_shader_packet && !drawer.GetMsaa()
+					&& pobj->shading_rate == ShadingRate::Rate1x1 && shading_rate_image == nullptr)
+					drawer.Triangle(va, vb, vc, pixel_shader_packet, pshader_data);
+				else
+					drawer.Triangle(va, vb, vc, pixel_shader, pshader_data);
+			}
+		}
 	}
 
+	// Core Function
+	const uint* Camera::RenderImage(RenderScene& scene)
+	{
+		// draw to target directly if it has the same layout, or convert own buffer to it at last
+		assert(target.data == nullptr || (target.width == width && target.height == height));
+		bool direct = target.data != nullptr && target.format == RenderTarget::Format::BGRA8
+			&& target.stride % sizeof(uint) == 0;
+		if (direct)
+		{
+			image = static_cast<uint*>(target.data);
+			image_pitch = target.stride / sizeof(uint);
+		}
+		else
+		{
+			ReserveBuffer();
+			image = buffer;
+			image_pitch = width;
+		}
 
+		// prepare drawer
+		int size = height * width;
+		zbuffer.resize(static_cast<size_t>(size) * DepthBuffer::PixelSize(depth_format) / sizeof(uint) + 1);
+		DepthBuffer depth(depth_format, zbuffer.data());
+		if (tile_clear == nullptr || tile_clear->GetWidth() != width || tile_clear->GetHeight() != height)
+			tile_clear = std::make_unique<TileClear>(width, height);
+		DrawerV drawer(image, width, height, depth, image_pitch);
+		DrawerF drawerf(image, width, height, image_pitch);
+		drawer.SetTileClear(tile_clear.get());
+		drawerf.SetTileClear(tile_clear.get());
+		drawer.SetZReversed(projection.reversed_z);
+		drawer.SetShadingRateImage(shading_rate_image);
+		// prepare shader data
+		VertexShaderData vshader_data;
+		PixelShaderData pshader_data;
+		vshader_data.mat_view = transform.GetInverseTransformMatrix();
+		vshader_data.mat_project = projection.GetTransformMatrix();
+		// msaa
+		bool use_msaa = msaa == DrawerV::msaa_samples && render_mode == RenderMode::Shader;
+		if (use_msaa)
+		{
+			size_t sample_count = static_cast<size_t>(size) * DrawerV::msaa_samples;
+			sample_buffer.resize(sample_count);
+			sample_zbuffer.resize(sample_count);
+			drawer.SetMsaa(sample_buffer.data(), sample_zbuffer.data());
+			tile_clear->SetBuffers(image, depth, sample_buffer.data(), sample_zbuffer.data(), DrawerV::msaa_samples, image_pitch);
+		}
+		else
+			tile_clear->SetBuffers(image, depth, nullptr, nullptr, 1, image_pitch);
+		// clear lazily, tiles are cleared when they are first drawn
+		drawer.Fill(0U);
+		drawer.FillZ(projection.reversed_z ? 0.0f : 1.0f);
+		// pick LODs once, depth pre-pass and shading must draw the same mesh
+		// levels of objects removed from scene are dropped
+		stats.triangle_count = 0;
+		std::unordered_map<const RenderObject*, int> levels;
+		for (auto pobj = scene.GetRenderObject(); pobj; pobj = scene.GetRenderObject(pobj))
+		{
+			if (pobj->lods.empty())
+				continue;
+			auto it = lod_levels.find(&*pobj);
+			levels[&*pobj] = SelectLod(&*pobj, vshader_data.mat_view, it == lod_levels.end() ? 0 : it->second);
+		}
+		lod_levels.swap(levels);
+		// depth pre-pass
+		if (depth_prepass && render_mode == RenderMode::Shader && !use_msaa)
+		{
+			DepthRenderer renderer(depth, width, height);
+			renderer.SetTileClear(tile_clear.get());
+			renderer.SetZReversed(projection.reversed_z);
+			Point origin = projection.GetOrigin();
+			for (auto pobj = scene.GetRenderObject(); pobj; pobj = scene.GetRenderObject(pobj))
+			{
+				if (pobj->transparent)
+					continue;
+				// same with transform of vertex shader data
+				Matrix transform_obj = pobj->transform.GetTransformMatrix() * vshader_data.mat_view * vshader_data.mat_project;
+				renderer.Draw(GetObjectMesh(&*pobj), transform_obj, true, origin);
+			}
+			drawer.SetZEqual(true);
+		}
+		pshader_data.shadow_map = shadow_map;
+		if (shadow_map != nullptr)
+		{
+			// screen -> ndc -> view -> world -> shadow map clip space
+			Matrix mat_screen(2.0f / width, 0, 0, 0,
+				0, -2.0f / height, 0, 0,
+				0, 0, 1, 0,
+				-1, 1, 0, 1);
+			pshader_data.mat_shadow = mat_screen * projection.GetInverseTransformMatrix()
+				* transform.GetTransformMatrix() * shadow_map->GetTransformMatrix();
+		}
+		// traverse opaque objects
+		std::vector<RenderObject*> transparent_objs;
+		for (auto pobj = scene.GetRenderObject(); pobj; pobj = scene.GetRenderObject(pobj))
+		{
+			if (pobj->transparent)
+				transparent_objs.push_back(&*pobj);
+			else
+				DrawObject(&*pobj, drawer, drawerf, vshader_data, pshader_data);
+		}
+
+		// transparent objects
+		bool use_oit = false;
+		if (!transparent_objs.empty())
+		{
+			drawer.SetZEqual(false);
+			if (transparency_mode == TransparencyMode::Sorted || render_mode != RenderMode::Shader)
+			{
+				// sort by depth of center in view space, from back to front
+				std::vector<uint> keys;
+				for (auto pobj : transparent_objs)
+					keys.push_back(~FloatSortKey((pobj->transform.pos * vshader_data.mat_view).z));
+				RadixSort(keys, transparent_objs);
+				drawer.SetOutput(DrawerV::Output::Blend);
+				for (auto pobj : transparent_objs)
+					DrawObject(pobj, drawer, drawerf, vshader_data, pshader_data);
+			}
+			else
+			{
+				if (kbuffer == nullptr || kbuffer->GetWidth() != width || kbuffer->GetHeight() != height)
+					kbuffer = std::make_unique<KBuffer>(width, height);
+				drawer.SetOutput(DrawerV::Output::OIT, kbuffer.get());
+				for (auto pobj : transparent_objs)
+					DrawObject(pobj, drawer, drawerf, vshader_data, pshader_data);
+				use_oit = true;
+			}
+		}
+
+		// resolve samples first, then blend k-buffer over it
+		if (use_msaa)
+			drawer.ResolveMsaa();
+		if (use_oit)
+			kbuffer->Resolve(image, image_pitch);
+		// fill tiles that nothing drew
+		tile_clear->Finish();
+
+		if (target.data != nullptr && !direct)
+			ConvertImage(image, width, height, target);
+
+		stats.pixel_count = drawer.GetPixelCount();
+
+		return image;
+	}
+
+
+
+	ShadowMap::ShadowMap(int _width, int _height)
+		: width(_width), height(_height), buffer(new float[static_cast<size_t>(_width) * _height]), bias(0.005f), lod(0)
+	{
+		std::fill(buffer, buffer + static_cast<size_t>(width) * height, 1.0f);
+	}
+
+	ShadowMap::~ShadowMap()
+	{
+		delete[] buffer;
+	}
+
+	Matrix ShadowMap::GetTransformMatrix()
+	{
+		return transform.GetInverseTransformMatrix() * projection.GetTransformMatrix();
+	}
+
+	void ShadowMap::Render(RenderScene& scene)
+	{
+		DepthRenderer renderer(buffer, width, height);
+		renderer.SetZReversed(projection.reversed_z);
+		renderer.Clear();
+		Matrix mat_light = GetTransformMatrix();
+		for (auto pobj = scene.GetRenderObject(); pobj; pobj = scene.GetRenderObject(pobj))
+			renderer.Draw(pobj->GetMesh(lod), pobj->transform.GetTransformMatrix() * mat_light, false, Point());
+	}
+
+	float ShadowMap::GetLight(Point p) const
+	{
+		float f = 1 / p.w;
+		int x = static_cast<int>((p.x * f + 1) * width / 2);
+		int y = static_cast<int>((-p.y * f + 1) * height / 2);
+		if (x < 0 || x >= width || y < 0 || y >= height || p.w <= 0)
+			return 1.0f;
+		if (projection.reversed_z)
+			return (p.z * f + bias >= buffer[y * width + x]) ? 1.0f : 0.0f;
+		return (p.z * f - bias <= buffer[y * width + x]) ? 1.0f : 0.0f;
+	}
+
+	float ShadowMap::GetLightPCF(Point p) const
+	{
+		float f = 1 / p.w;
+		int x0 = static_cast<int>((p.x * f + 1) * width / 2);
+		int y0 = static_cast<int>((-p.y * f + 1) * height / 2);
+		if (x0 < 0 || x0 >= width || y0 < 0 || y0 >= height || p.w <= 0)
+			return 1.0f;
+		// compare -z for reversed-z, then nearer is smaller as usual
+		float sign = projection.reversed_z ? -1.0f : 1.0f;
+		float z = p.z * f * sign - bias;
+		int lit = 0;
+		for (int y = y0 - 1; y <= y0 + 1; y++)
+		{
+			for (int x = x0 - 1; x <= x0 + 1; x++)
+			{
+				int xc = Clamp(x, 0, width - 1), yc = Clamp(y, 0, height - 1);
+				if (z <= buffer[yc * width + xc] * sign)
+					lit++;
+			}
+		}
+		return lit / 9.0f;
+	}
 
 	RenderObject::RenderObject(std::shared_ptr<Mesh> _pmesh, std::shared_ptr<Texture> _pt, std::shared_ptr<Texture> _pt2)
-		: pmesh(_pmesh), texture(_pt), texture2(_pt2)
+		: pmesh(_pmesh), texture(_pt), texture2(_pt2), transparent(false),
+		shading_rate(ShadingRate::Rate1x1)
 	{
 	}
 
@@ -113,31 +505,84 @@ namespace Rehenz
 	{
 	}
 
+	RenderTarget::RenderTarget() : data(nullptr), width(0), height(0), stride(0), format(Format::BGRA8)
+	{
+	}
+
+	RenderTarget::RenderTarget(void* _data, int _width, int _height, int _stride, Format _format)
+		: data(_data), width(_width), height(_height), stride(_stride), format(_format)
+	{
+		assert(stride >= width * PixelSize(format));
+	}
+
+	int RenderTarget::PixelSize(Format format)
+	{
+		switch (format)
+		{
+		case Format::BGRA8:
+		case Format::RGBA8:
+			return 4;
+		case Format::RGB565:
+			return 2;
+		case Format::Float:
+			return 16;
+		}
+		return 0;
+	}
+
 	Camera::Camera(int _height, int _width)
 	{
 		height = _height;
 		width = _width;
-		int size = height * width;
-		buffer = new uint[size];
+		buffer_capacity = static_cast<size_t>(height) * width;
+		buffer = new uint[buffer_capacity];
+		image = buffer;
+		image_pitch = width;
 
 		transform.pos = Vector(0, 0, -5);
 		projection.aspect = static_cast<float>(width) / height;
 
 		render_mode = RenderMode::Wireframe;
+		depth_prepass = false;
+		transparency_mode = TransparencyMode::Sorted;
+		msaa = 1;
+		depth_format = DepthFormat::Float32;
+		stats.pixel_count = 0;
+		stats.triangle_count = 0;
 		vertex_shader = DefaultVertexShader;
 		pixel_shader = DefaultPixelShader;
+		pixel_shader_packet = nullptr;
+		shading_rate_image = nullptr;
+		lod_pixel_error = 1;
+		lod_bias = 0;
+		lod_hysteresis = 0.25f;
 	}
 
+	// render target is not copied, memory of caller should have one owner
 	Camera::Camera(const Camera& c) : transform(c.transform), projection(c.projection)
 	{
 		height = c.height;
 		width = c.width;
-		int size = height * width;
-		buffer = new uint[size];
+		buffer_capacity = static_cast<size_t>(height) * width;
+		buffer = new uint[buffer_capacity];
+		image = buffer;
+		image_pitch = width;
 
 		render_mode = c.render_mode;
+		depth_prepass = c.depth_prepass;
+		transparency_mode = c.transparency_mode;
+		msaa = c.msaa;
+		depth_format = c.depth_format;
+		stats.pixel_count = 0;
+		stats.triangle_count = 0;
 		vertex_shader = c.vertex_shader;
 		pixel_shader = c.pixel_shader;
+		shadow_map = c.shadow_map;
+		pixel_shader_packet = c.pixel_shader_packet;
+		shading_rate_image = c.shading_rate_image;
+		lod_pixel_error = c.lod_pixel_error;
+		lod_bias = c.lod_bias;
+		lod_hysteresis = c.lod_hysteresis;
 	}
 
 	Camera::~Camera()
@@ -147,15 +592,38 @@ namespace Rehenz
 
 	void Camera::SetSize(int _height, int _width)
 	{
-		delete[] buffer;
+		// target has memory of old size
+		target = RenderTarget();
 		height = _height;
 		width = _width;
-		int size = height * width;
-		buffer = new uint[size];
-		
+		ReserveBuffer();
+		image = buffer;
+		image_pitch = width;
+
 		projection.aspect = static_cast<float>(width) / height;
 	}
 
+	void Camera::SetRenderTarget(const RenderTarget& _target)
+	{
+		target = _target;
+		if (target.data == nullptr)
+			return;
+		// own buffer is allocated when rendering if it is required
+		height = target.height;
+		width = target.width;
+		projection.aspect = static_cast<float>(width) / height;
+	}
+
+	void Camera::ReserveBuffer()
+	{
+		size_t size = static_cast<size_t>(height) * width;
+		if (size <= buffer_capacity)
+			return;
+		delete[] buffer;
+		buffer = new uint[size];
+		buffer_capacity = size;
+	}
+
 
 
 	RenderScene RenderScene::global_scene = RenderScene();
@@ -223,7 +691,24 @@ namespace Rehenz
 
 	Matrix Transform::GetInverseTransformMatrix()
 	{
-		return  GetInverseMatrixT(pos) * GetInverseMatrixA(axes) * GetInverseMatrixS(scale);
+		// (S * A * T)^-1 = T^-1 * transpose(A) * S^-1, no general inverse needed
+		Matrix result = MatrixTranspose(GetMatrixA(axes));
+		for (int i = 0; i < 3; i++)
+		{
+			result(i, 0) /= scale.x;
+			result(i, 1) /= scale.y;
+			result(i, 2) /= scale.z;
+		}
+		for (int j = 0; j < 3; j++)
+			result(3, j) = -(pos.x * result(0, j) + pos.y * result(1, j) + pos.z * result(2, j));
+		return result;
+	}
+
+	void Transform::SetTransformMatrix(const Matrix& m)
+	{
+		Matrix rotation;
+		MatrixDecompose(m, scale, rotation, pos);
+		axes = GetAircraftAxes(rotation);
 	}
 
 	Vector Transform::GetFront()
@@ -282,7 +767,7 @@ namespace Rehenz
 			axes.pitch = -atanf(front.y / r);
 	}
 
-	Projection::Projection() :fovy(pi_div2), aspect(1), z_near(1), z_far(500)
+	Projection::Projection() :fovy(pi_div2), aspect(1), z_near(1), z_far(500), reversed_z(false)
 	{
 	}
 
@@ -292,12 +777,17 @@ namespace Rehenz
 
 	Matrix Projection::GetTransformMatrix()
 	{
-		return GetMatrixP(fovy, aspect, z_near, z_far);
+		return reversed_z ? GetMatrixPReversed(fovy, aspect, z_near, z_far) : GetMatrixP(fovy, aspect, z_near, z_far);
+	}
+
+	Matrix Projection::GetInverseTransformMatrix()
+	{
+		return reversed_z ? GetInverseMatrixPReversed(fovy, aspect, z_near, z_far) : GetInverseMatrixP(fovy, aspect, z_near, z_far);
 	}
 
 	Point Projection::GetOrigin()
 	{
-		return Rehenz::GetOriginP(z_near, z_far);
+		return reversed_z ? Rehenz::GetOriginPReversed(z_near, z_far) : Rehenz::GetOriginP(z_near, z_far);
 	}
 
 }
@@ -3,7 +3,9 @@
 #include "math.h"
 #include <vector>
 #include <memory>
+#include <unordered_map>
 #include "mesh.h"
+#include "mesh_simplify.h"
 
 namespace Rehenz
 {
@@ -13,7 +15,18 @@ namespace Rehenz
 	class RenderObject;
 	class RenderScene;
 
+	struct RenderTarget;
 	class Camera;
+	class ShadowMap;
+	class KBuffer;
+	class TileClear;
+	class DrawerV;
+	class DrawerF;
+	enum class DepthFormat;
+	enum class ShadingRate : uchar;
+
+	// texture or vertex color, darkened in shadow of PixelShaderData::shadow_map
+	extern PixelShader ShadowPixelShader;
 
 
 
@@ -28,7 +41,10 @@ namespace Rehenz
 		~Transform();
 
 		Matrix GetTransformMatrix();
+		// inverse of GetTransformMatrix, built from transposed rotation
 		Matrix GetInverseTransformMatrix();
+		// set pos, axes and scale from affine matrix, only shear is lost
+		void SetTransformMatrix(const Matrix& m);
 
 		Vector GetFront();
 		Vector GetUp();
@@ -43,12 +59,16 @@ namespace Rehenz
 	{
 	public:
 		float fovy, aspect, z_near, z_far;
+		// map z_near to 1 and z_far to 0, Camera and ShadowMap flip depth test and clear z to 0
+		// back faces have positive dot of sight and normal in this space
+		bool reversed_z;
 
-		// default fovy = pi/2, aspect = 1, z_near = 1, z_far = 500
+		// default fovy = pi/2, aspect = 1, z_near = 1, z_far = 500, reversed_z = false
 		Projection();
 		~Projection();
 
 		Matrix GetTransformMatrix();
+		Matrix GetInverseTransformMatrix();
 
 		Point GetOrigin();
 	};
@@ -58,15 +78,32 @@ namespace Rehenz
 	private:
 	public:
 		Transform transform;
+		// transform uv of mesh, such as scroll or rotate texture
+		Transform uv_transform;
 
 		std::shared_ptr<Mesh> pmesh;
+		// levels of detail from fine to coarse such as from CreateLodChain, pmesh is drawn if empty
+		// each Camera picks one by projected size, see Camera::lod_pixel_error
+		std::vector<MeshLod> lods;
 
 		std::shared_ptr<Texture> texture;
 		std::shared_ptr<Texture> texture2;
+		// override sampler of textures if not nullptr
+		std::shared_ptr<Sampler> sampler;
+		// blend by alpha of pixel shader output, drawn after opaque objects and not write z-buffer
+		bool transparent;
+		// shade blocks of pixels once, default is Rate1x1, see DrawerV::SetShadingRate
+		ShadingRate shading_rate;
 
 		explicit RenderObject(std::shared_ptr<Mesh> _pmesh = nullptr,
 			std::shared_ptr<Texture> _pt = nullptr, std::shared_ptr<Texture> _pt2 = nullptr);
 		~RenderObject();
+
+		// mesh of LOD lod clamped to lods, or pmesh if lods is empty
+		inline Mesh& GetMesh(int lod = 0)
+		{
+			return lods.empty() ? *pmesh : *lods[Clamp(lod, 0, static_cast<int>(lods.size()) - 1)].mesh;
+		}
 	};
 
 	class RenderScene
@@ -87,6 +124,7 @@ namespace Rehenz
 			obj_reader() { index = 0; pobj = nullptr; }
 			inline operator bool() { return pobj != nullptr; }
 			inline RenderObject* operator->() { return pobj; }
+			inline RenderObject& operator*() { return *pobj; }
 		};
 
 		RenderScene();
@@ -125,12 +163,113 @@ namespace Rehenz
 		RenderScene::global_scene.GetRenderObject(prev);
 	}
 
+	// depth map rendered from the view of a light
+	// render it before cameras, then pixel shaders can test whether a pixel is lit
+	class ShadowMap
+	{
+	public:
+		const int width;
+		const int height;
+		// depth in [0,1], row-major
+		float* const buffer;
+
+		// light view
+		Transform transform;
+		Projection projection;
+		// added to depth of pixel before compare, avoid shadow acne
+		float bias;
+		// LOD drawn by objects with lods, clamped to the coarsest, default is 0
+		int lod;
+
+		explicit ShadowMap(int _width, int _height);
+		ShadowMap(const ShadowMap&) = delete;
+		ShadowMap& operator=(const ShadowMap&) = delete;
+		~ShadowMap();
+
+		// world space -> shadow map clip space
+		Matrix GetTransformMatrix();
+
+		// render depth of all objects, only position is used, objects with lods draw LOD lod
+		// all faces are drawn, no back-face culling
+		void Render(RenderScene& scene);
+		inline void Render()
+		{
+			Render(RenderScene::global_scene);
+		}
+
+		// p is in shadow map clip space
+		// depth is float, and reversed_z of projection is supported
+		// return 1 if lit, 0 if in shadow, and points out of the map are lit
+		float GetLight(Point p) const;
+		// 3x3 percentage closer filtering, return [0,1]
+		float GetLightPCF(Point p) const;
+	};
+
+	// memory owned by caller, Camera renders into it, see Camera::SetRenderTarget
+	struct RenderTarget
+	{
+		// BGRA8  : same layout with image of Camera, drawn directly if stride is a multiple of 4
+		// RGBA8  : converted from image of Camera at end of rendering
+		// RGB565 : converted as above
+		// Float  : 4 floats r,g,b,a, converted as above
+		// alpha is not rendered, it is 0 for 8 bits formats like image of Camera, and 1 for Float
+		enum class Format { BGRA8, RGBA8, RGB565, Float };
+
+		void* data;
+		int width, height;
+		// bytes per row
+		int stride;
+		Format format;
+
+		// no target
+		RenderTarget();
+		RenderTarget(void* _data, int _width, int _height, int _stride, Format _format);
+
+		// bytes per pixel
+		static int PixelSize(Format format);
+	};
+
 	class Camera
 	{
+	public:
+		// statistics of last rendering
+		struct RenderStats
+		{
+			// count of pixels passed z test and shaded
+			size_t pixel_count;
+			// count of triangles of meshes drawn, before culling and clipping
+			size_t triangle_count;
+		};
+
 	private:
 		int height, width;
-		// last buffer image
+		// own image, only grows
 		uint* buffer;
+		size_t buffer_capacity;
+		// render into it if data is not nullptr
+		RenderTarget target;
+		// last image, buffer or data of target, and its row stride in pixels
+		uint* image;
+		int image_pitch;
+		RenderStats stats;
+		// for TransparencyMode::OIT, created when first used
+		std::unique_ptr<KBuffer> kbuffer;
+		// buffers kept between frames, and cleared lazily by tile_clear
+		// z-buffer is words of depth_format
+		std::vector<uint> zbuffer;
+		std::vector<uint> sample_buffer;
+		std::vector<float> sample_zbuffer;
+		std::unique_ptr<TileClear> tile_clear;
+		// LOD picked for objects with lods in last frame, kept for hysteresis
+		std::unordered_map<const RenderObject*, int> lod_levels;
+
+		void ReserveBuffer();
+		// pick LOD of object with lods from its bounding sphere, lod is last picked, mat_view is world -> view
+		int SelectLod(RenderObject* pobj, const Matrix& mat_view, int lod);
+		// mesh of LOD picked in this frame
+		Mesh& GetObjectMesh(RenderObject* pobj);
+		void DrawObject(RenderObject* pobj, DrawerV& drawer, DrawerF& drawerf,
+			VertexShaderData& vshader_data, PixelShaderData& pshader_data);
 
 	public:
 		Transform transform;
@@ -138,8 +277,37 @@ namespace Rehenz
 
 		enum class RenderMode { Wireframe, PureWhite, /*FlatColor,*/ Shader };
 		RenderMode render_mode;
+		// draw depth of all objects first, then shade only the nearest pixels
+		// vertex shader must transform position like DefaultVertexShader
+		bool depth_prepass;
+		// Sorted : sort transparent objects from back to front by center, then blend them
+		//          triangles in one object are not sorted
+		// OIT    : keep nearest fragments of each pixel in a k-buffer, then blend them in order
+		enum class TransparencyMode { Sorted, OIT };
+		TransparencyMode transparency_mode;
+		// format of z-buffer for main pass and depth pre-pass, default is Float32
+		// integer formats suit z of reversed_z = false, float suits reversed_z = true
+		DepthFormat depth_format;
+		// samples per pixel, 1 or 4, only for RenderMode::Shader
+		// pixel_shader_packet and depth_prepass are not used when msaa is 4
+		int msaa;
 		VertexShader vertex_shader;
 		PixelShader pixel_shader;
+		// passed to pixel shaders, render it before camera
+		std::shared_ptr<ShadowMap> shadow_map;
+		// use it rather than pixel_shader if not nullptr, shade 2x2 pixels once
+		// not used by objects with coarse shading rate or when shading_rate_image is set
+		PixelShaderPacket pixel_shader_packet;
+		// lower shading rate by screen tiles, such as at edges or in motion, nullptr to disable
+		// see DrawerV::SetShadingRateImage, memory is owned by caller
+		const ShadingRate* shading_rate_image;
+		// objects with lods draw the coarsest LOD whose error is at most lod_pixel_error pixels on screen, default is 1
+		float lod_pixel_error;
+		// log2 scale of lod_pixel_error for all objects, > 0 picks coarser LODs, default is 0
+		float lod_bias;
+		// a coarser LOD is picked only when its error is below (1 - lod_hysteresis) of the limit,
+		// so objects near a switch distance do not flicker between LODs, default is 0.25
+		float lod_hysteresis;
 
 		// default pos = (0,0,-5)
 		explicit Camera(int _height, int _width);
@@ -149,10 +317,20 @@ namespace Rehenz
 
 		inline int GetHeight() { return height; }
 		inline int GetWidth() { return width; }
-		inline const uint* GetLastImage() { return buffer; }
+		// rows of image are GetLastImagePitch() pixels apart
+		inline const uint* GetLastImage() { return image; }
+		inline int GetLastImagePitch() { return image_pitch; }
+		inline const RenderStats& GetLastStats() { return stats; }
 
+		// own buffer is kept if new size fits in it, render target is detached
 		void SetSize(int _height, int _width);
 
+		// render into memory of caller, and size of camera is set to size of target
+		// a target whose data is nullptr returns to own buffer
+		void SetRenderTarget(const RenderTarget& _target);
+		inline const RenderTarget& GetRenderTarget() { return target; }
+
+		// return image, see GetLastImage
 		const uint* RenderImage(RenderScene& scene);
 		inline const uint* RenderImage()
 		{
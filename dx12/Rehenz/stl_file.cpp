@@ -0,0 +1,157 @@
+#include "stl_file.h"
+#include "mapped_file.h"
+#include "util.h"
+#include <cstring>
+
+namespace Rehenz
+{
+	namespace
+	{
+		// 80 bytes header and triangle count, then 50 bytes per triangle : normal, 3 corners, attribute
+		const size_t stl_header_size = 84;
+		const size_t stl_triangle_size = 50;
+
+		// position of corner c, -0 is read as 0 so they weld
+		inline Vector3 StlCorner(const char* triangles, size_t c)
+		{
+			float f[3];
+			memcpy(f, triangles + (c / 3) * stl_triangle_size + 12 + (c % 3) * 12, sizeof(f));
+			return Vector3(f[0] + 0.0f, f[1] + 0.0f, f[2] + 0.0f);
+		}
+
+		inline uint StlHash(Vector3 p)
+		{
+			uint x, y, z;
+			memcpy(&x, &p.x, 4);
+			memcpy(&y, &p.y, 4);
+			memcpy(&z, &p.z, 4);
+			uint h = x * 73856093u ^ y * 19349663u ^ z * 83492791u;
+			h ^= h >> 16;
+			h *= 0x85ebca6bu;
+			h ^= h >> 13;
+			return h;
+		}
+	}
+
+	std::shared_ptr<Mesh> CreateMeshFromStlFile(const std::string& filename, int threads)
+	{
+		MappedFile file(filename);
+		if (file.Data() == nullptr || file.Size() < stl_header_size)
+			return nullptr;
+		uint triangle_count = 0;
+		memcpy(&triangle_count, file.Data() + 80, 4);
+		if (file.Size() != stl_header_size + static_cast<ullong>(triangle_count) * stl_triangle_size || triangle_count > 0x7fffffff / 3)
+			return nullptr;
+		const char* data = file.Data() + stl_header_size;
+		size_t corner_count = static_cast<size_t>(triangle_count) * 3;
+
+		// weld by hash of position, hashes are split to a partition per thread, so no table is shared
+		// every thread reads all corners and keeps those of its partition, the first corner of a position is kept
+		// triangles[c] is the kept corner of c
+		if (threads <= 0)
+			threads = static_cast<int>(std::thread::hardware_concurrency());
+		uint parts = static_cast<uint>(Clamp(static_cast<int>(corner_count / 65536), 1, Max(threads, 1)));
+		std::vector<int> triangles(corner_count);
+		std::vector<size_t> part_vertex_count(parts);
+		ParallelFor(parts, 1, [&](size_t begin, size_t end)
+			{
+				for (size_t part = begin; part < end; part++)
+				{
+					// open addressing, a slot is kept corner + 1 (0 is empty) and its hash
+					uint size = 1024;
+					while (size < corner_count / parts / 2)
+						size <<= 1;
+					std::vector<uint> slots(size * 2, 0);
+					size_t count = 0;
+					for (size_t c = 0; c < corner_count; c++)
+					{
+						Vector3 p = StlCorner(data, c);
+						uint h = StlHash(p);
+						if (static_cast<size_t>((static_cast<ullong>(h) * parts) >> 32) != part)
+							continue;
+						uint mask = size - 1;
+						for (uint i = h & mask;; i = (i + 1) & mask)
+						{
+							if (slots[i * 2] == 0)
+							{
+								slots[i * 2] = static_cast<uint>(c + 1);
+								slots[i * 2 + 1] = h;
+								triangles[c] = static_cast<int>(c);
+								count++;
+								break;
+							}
+							if (slots[i * 2 + 1] == h && StlCorner(data, slots[i * 2] - 1) == p)
+							{
+								triangles[c] = static_cast<int>(slots[i * 2] - 1);
+								break;
+							}
+						}
+						// keep table at most half full
+						if (count * 2 > size)
+						{
+							std::vector<uint> grown(size * 4, 0);
+							uint grown_mask = size * 2 - 1;
+							for (uint i = 0; i < size; i++)
+							{
+								if (slots[i * 2] == 0)
+									continue;
+								uint k = slots[i * 2 + 1] & grown_mask;
+								while (grown[k * 2] != 0)
+									k = (k + 1) & grown_mask;
+								grown[k * 2] = slots[i * 2];
+								grown[k * 2 + 1] = slots[i * 2 + 1];
+							}
+							slots.swap(grown);
+							size *= 2;
+						}
+					}
+					part_vertex_count[part] = count;
+				}
+			}, static_cast<int>(parts));
+
+		// kept corners become vertices in corner order, a kept corner is before the corners merged to it
+		size_t vertex_count = 0;
+		for (auto count : part_vertex_count)
+			vertex_count += count;
+		std::vector<Vector3> positions;
+		positions.reserve(vertex_count);
+		for (size_t c = 0; c < corner_count; c++)
+		{
+			if (triangles[c] == static_cast<int>(c))
+			{
+				triangles[c] = static_cast<int>(positions.size());
+				positions.push_back(StlCorner(data, c));
+			}
+			else
+				triangles[c] = triangles[triangles[c]];
+		}
+
+		// drop degenerate triangles and sum area weighted face normals
+		std::vector<Vector3> normals(vertex_count);
+		size_t kept = 0;
+		for (size_t i = 0; i < corner_count; i += 3)
+		{
+			int a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+			if (a == b || b == c || c == a)
+				continue;
+			Vector3 n = VectorCross(positions[b] - positions[a], positions[c] - positions[a]);
+			normals[a] += n;
+			normals[b] += n;
+			normals[c] += n;
+			triangles[kept++] = a;
+			triangles[kept++] = b;
+			triangles[kept++] = c;
+		}
+		triangles.resize(kept);
+		ParallelFor(vertex_count, 16384, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					normals[i] = VectorNormalize(normals[i]);
+			}, threads);
+
+		auto mesh = std::make_shared<Mesh>();
+		mesh->SetStreams(std::move(positions), std::move(normals), std::vector<Color>(), std::vector<UV>(), std::vector<UV>());
+		mesh->SetTriangles(std::move(triangles));
+		return mesh;
+	}
+}
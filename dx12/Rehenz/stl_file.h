@@ -0,0 +1,12 @@
+#pragma once
+#include "mesh.h"
+
+// binary .stl mesh loading, ascii .stl is not supported
+namespace Rehenz
+{
+	// corners of the same position are welded to one vertex while loading, triangles that become degenerate are dropped
+	// normals are area weighted sums of face normals, normals and attribute bytes in the file are ignored
+	// the file is memory-mapped and welded by threads, 0 is hardware concurrency
+	// return nullptr if file can not be opened or its size does not match its triangle count
+	std::shared_ptr<Mesh> CreateMeshFromStlFile(const std::string& filename, int threads = 0);
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include <utility>
+#include <vector>
+#include <thread>
 
 namespace Rehenz
 {
@@ -20,4 +22,28 @@ namespace Rehenz
 		if (c < b)
 			std::swap(b, c);
 	}
-}
\ No newline at end of file
+
+	// split [0,count) into ranges of at least min_range, call f(begin, end) for each range by threads
+	// 0 threads is hardware concurrency, first range runs on calling thread
+	template <typename F>
+	inline void ParallelFor(size_t count, size_t min_range, F f, int threads = 0)
+	{
+		if (threads <= 0)
+			threads = static_cast<int>(std::thread::hardware_concurrency());
+		size_t range_count = count / (min_range > 0 ? min_range : 1);
+		if (range_count > static_cast<size_t>(threads))
+			range_count = static_cast<size_t>(threads);
+		if (range_count <= 1)
+		{
+			if (count > 0)
+				f(static_cast<size_t>(0), count);
+			return;
+		}
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < range_count; i++)
+			workers.emplace_back(f, count * i / range_count, count * (i + 1) / range_count);
+		f(static_cast<size_t>(0), count / range_count);
+		for (auto& t : workers)
+			t.join();
+	}
+}
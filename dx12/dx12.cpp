@@ -1181,12 +1181,19 @@ namespace Dx12
         return p;
     }
 
-    std::shared_ptr<MeshDx12> MeshDx12::CreateFromRehenzMesh(std::shared_ptr<Rehenz::Mesh> mesh)
+    std::shared_ptr<MeshDx12> MeshDx12::CreateFromRehenzMesh(std::shared_ptr<Rehenz::Mesh> mesh, bool optimize)
     {
         HRESULT hr = S_OK;
 
         std::shared_ptr<MeshDx12> p(new MeshDx12);
 
+        // upload an optimized copy, triangles ordered for post-transform cache and overdraw, vertices in fetch order
+        if (optimize)
+        {
+            mesh = std::make_shared<Rehenz::Mesh>(*mesh);
+            mesh->Optimize();
+        }
+
         // set data
         struct Vertex
         {
@@ -1198,14 +1205,21 @@ namespace Dx12
         };
         std::vector<Vertex> vertices;
         vertices.reserve(mesh->VertexCount());
-        for (auto& v : mesh->GetVertices())
+        // read streams through views, works for AoS and SoA meshes without copying Rehenz::Vertex
+        Rehenz::uint streams = mesh->GetStreams();
+        Rehenz::MeshStreamView pos = mesh->GetStreamView(Rehenz::MeshStreams::position);
+        Rehenz::MeshStreamView normal = mesh->GetStreamView(Rehenz::MeshStreams::normal);
+        Rehenz::MeshStreamView color = mesh->GetStreamView(Rehenz::MeshStreams::color);
+        Rehenz::MeshStreamView uv = mesh->GetStreamView(Rehenz::MeshStreams::uv);
+        Rehenz::MeshStreamView uv2 = mesh->GetStreamView(Rehenz::MeshStreams::uv2);
+        for (size_t i = 0; i < mesh->VertexCount(); i++)
         {
             Vertex vv;
-            vv.pos = XMFLOAT3(v.p.x, v.p.y, v.p.z);
-            vv.normal = XMFLOAT3(v.n.x, v.n.y, v.n.z);
-            vv.color = XMFLOAT4(v.c.x, v.c.y, v.c.z, v.c.w);
-            vv.uv = XMFLOAT2(v.uv.x, v.uv.y);
-            vv.uv2 = XMFLOAT2(v.uv2.x, v.uv2.y);
+            vv.pos = XMFLOAT3(pos[i][0], pos[i][1], pos[i][2]);
+            vv.normal = (streams & Rehenz::MeshStreams::normal) ? XMFLOAT3(normal[i][0], normal[i][1], normal[i][2]) : XMFLOAT3(0, 0, 0);
+            vv.color = (streams & Rehenz::MeshStreams::color) ? XMFLOAT4(color[i][0], color[i][1], color[i][2], color[i][3]) : XMFLOAT4(1, 1, 1, 1);
+            vv.uv = (streams & Rehenz::MeshStreams::uv) ? XMFLOAT2(uv[i][0], uv[i][1]) : XMFLOAT2(0, 0);
+            vv.uv2 = (streams & Rehenz::MeshStreams::uv2) ? XMFLOAT2(uv2[i][0], uv2[i][1]) : XMFLOAT2(0, 0);
             vertices.push_back(vv);
         }
         int v_size = sizeof(Vertex);
@@ -1658,9 +1672,10 @@ namespace Dx12
 
         // copy data
         CBObj cb_struct;
-        XMMATRIX world = ToXmMatrix(transform.GetTransformMatrix());
+        Rehenz::Matrix mat_world = transform.GetTransformMatrix();
+        XMMATRIX world = ToXmMatrix(mat_world);
         dxm::XMStoreFloat4x4(&cb_struct.world, dxm::XMMatrixTranspose(world));
-        XMMATRIX inv_world = ToXmMatrix(transform.GetInverseTransformMatrix());
+        XMMATRIX inv_world = ToXmMatrix(Rehenz::MatrixInverseAffine(mat_world));
         dxm::XMStoreFloat4x4(&cb_struct.inv_world, dxm::XMMatrixTranspose(inv_world));
         XMMATRIX uv_tf = ToXmMatrix(uv_transform.GetTransformMatrix());
         dxm::XMStoreFloat4x4(&cb_struct.uv_tf, dxm::XMMatrixTranspose(uv_tf));